@@ -0,0 +1,84 @@
+#ifndef CAFFE_BATCHING_SERVER_HPP_
+#define CAFFE_BATCHING_SERVER_HPP_
+
+#include <deque>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/inference_replicas.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Answers single-sample inference requests from many threads by
+ *        running them through the net in batches.
+ *
+ * Every replica of an InferenceReplicas set has a worker thread. A worker
+ * waits for a request and then for more, until it has max_batch requests
+ * or the first one has waited max_latency_us, reshapes the input blob when
+ * the batch size changed, copies the inputs in, runs Forward and copies
+ * each request's slice of the outputs back. Larger batches amortize the
+ * per-Forward cost (weights read once per batch, larger GEMMs) at the price
+ * of up to max_latency_us of extra latency when the load is low.
+ *
+ * The net must have one input blob whose first axis is the batch; a
+ * request's output is the concatenation of its slices of all output blobs.
+ */
+// 把来自多个线程的单样本请求合并成批次再推理
+template <typename Dtype>
+class BatchingServer {
+ public:
+  /// @brief Counters and latency percentiles of the served requests.
+  struct Stats {
+    int64_t requests;
+    int64_t batches;
+    double seconds;         // since the server started
+    float p50_latency_ms;   // over the last kLatencyWindow requests
+    float p99_latency_ms;
+  };
+  static const int kLatencyWindow = 10000;
+
+  BatchingServer(const shared_ptr<InferenceReplicas<Dtype> >& replicas,
+      int max_batch, int max_latency_us);
+  ~BatchingServer();
+
+  /// @brief Returns the number of values of one request's input / output.
+  inline int input_count() const { return input_count_; }
+  inline int output_count() const { return output_count_; }
+
+  /**
+   * @brief Runs one sample through the net and blocks until its output is
+   *        ready. May be called from any number of threads.
+   */
+  void Predict(const Dtype* input, Dtype* output);
+
+  Stats stats() const;
+
+ protected:
+  struct Request;
+  // 每个副本一个工作线程
+  void Work(int replica);
+
+  shared_ptr<InferenceReplicas<Dtype> > replicas_;
+  int max_batch_;
+  int max_latency_us_;
+  int input_count_;
+  int output_count_;
+  std::deque<Request*> queue_;
+  bool stopping_;
+  int64_t requests_;
+  int64_t batches_;
+  vector<float> latencies_ms_;  // 环形缓冲区
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(BatchingServer);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_BATCHING_SERVER_HPP_
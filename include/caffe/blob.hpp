@@ -296,6 +296,16 @@ class Blob {
    */
   // 将other Blob的diff分享到当前的Blob
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to point to a SyncedMemory buffer that is
+   *        at least count() elements large and may be shared by other Blob%s
+   *        -- used by Net to reuse activation memory during inference.
+   *
+   * A later Reshape that grows beyond the buffer allocates private memory
+   * again.
+   */
+  // 将data指向一块（可能被多个Blob共用的）内存缓冲区
+  void ShareDataBuffer(const shared_ptr<SyncedMemory>& buffer);
   // 判断other BlobProto的形状是否与当前的Blob一致
   bool ShapeEquals(const BlobProto& other);
 
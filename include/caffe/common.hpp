@@ -106,8 +106,39 @@ class Caffe {
   // Thread local context for Caffe. Moved to common.cpp instead of
   // including boost/thread.hpp to avoid a boost/NVCC issues (#1009, #1010)
   // on OSX. Also fails on Linux with CUDA 7.0.18.
+  // Returns the context installed on this thread by a ContextScope, if any,
+  // and otherwise the thread's own context, created on first use.
   static Caffe& Get();
 
+  /**
+   * @brief Creates an execution context with the mode, device and parallel
+   *        training settings of the calling thread and its own RNG (and, on
+   *        the GPU, cuBLAS and cuRAND handles).
+   *
+   * A context may be used by one thread at a time, but by any thread; e.g.
+   * a Net that owns one (see Net::set_context) runs Forward in it on
+   * whichever thread calls Forward, without setting up that thread first.
+   */
+  static shared_ptr<Caffe> CreateContext();
+
+  /**
+   * @brief Makes context the one that Get() returns on this thread until
+   *        the scope ends (and selects its device in GPU mode). Scopes may
+   *        be nested; a NULL context leaves the current one in place.
+   */
+  // 在作用域内把当前线程的 Caffe 状态切换为 context
+  class ContextScope {
+   public:
+    explicit ContextScope(Caffe* context);
+    ~ContextScope();
+   private:
+    Caffe* context_;
+    Caffe* previous_;
+    int previous_device_;
+
+    DISABLE_COPY_AND_ASSIGN(ContextScope);
+  };
+
   enum Brew { CPU, GPU };
 
   // This random number generator facade hides boost and CUDA rng
@@ -175,6 +206,8 @@ class Caffe {
   shared_ptr<RNG> random_generator_;
 
   Brew mode_;
+  // The device the handles were created on, or -1 without a GPU.
+  int device_;
 
   // Parallel training
   int solver_count_;
@@ -9,6 +9,8 @@
 
 namespace caffe {
 
+struct DatumView;
+
 /**
  * @brief Applies common transformations to the input data, such as
  * scaling, mirroring, substracting the image mean...
@@ -37,6 +39,12 @@ class DataTransformer {
    */
   void Transform(const Datum& datum, Blob<Dtype>* transformed_blob);
 
+  /**
+   * @brief As Transform(const Datum&, Blob<Dtype>*), reading the datum in
+   *    place, e.g. from the memory of a DB cursor (see data_layer.cpp).
+   */
+  void Transform(const DatumView& datum, Blob<Dtype>* transformed_blob);
+
   /**
    * @brief Applies the transformation defined in the data layer's
    * transform_param block to a vector of Datum.
@@ -98,6 +106,7 @@ class DataTransformer {
    *    Datum containing the data to be transformed.
    */
   vector<int> InferBlobShape(const Datum& datum);
+  vector<int> InferBlobShape(const DatumView& datum);
   /**
    * @brief Infers the shape of transformed_blob will have when
    *    the transformation is applied to the data.
@@ -138,7 +147,7 @@ class DataTransformer {
    */
   virtual int Rand(int n);
 
-  void Transform(const Datum& datum, Dtype* transformed_data);
+  void Transform(const DatumView& datum, Dtype* transformed_data);
   // Tranformation parameters
   TransformationParameter param_;
 
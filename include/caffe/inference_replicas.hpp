@@ -0,0 +1,69 @@
+#ifndef CAFFE_INFERENCE_REPLICAS_HPP_
+#define CAFFE_INFERENCE_REPLICAS_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A set of TEST phase nets that share one copy of the trained
+ *        weights, e.g. one net per worker thread of an inference server.
+ *
+ * Replica 0 loads the weights; the other replicas point their params at
+ * replica 0's blobs (see Net::ShareTrainedLayersWith), so the weights are
+ * held once however many replicas there are, and each replica only adds its
+ * own activations. The weights are brought to the current mode's memory
+ * before they are shared, so Forward only reads them and different replicas
+ * may run Forward on different threads at the same time. A single replica
+ * must not be used by two threads at once, and the weights must not be
+ * changed while replicas run.
+ *
+ * Each replica owns an execution context (see Caffe::CreateContext) with
+ * the mode and device of the calling thread, so a pool of server threads
+ * may run any replica without setting up Caffe on those threads.
+ */
+// 共享同一份只读权值的多个推理网络，每个副本只有自己的激活内存
+template <typename Dtype>
+class InferenceReplicas {
+ public:
+  /**
+   * @brief Creates count replicas of the net in param_file with the weights
+   *        in weights_file (any format accepted by CopyTrainedLayersFrom).
+   */
+  InferenceReplicas(const string& param_file, const string& weights_file,
+      int count);
+  /// @brief Creates count replicas of param sharing the weights of net.
+  InferenceReplicas(const NetParameter& param, shared_ptr<Net<Dtype> > net,
+      int count);
+
+  inline int size() const { return replicas_.size(); }
+  inline const shared_ptr<Net<Dtype> >& replica(int i) const {
+    return replicas_[i];
+  }
+  /**
+   * @brief Returns the bytes of the shared weights, including the copies
+   *        derived from them for the current shapes, e.g. the transformed
+   *        filters of WinogradConvolutionLayer (also held once).
+   */
+  size_t weights_bytes() const;
+  /// @brief Returns the bytes of the activations of one replica.
+  inline size_t activations_bytes() const { return activations_bytes_; }
+
+ protected:
+  void Init(const NetParameter& param, int count);
+
+  vector<shared_ptr<Net<Dtype> > > replicas_;
+  size_t weights_bytes_;
+  size_t activations_bytes_;
+
+DISABLE_COPY_AND_ASSIGN(InferenceReplicas);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_INFERENCE_REPLICAS_HPP_
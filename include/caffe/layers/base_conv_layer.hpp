@@ -53,6 +53,31 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   // CPU实现后向传播求偏置导数
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
 
+  // Batch-level CPU drivers: the num_ images of a batch are split into
+  // contiguous chunks that run on ThreadPool::Global(), each chunk with its
+  // own column buffer. With a single-threaded pool they reduce to the plain
+  // per-image loop. Weight gradients are accumulated into per-chunk partial
+  // sums and reduced in chunk order, so results are deterministic for a given
+  // thread count.
+  // 整个 batch 的前向传播（bias 为 NULL 时不加偏置）
+  void forward_cpu_batch(const Dtype* input, const Dtype* weights,
+      const Dtype* bias, Dtype* output);
+  // 对输出做融合的 ReLU（fuse_relu_ 为假时什么都不做）
+  inline void forward_cpu_relu(Dtype* output, int count) {
+    if (fuse_relu_) {
+      for (int i = 0; i < count; ++i) {
+        output[i] = output[i] > 0 ? output[i] :
+            output[i] * relu_negative_slope_;
+      }
+    }
+  }
+  // 根据融合 ReLU 的输出把 top diff 原地变换为 ReLU 之前的导数
+  void backward_cpu_relu(const Dtype* output, Dtype* output_diff, int count);
+  // 整个 batch 的后向传播：weight_diff 非空时累加权重导数，
+  // input_diff 非空时计算数据导数，两者共用每个任务的 col buffer
+  void backward_cpu_batch(const Dtype* input, const Dtype* output,
+      const Dtype* weights, Dtype* weight_diff, Dtype* input_diff);
+
 #ifndef CPU_ONLY
   // GPU实现前向传播的卷积操作
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -112,6 +137,8 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_; // 是否启用偏置
   bool is_1x1_; // 是不是1x1卷积
   bool force_nd_im2col_; // 是否强制使用N维通用卷积
+  bool fuse_relu_; // 是否在输出上直接做 ReLU
+  Dtype relu_negative_slope_; // 融合的 ReLU 的负斜率
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
@@ -189,6 +216,22 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   }
 #endif
 
+  // Workers of the batch drivers; col_buffer is the chunk's own scratch space.
+  // 在指定的 col buffer 上完成单张图像的 gemm 计算
+  void forward_cpu_gemm_col(const Dtype* input, const Dtype* weights,
+      Dtype* output, Dtype* col_buffer, bool skip_im2col);
+  void backward_cpu_gemm_col(const Dtype* output, const Dtype* weights,
+      Dtype* input, Dtype* col_buffer);
+  void weight_cpu_gemm_col(const Dtype* input, const Dtype* output,
+      Dtype* weights, Dtype* col_buffer);
+  // 每个线程任务处理 batch 中属于自己的那一段连续图像
+  void forward_cpu_task(int task, int num_tasks, const Dtype* input,
+      const Dtype* weights, const Dtype* bias, Dtype* output);
+  void backward_cpu_task(int task, int num_tasks, const Dtype* input,
+      const Dtype* output, const Dtype* weights, Dtype* input_diff);
+  // 根据线程池大小准备每个任务的 col buffer 与权重导数缓存，返回任务数
+  int setup_cpu_batch(bool need_weight_partials);
+
   int num_kernels_im2col_; // num_kernels_im2col_ = conv_in_channels_ * conv_out_spatial_dim_
   int num_kernels_col2im_; // num_kernels_col2im_ = reverse_dimensions() ? top_dim_ : bottom_dim_
   int conv_out_channels_;  // 卷积的输出通道数，在参数配置文件中设置
@@ -199,6 +242,12 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int output_offset_;
 
   Blob<Dtype> col_buffer_; // im2col的时候使用的存储空间
+  // 并行处理 batch 时除第一个任务外，其余任务各自使用的 col buffer
+  vector<shared_ptr<Blob<Dtype> > > task_col_buffers_;
+  // 并行处理 batch 时除第一个任务外，其余任务各自的权重导数部分和
+  vector<shared_ptr<Blob<Dtype> > > task_weight_diffs_;
+  vector<Dtype*> task_col_data_; // 每个任务的 col buffer 指针
+  vector<Dtype*> task_weight_diff_data_; // 每个任务的权重导数部分和指针
   Blob<Dtype> bias_multiplier_; // 将偏置扩展成矩阵
 };
 
@@ -8,7 +8,7 @@
 #include "caffe/internal_thread.hpp" //处理多线程的代码文件
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
-#include "caffe/util/blocking_queue.hpp" //线程队列的相关文件
+#include "caffe/util/spsc_queue.hpp" //线程队列的相关文件
 
 namespace caffe {
 
@@ -88,10 +88,10 @@ class BasePrefetchingDataLayer :
 
   vector<shared_ptr<Batch<Dtype> > > prefetch_; // batch向量
   // 从 prefetch_free_ 队列取 batch，将该 batch 放到 prefetch_full_ 队列
-  BlockingQueue<Batch<Dtype>*> prefetch_free_;
+  SPSCQueue<Batch<Dtype>*> prefetch_free_;
   // 从 prefetch_full_ 队列取 batch，将该 batch 输入网络计算，
   // 然后在 prefetch_full_ 中清空该 batch，最后将其放到 prefetch_free_ 队列
-  BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  SPSCQueue<Batch<Dtype>*> prefetch_full_;
   Batch<Dtype>* prefetch_current_; // 当前所提取的 batch
 
   Blob<Dtype> transformed_data_; // 转换过的blob数据,中间变量用来辅助图像变换
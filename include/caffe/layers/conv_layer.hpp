@@ -59,7 +59,9 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  group.
    *  - bias_term (\b optional, default true). Whether to have a bias.
    *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
-   *    kernels + stream parallelism) engines.
+   *    kernels + stream parallelism) engines, plus the WINOGRAD and DIRECT
+   *    CPU forward engines (see WinogradConvolutionLayer and
+   *    DirectConvolutionLayer).
    */
   explicit ConvolutionLayer(const LayerParameter& param)
       : BaseConvolutionLayer<Dtype>(param) {}
@@ -1,6 +1,10 @@
 #ifndef CAFFE_DATA_LAYER_HPP_
 #define CAFFE_DATA_LAYER_HPP_
 
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#endif  // USE_OPENCV
+#include <string>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -10,6 +14,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -31,10 +36,40 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
   void Next();
   bool Skip();
   virtual void load_batch(Batch<Dtype>* batch);
+  // 每个变换任务负责 batch 中一段连续的样本：就地解析、解码并变换到各自的位置
+  void transform_task(int task, int num_tasks, Dtype* top_data,
+      Dtype* top_label);
+  // 由记录推断单个样本的形状；编码的图片需要缩放时先解码
+  vector<int> InferItemShape(const DatumView& datum);
+#ifdef USE_OPENCV
+  /// @brief Decodes an encoded record as set by force_color / force_gray and
+  ///        new_height / new_width, with the reduced JPEG decode if asked.
+  cv::Mat DecodeItem(const DatumView& datum);
+#endif  // USE_OPENCV
 
   shared_ptr<db::DB> db_;
   shared_ptr<db::Cursor> cursor_;
   uint64_t offset_;
+
+  // 变换线程池，线程数由 data_param.transform_threads 指定
+  shared_ptr<ThreadPool> transform_pool_;
+  /// @brief One transformer (with its own RNG) and output view per task;
+  ///        task 0 uses data_transformer_.
+  vector<shared_ptr<DataTransformer<Dtype> > > task_transformers_;
+  vector<shared_ptr<Blob<Dtype> > > task_transformed_data_;
+  // 每个任务在当前 batch 中的解码和变换耗时（微秒）
+  vector<double> task_decode_time_;
+  vector<double> task_trans_time_;
+  /// @brief The serialized records of the current batch. They point into
+  ///        the database when the cursor's values persist (LMDB) and into
+  ///        value_copies_ otherwise; the workers read them in place.
+  vector<const void*> value_data_;
+  vector<size_t> value_size_;
+  // 游标移动后记录内存会失效的后端（LevelDB）使用的拷贝，在 batch 之间复用
+  vector<string> value_copies_;
+  // 每个任务解析不能就地读取的记录（含 float_data）时使用的 Datum
+  vector<Datum> task_datums_;
+  Datum first_datum_;
 };
 
 }  // namespace caffe
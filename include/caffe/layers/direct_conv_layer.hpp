@@ -0,0 +1,54 @@
+#ifndef CAFFE_DIRECT_CONV_LAYER_HPP_
+#define CAFFE_DIRECT_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Direct (im2col-free) implementation of ConvolutionLayer for 2D
+ *        convolution on the CPU.
+ *
+ * The forward pass accumulates each input row straight into blocks of
+ * kOutputBlock output rows, so every loaded input value is reused across
+ * several filters and the innermost loop over the output width is
+ * unit-stride for stride-1 layers and can be vectorized by the compiler.
+ * This pays off where im2col + GEMM is memory bound: depthwise and
+ * low-channel group convolution, and strided or padded 1x1 convolution.
+ *
+ * With engine DIRECT every 2D shape runs directly; when selected
+ * automatically (engine DEFAULT) only the shapes above do, and the rest fall
+ * back to ConvolutionLayer, as do N-D shapes, the backward pass and GPU mode.
+ */
+template <typename Dtype>
+class DirectConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit DirectConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  // 每个线程任务处理一段连续的 (图像, 卷积组, 输出通道块) 工作项
+  void forward_cpu_task(int task, int num_tasks, const Dtype* input,
+      const Dtype* weights, const Dtype* bias, Dtype* output);
+
+  // 每次同时计算的输出通道数（寄存器分块大小）
+  static const int kOutputBlock = 4;
+
+  bool use_direct_; // 当前输入形状是否使用直接卷积
+  int output_blocks_; // 每个卷积组内的输出通道块数
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DIRECT_CONV_LAYER_HPP_
@@ -1,6 +1,10 @@
 #ifndef CAFFE_IMAGE_DATA_LAYER_HPP_
 #define CAFFE_IMAGE_DATA_LAYER_HPP_
 
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#endif  // USE_OPENCV
+
 #include <string>
 #include <utility>
 #include <vector>
@@ -11,12 +15,18 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
 /**
  * @brief Provides data to the Net from image files.
  *
+ * The images of a batch are read, decoded and transformed by
+ * image_data_param.decode_threads tasks in parallel, each on a contiguous
+ * range of the batch. The batch shape is inferred from its first decoded
+ * image, so no image is decoded twice.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
@@ -36,9 +46,27 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleImages();
   virtual void load_batch(Batch<Dtype>* batch);
+  // 每个任务负责 batch 中一段连续的图片：先读入并解码，再变换到各自的位置
+  void decode_task(int task, int num_tasks);
+  void transform_task(int task, int num_tasks, Dtype* top_data);
 
   vector<std::pair<std::string, int> > lines_;
   int lines_id_;   // 这是一个全局的图片id标志, 当其达到数据集末尾时，重新置零循环读取
+
+  // 解码线程池，线程数由 image_data_param.decode_threads 指定
+  shared_ptr<ThreadPool> decode_pool_;
+  /// @brief One transformer (with its own RNG) and output view per task;
+  ///        task 0 uses data_transformer_.
+  vector<shared_ptr<DataTransformer<Dtype> > > task_transformers_;
+  vector<shared_ptr<Blob<Dtype> > > task_transformed_data_;
+  // 每个任务在当前 batch 中的读入解码和变换耗时（微秒）
+  vector<double> task_decode_time_;
+  vector<double> task_trans_time_;
+  // 当前 batch 的图片文件名及解码结果
+  vector<std::string> batch_filenames_;
+#ifdef USE_OPENCV
+  vector<cv::Mat> batch_images_;
+#endif  // USE_OPENCV
 };
 
 
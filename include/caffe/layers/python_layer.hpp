@@ -10,6 +10,24 @@ namespace bp = boost::python;
 
 namespace caffe {
 
+/**
+ * @brief Holds the Python GIL for its lifetime.
+ *
+ * pycaffe releases the GIL while Forward, Backward, Step, etc. run, so any
+ * code called back from them that touches Python objects takes it here.
+ * It is also safe on a thread that already holds the GIL.
+ */
+class PyGILAcquire {
+ public:
+  PyGILAcquire() : state_(PyGILState_Ensure()) { }
+  ~PyGILAcquire() { PyGILState_Release(state_); }
+
+ private:
+  PyGILState_STATE state_;
+
+DISABLE_COPY_AND_ASSIGN(PyGILAcquire);
+};
+
 template <typename Dtype>
 class PythonLayer : public Layer<Dtype> {
  public:
@@ -24,6 +42,7 @@ class PythonLayer : public Layer<Dtype> {
         && !Caffe::multiprocess()) {
       LOG(FATAL) << "PythonLayer does not support CLI Multi-GPU, use train.py";
     }
+    PyGILAcquire gil;
     self_.attr("param_str") = bp::str(
         this->layer_param_.python_param().param_str());
     self_.attr("phase") = static_cast<int>(this->phase_);
@@ -31,6 +50,7 @@ class PythonLayer : public Layer<Dtype> {
   }
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    PyGILAcquire gil;
     self_.attr("reshape")(bottom, top);
   }
 
@@ -43,10 +63,12 @@ class PythonLayer : public Layer<Dtype> {
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    PyGILAcquire gil;
     self_.attr("forward")(bottom, top);
   }
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    PyGILAcquire gil;
     self_.attr("backward")(top, propagate_down, bottom);
   }
 
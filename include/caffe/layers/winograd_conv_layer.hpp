@@ -0,0 +1,78 @@
+#ifndef CAFFE_WINOGRAD_CONV_LAYER_HPP_
+#define CAFFE_WINOGRAD_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Winograd minimal filtering implementation of ConvolutionLayer for
+ *        2D 3x3 stride-1 convolution on the CPU.
+ *
+ * The forward pass transforms the filters and overlapping input tiles,
+ * multiplies them with one GEMM per transform coefficient and transforms the
+ * products back (Lavin & Gray, "Fast Algorithms for Convolutional Neural
+ * Networks", 2015). No im2col buffer is built. The layer factory only
+ * creates it for engine: WINOGRAD, which uses F(4x4,3x3) when both output
+ * dimensions are at least 8 and F(2x2,3x3) otherwise; F(4x4,3x3) does fewer
+ * multiplications but is less accurate. Constructed directly with any other
+ * engine value, the layer always uses F(2x2,3x3). The transformed filters are cached and recomputed only
+ * when the weights change (see SyncedMemory::generation); layers whose
+ * weights are the same SyncedMemory, e.g. the replicas of an inference net,
+ * share one cached copy.
+ *
+ * Other shapes, the backward pass and GPU mode fall back to ConvolutionLayer.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), use_winograd_(false), tile_(0) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  /**
+   * @brief Returns the cached transformed filters used by this layer, shared
+   *        with every layer whose weights are the same SyncedMemory, or NULL
+   *        if the current shape falls back to im2col + GEMM.
+   */
+  const Blob<Dtype>* transformed_weights() const;
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  // 取得与当前权值 SyncedMemory 及块大小对应的共享缓存
+  void acquire_transformed_weights();
+  // 计算变换后的卷积核 U = G g G^T
+  void transform_weights(const Dtype* weights, Dtype* U);
+  // 每个线程任务处理 batch 中属于自己的那一段连续图像
+  void forward_cpu_task(int task, int num_tasks, const Dtype* input,
+      const Dtype* bias, Dtype* output);
+
+  bool use_winograd_; // 当前输入形状是否使用 Winograd 计算
+  int tile_; // 输出块大小 m (2 或 4)
+  int alpha_; // 输入块大小 m + 2
+  int tiles_h_; // 输出在高方向上的块数
+  int tiles_w_; // 输出在宽方向上的块数
+  /// @brief Cache of the transformed filters, keyed by the weight
+  ///        SyncedMemory and tile size; defined in winograd_conv_layer.cpp.
+  class TransformedWeights;
+  shared_ptr<TransformedWeights> transformed_weights_;
+  // 每个任务的变换后输入 V: [alpha^2][C][tiles]
+  vector<shared_ptr<Blob<Dtype> > > task_input_;
+  // 每个任务的逐系数乘积 M: [alpha^2][num_output][tiles]
+  vector<shared_ptr<Blob<Dtype> > > task_product_;
+  vector<Dtype*> task_input_data_;
+  vector<Dtype*> task_product_data_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WINOGRAD_CONV_LAYER_HPP_
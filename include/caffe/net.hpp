@@ -11,9 +11,12 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/profiler.hpp"
 
 namespace caffe {
 
+class MappedWeights;
+
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
  *        specified by a NetParameter.
@@ -117,10 +120,29 @@ class Net {
   void CopyTrainedLayersFrom(const string trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
   void CopyTrainedLayersFromHDF5(const string trained_filename);
+  /**
+   * @brief Loads a mapped weights file (see MappedWeights) by pointing the
+   *        blobs at the mapped tensors, so only the index is read up front.
+   *
+   * Blobs are copied instead if their type differs from the file's or the
+   * params are packed (see PackFlatParams). The net keeps the mapping
+   * alive; writing to a bound blob never changes the file.
+   */
+  void CopyTrainedLayersFromMapped(const string trained_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
   /// @brief Writes the net to an HDF5 file.
   void ToHDF5(const string& filename, bool write_diff = false) const;
+  /**
+   * @brief Like ToProto and ToHDF5, but writes params, a copy of params()
+   *        (e.g. one staged for a background snapshot), instead of the
+   *        net's own blobs. They only read the layer definitions otherwise,
+   *        so they may run while the net trains.
+   */
+  void ToProto(const vector<shared_ptr<Blob<Dtype> > >& params,
+      NetParameter* param, bool write_diff = false) const;
+  void ToHDF5(const vector<shared_ptr<Blob<Dtype> > >& params,
+      const string& filename, bool write_diff = false) const;
 
   /// @brief returns the network name.
   inline const string& name() const { return name_; }
@@ -193,6 +215,35 @@ class Net {
   inline const vector<bool>& has_params_decay() const {
     return has_params_decay_;
   }
+  /**
+   * @brief Whether the learnable params and their diffs live in two
+   *        contiguous buffers (NetParameter.flat_params).
+   *
+   * Param i occupies [flat_param_offsets()[i], flat_param_offsets()[i] +
+   * count) of both buffers; each param starts on a 64-byte boundary and the
+   * padding between params is zero.
+   */
+  inline bool has_flat_params() const { return flat_params_; }
+  /**
+   * @brief Moves the learnable params and their diffs into the flat buffers,
+   *        keeping their values. Init calls this when
+   *        NetParameter.flat_params is set; calling it again does nothing.
+   */
+  void PackFlatParams();
+  /// @brief The number of elements in each flat buffer, padding included.
+  inline int flat_params_count() const { return flat_params_count_; }
+  inline const vector<int>& flat_param_offsets() const {
+    return flat_param_offsets_;
+  }
+  /**
+   * @brief The flat buffers on the CPU. These move the head of every
+   *        learnable param to the CPU and check that no param has been
+   *        given other memory since Init (e.g. by Blob::ShareData).
+   */
+  const Dtype* cpu_flat_data() { return FlatBuffer(false, false); }
+  const Dtype* cpu_flat_diff() { return FlatBuffer(true, false); }
+  Dtype* mutable_cpu_flat_data() { return FlatBuffer(false, true); }
+  Dtype* mutable_cpu_flat_diff() { return FlatBuffer(true, true); }
   const map<string, int>& param_names_index() const {
     return param_names_index_;
   }
@@ -221,6 +272,24 @@ class Net {
   const shared_ptr<Layer<Dtype> > layer_by_name(const string& layer_name) const;
 
   void set_debug_info(const bool value) { debug_info_ = value; }
+  /**
+   * @brief Records the time and memory traffic of every layer run by
+   *        ForwardFromTo and BackwardFromTo into profiler. Pass an empty
+   *        pointer to stop profiling; when disabled the cost is one branch
+   *        per layer.
+   */
+  void set_profiler(const shared_ptr<Profiler>& profiler) {
+    profiler_ = profiler;
+  }
+  const shared_ptr<Profiler>& profiler() const { return profiler_; }
+  /**
+   * @brief Runs Forward, Backward and Reshape in context (see
+   *        Caffe::CreateContext) instead of the calling thread's Caffe
+   *        state, so any thread may run the net. Pass an empty pointer to
+   *        use the calling thread's state again.
+   */
+  void set_context(const shared_ptr<Caffe>& context) { context_ = context; }
+  const shared_ptr<Caffe>& context() const { return context_; }
 
   // Helpers for Init.
   /**
@@ -272,12 +341,32 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /**
+   * @brief Finds the intermediate blobs that may share memory when
+   *        NetParameter.share_activations is set, and the range of layers
+   *        over which each of them is live.
+   */
+  void InitActivationSharing(const NetParameter& param);
+  /**
+   * @brief Assigns the intermediate blobs to a small set of buffers so that
+   *        blobs which are never live at the same time use the same memory.
+   *        Called from Init and Reshape; does nothing unless enabled.
+   */
+  void ShareActivations();
+  /// @brief Calls PackFlatParams when NetParameter.flat_params is set.
+  void InitFlatParams(const NetParameter& param);
+  /// @brief Helper for the flat buffer accessors.
+  Dtype* FlatBuffer(const bool diff, const bool for_write);
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
   void BackwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Update.
   void UpdateDebugInfo(const int param_id);
+  /// @brief Records a layer that started at start_us into profiler_.
+  void ProfileLayer(const int layer_id, const bool backward,
+      const int64_t start_us);
 
   /// @brief The network name
   string name_;
@@ -336,6 +425,29 @@ class Net {
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Receives per-layer events when profiling is enabled.
+  shared_ptr<Profiler> profiler_;
+  /// The execution context the net runs in, or NULL for the caller's.
+  shared_ptr<Caffe> context_;
+  /// Whether intermediate blobs share memory (inference only).
+  bool share_activations_;
+  /// Sharing group of each blob, or -1 if the blob keeps its own memory.
+  /// Blobs that already alias each other (e.g. Split tops) form one group.
+  vector<int> activation_group_;
+  /// First and last layer at which each sharing group is used.
+  vector<int> activation_begin_;
+  vector<int> activation_end_;
+  /// The buffers shared by the intermediate blobs.
+  vector<shared_ptr<SyncedMemory> > activation_buffers_;
+  /// Whether the learnable params live in flat_data_ and flat_diff_.
+  bool flat_params_;
+  int flat_params_count_;
+  vector<int> flat_param_offsets_;
+  /// The flat buffers, with room to align their start to 64 bytes.
+  shared_ptr<SyncedMemory> flat_data_;
+  shared_ptr<SyncedMemory> flat_diff_;
+  /// The weights files the params are bound to.
+  vector<shared_ptr<MappedWeights> > mapped_weights_;
   // Callbacks
   vector<Callback*> before_forward_;
   vector<Callback*> after_forward_;
@@ -2,8 +2,8 @@
 #define CAFFE_PARALLEL_HPP_
 
 #ifdef USE_NCCL
-
 #include <boost/thread.hpp>
+#endif
 
 #include <string>
 #include <vector>
@@ -12,14 +12,142 @@
 #include "caffe/common.hpp"
 #include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/solver.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/transport.hpp"
+#ifdef USE_NCCL
 #include "caffe/util/nccl.hpp"
+#endif
 
 namespace caffe {
 
+/**
+ * @brief Data-parallel training on the CPU: Caffe::solver_count() solver
+ *        replicas run in threads of one process and average their gradients
+ *        through shared memory.
+ *
+ * Every replica packs its learnable params (Net::PackFlatParams), so the
+ * gradients of a replica are one contiguous buffer. The buffer is reduced in
+ * buckets, last bucket first. Each replica has a reducer thread that sums
+ * its slice of a bucket over all replicas (reduce-scatter) and then copies
+ * the other slices of that bucket from their owners (all-gather), so every
+ * replica ends with the same averaged gradient. With
+ * SolverParameter.layer_wise_reduce a bucket is reduced as soon as every
+ * replica has finished the backward pass of the layers it covers, which
+ * overlaps the reduction with the rest of backward.
+ */
+// CPU 上的数据并行训练：每个线程一个 solver 副本，梯度通过共享内存求平均
+template<typename Dtype>
+class CPUParallel : public Solver<Dtype>::Callback,
+                    public Net<Dtype>::Callback {
+ public:
+  explicit CPUParallel(shared_ptr<Solver<Dtype> > root_solver);
+  virtual ~CPUParallel();
+
+  /**
+   * @brief Trains the root solver together with Caffe::solver_count() - 1
+   *        replicas created on new threads.
+   * @param pin_numa binds replica i, its reducer and its data prefetch
+   *        threads to the CPUs of NUMA node i % (number of nodes).
+   * @param restore if not NULL, every replica restores this solver state.
+   */
+  void Run(bool pin_numa, const char* restore);
+
+ protected:
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+  class Reducer;
+  template <typename T> friend class CPUParallelWorker;
+
+  CPUParallel(shared_ptr<Solver<Dtype> > solver, shared_ptr<sync> shared);
+  void Init();
+  /// @brief Copies the params of replica 0 into every replica.
+  void Broadcast();
+  /// @brief Reduces the gradients of one iteration; runs on reducer_.
+  void Reduce(const int iteration);
+
+  void on_start();
+  void run(int layer);  // Net callback
+  void on_gradients_ready();
+
+  shared_ptr<Solver<Dtype> > solver_;
+  shared_ptr<sync> sync_;
+  shared_ptr<InternalThread> reducer_;
+  int rank_;
+  int iterations_;
+  int backward_passes_;
+  /// Offset in the flat diff from which all gradients are final once
+  /// backward has run down to each layer.
+  vector<int> layer_ready_offset_;
+
+DISABLE_COPY_AND_ASSIGN(CPUParallel);
+};
+
+/**
+ * @brief Data-parallel training across processes: every process (rank) runs
+ *        one solver and the gradients are averaged over a Transport.
+ *
+ * As in CPUParallel the learnable params are packed into flat buffers. A
+ * communication thread all-reduces the flat diff in buckets, last bucket
+ * first, with RingAllReduce or TreeAllReduce. With
+ * SolverParameter.layer_wise_reduce a bucket is sent as soon as backward has
+ * passed the layers it covers, which overlaps the communication with the rest
+ * of Net::BackwardFromTo. The time spent in the all-reduce is reported in the
+ * iteration log of Solver::Step.
+ */
+// 多进程数据并行训练：每个进程一个 solver，梯度通过 Transport 求平均
+template<typename Dtype>
+class TransportParallel : public Solver<Dtype>::Callback,
+                          public Net<Dtype>::Callback {
+ public:
+  /**
+   * @param solver the solver of this rank, created after setting
+   *        Caffe::solver_count() and Caffe::solver_rank().
+   * @param algorithm "ring" or "tree".
+   */
+  TransportParallel(shared_ptr<Solver<Dtype> > solver,
+      shared_ptr<Transport> transport, const string& algorithm);
+  virtual ~TransportParallel();
+
+  /**
+   * @brief Copies the params of rank 0 to all ranks and trains. Rank 0 runs
+   *        Solver::Solve, the other ranks the same number of Step iterations.
+   */
+  void Run();
+
+ protected:
+  class sync;
+  class Communicator;
+
+  /// @brief All-reduces the gradients of one iteration; runs on communicator_.
+  void Communicate(const int iteration);
+
+  void on_start();
+  void run(int layer);  // Net callback
+  void on_gradients_ready();
+
+  shared_ptr<Solver<Dtype> > solver_;
+  shared_ptr<Transport> transport_;
+  void (*all_reduce_)(Transport*, Dtype*, int);
+  shared_ptr<sync> sync_;
+  shared_ptr<InternalThread> communicator_;
+  Dtype* diff_;
+  int count_;
+  int iterations_;
+  int backward_passes_;
+  vector<int> layer_ready_offset_;
+
+DISABLE_COPY_AND_ASSIGN(TransportParallel);
+};
+
+#ifdef USE_NCCL
+
 // Represents a net parameters. Once a net is created, its parameter buffers can
 // be replaced by ones from Params, to allow parallelization. Params ensures
 // parameters are allocated in one consecutive array.
@@ -117,7 +245,8 @@ class NCCL : public GPUParams<Dtype>,
   using Params<Dtype>::diff_;
 };
 
+#endif  // USE_NCCL
+
 }  // namespace caffe
 
-#endif  // USE_NCCL
 #endif  // header
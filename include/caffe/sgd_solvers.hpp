@@ -5,9 +5,38 @@
 #include <vector>
 
 #include "caffe/solver.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+/**
+ * @brief The inputs of the fused CPU update kernels of the SGD solvers, which
+ *        update one parameter blob in a single pass (see
+ *        SGDSolver::FusedUpdate).
+ */
+// 融合更新内核的参数：梯度归一化、梯度裁剪、正则化和参数更新在一次遍历中完成
+template <typename Dtype>
+struct SolverUpdateArgs {
+  Dtype* data;            // 参数，原地更新
+  Dtype* diff;            // 梯度，更新后存放更新量（与 ComputeUpdateValue 一致）
+  Dtype* history;
+  Dtype* history2;        // AdaDelta 和 Adam 的第二个历史
+  Dtype diff_scale;       // 1 / iter_size 乘以梯度裁剪的缩放系数
+  Dtype l2_decay;
+  Dtype l1_decay;
+  Dtype rate;             // 该参数的学习率
+  Dtype momentum;
+  Dtype momentum2;
+  Dtype delta;
+
+  // The i-th gradient after normalization, clipping and regularization,
+  // i.e. the diff that Normalize and Regularize would leave behind.
+  inline Dtype gradient(const int i) const {
+    return diff_scale * diff[i] + l2_decay * data[i] +
+        l1_decay * caffe_sign(data[i]);
+  }
+};
+
 /**
  * @brief Optimizes the parameters of a Net using
  *        stochastic gradient descent (SGD) with momentum.
@@ -31,9 +60,41 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   virtual void ClipGradients();
+  // The factor ClipGradients scales the gradients by (1 if they are not
+  // clipped).
+  Dtype GetClipScale();
+  /**
+   * @brief Does Normalize, Regularize, ComputeUpdateValue and Blob::Update
+   *        for one parameter in a single pass over its data, diff and
+   *        history. The gradients are scaled by diff_scale on the fly and,
+   *        as with the separate steps, the diff is left holding the update
+   *        value.
+   */
+  virtual void FusedUpdate(int param_id, Dtype rate, Dtype diff_scale);
+  /**
+   * @brief Whether ApplyUpdate uses FusedUpdate: only in CPU mode, without
+   *        debug_info (which logs from Net::Update), and only for the
+   *        built-in solvers, since a subclass may override any of the steps
+   *        the fused update replaces.
+   */
+  bool UseFusedUpdate() const;
+  // 填写 SolverUpdateArgs 中所有求解器共用的部分
+  SolverUpdateArgs<Dtype> GetUpdateArgs(int param_id, Dtype rate,
+      Dtype diff_scale);
   virtual void SnapshotSolverState(const string& model_filename);
-  virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
-  virtual void SnapshotSolverStateToHDF5(const string& model_filename);
+  virtual boost::function<void(const string&)> StageSolverState();
+  // 把 iter、current_step 和 history 作为 model_filename 的求解器状态写入
+  // state_filename
+  static void SnapshotSolverStateToBinaryProto(int iter, int current_step,
+      const vector<shared_ptr<Blob<Dtype> > >& history,
+      const string& model_filename, const string& state_filename);
+  static void SnapshotSolverStateToHDF5(int iter, int current_step,
+      const vector<shared_ptr<Blob<Dtype> > >& history,
+      const string& model_filename, const string& state_filename);
+  // 在后台线程中写出 StageSolverState 暂存的状态
+  static void WriteStagedSolverState(SolverParameter_SnapshotFormat format,
+      int iter, int current_step, vector<shared_ptr<Blob<Dtype> > > history,
+      const string& state_filename, const string& model_filename);
   virtual void RestoreSolverStateFromHDF5(const string& state_file);
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file);
   // history maintains the historical momentum data.
@@ -41,6 +102,8 @@ class SGDSolver : public Solver<Dtype> {
   // temp maintains other information that might be needed in computation
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
+  // history 的副本，供后台快照使用
+  vector<shared_ptr<Blob<Dtype> > > staged_history_;
 
   DISABLE_COPY_AND_ASSIGN(SGDSolver);
 };
@@ -56,6 +119,7 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, Dtype rate, Dtype diff_scale);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -71,6 +135,7 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, Dtype rate, Dtype diff_scale);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -91,6 +156,7 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, Dtype rate, Dtype diff_scale);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -115,6 +181,7 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, Dtype rate, Dtype diff_scale);
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -139,6 +206,7 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, Dtype rate, Dtype diff_scale);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
@@ -0,0 +1,69 @@
+#ifndef CAFFE_SHAPE_BUCKETS_HPP_
+#define CAFFE_SHAPE_BUCKETS_HPP_
+
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/inference_replicas.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Serves inputs of varying shape from a fixed set of input shapes
+ *        ("buckets") without reshaping a net per request.
+ *
+ * Every bucket has its own replica of the net (see InferenceReplicas, so
+ * the weights are shared), reshaped once to the bucket's input shape when
+ * the buckets are created. Switching between buckets is then just picking
+ * another net: no layer Reshape runs and, once a bucket has run Forward,
+ * no buffer is allocated again. The price is one set of activations per
+ * bucket.
+ *
+ * An input is served by the smallest bucket at least as large on every
+ * axis; Prepare pads it with zeros at the end of each axis. Whether padding
+ * changes the result (it does for e.g. global pooling) depends on the net.
+ */
+// 为一组输入形状各准备一个已经 Reshape 好的网络，切换形状时无需 Reshape
+template <typename Dtype>
+class ShapeBuckets {
+ public:
+  /**
+   * @brief Creates one bucket per shape of the input blob of param, with
+   *        the weights of net (which becomes the net of bucket 0).
+   */
+  ShapeBuckets(const NetParameter& param, shared_ptr<Net<Dtype> > net,
+      const vector<vector<int> >& shapes);
+
+  inline int size() const { return shapes_.size(); }
+  inline const vector<int>& shape(int bucket) const { return shapes_[bucket]; }
+  inline const shared_ptr<Net<Dtype> >& net(int bucket) const {
+    return replicas_->replica(bucket);
+  }
+  /**
+   * @brief Returns the bytes of the weights shared by all buckets, including
+   *        derived copies such as transformed Winograd filters, which are
+   *        held once per tile size rather than once per bucket.
+   */
+  inline size_t weights_bytes() const { return replicas_->weights_bytes(); }
+
+  /// @brief Returns the smallest bucket that fits shape, or -1 if none.
+  int Find(const vector<int>& shape) const;
+  /**
+   * @brief Copies data of the given shape, zero-padded, into the input blob
+   *        of the smallest bucket that fits it, and returns that bucket.
+   *        Forward of net(bucket) then runs the request.
+   */
+  int Prepare(const Dtype* data, const vector<int>& shape);
+
+ protected:
+  shared_ptr<InferenceReplicas<Dtype> > replicas_;
+  vector<vector<int> > shapes_;
+
+DISABLE_COPY_AND_ASSIGN(ShapeBuckets);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_SHAPE_BUCKETS_HPP_
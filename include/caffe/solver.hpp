@@ -66,6 +66,11 @@ class Solver {
   // function that produces a SolverState protocol buffer that needs to be
   // written to disk together with the learned net.
   void Snapshot();
+  /**
+   * @brief Blocks until the snapshot being written in the background (see
+   *        SolverParameter.snapshot_async), if any, is on disk.
+   */
+  void WaitForSnapshot();
   virtual ~Solver() {}
   inline const SolverParameter& param() const { return param_; }
   inline shared_ptr<Net<Dtype> > net() { return net_; }
@@ -87,6 +92,16 @@ class Solver {
   void add_callback(Callback* value) {
     callbacks_.push_back(value);
   }
+  /**
+   * @brief Accounts time spent exchanging gradients, for the iteration log of
+   *        Step. blocked_ms is how long the solver waited for the exchange,
+   *        i.e. the part not overlapped with backward plus any wait for
+   *        slower replicas.
+   */
+  void add_communication_time(float total_ms, float blocked_ms) {
+    communication_ms_ += total_ms;
+    communication_blocked_ms_ += blocked_ms;
+  }
 
   void CheckSnapshotWritePermissions();
   /**
@@ -104,6 +119,20 @@ class Solver {
   void TestAll();
   void Test(const int test_net_id = 0);
   virtual void SnapshotSolverState(const string& model_filename) = 0;
+  /**
+   * @brief Copies the solver state written by SnapshotSolverState for a
+   *        background snapshot, and returns the function that writes the
+   *        copy for the given model filename. Only called once the previous
+   *        background snapshot is written, so staging buffers may be reused.
+   */
+  virtual boost::function<void(const string&)> StageSolverState();
+  // 把 blob 的 data (copy_diff 时还有 diff) 复制到 CPU 内存中的 staged
+  static void StageBlob(const Blob<Dtype>& blob, bool copy_diff,
+      Blob<Dtype>* staged);
+  void SnapshotAsync();
+  // 在后台线程中写出暂存的快照
+  void WriteStagedSnapshot(const int iter, const string& model_filename,
+      const boost::function<void(const string&)>& write_state);
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
   void DisplayOutputBlobs(const int net_id);
@@ -128,6 +157,17 @@ class Solver {
   // Timing information, handy to tune e.g. nbr of GPUs
   Timer iteration_timer_;
   float iterations_last_;
+  // 自上次输出以来的梯度通信时间 (毫秒)
+  float communication_ms_;
+  float communication_blocked_ms_;
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class AsyncSnapshot;
+  // 最后声明，析构时最先等待后台写完
+  shared_ptr<AsyncSnapshot> async_snapshot_;
 
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
@@ -8,6 +8,7 @@
 #endif
 
 #include "caffe/common.hpp"
+#include "caffe/util/host_allocator.hpp"
 
 namespace caffe {
 
@@ -22,8 +23,10 @@ namespace caffe {
 // 分配的内存可以常驻在内存空间中对效率是有帮助的，空间不会被别的进程所抢占。同样如果内存越大，能被分配的Pinned内存自然也越大。
 // 还有一点是，对于单一的GPU而言提升并不会太显著，但是对于多个GPU的并行而言可以显著提高稳定性。
 
-// 全局函数，分配内存空间
-inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
+// 全局函数，分配内存空间；*pooled 表示块来自 HostAllocator，释放时需原样传回
+inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda,
+    bool* pooled) {
+  *pooled = false;
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
     CUDA_CHECK(cudaMallocHost(ptr, size)); // GPU模式下CUDA分配内存
@@ -31,6 +34,13 @@ inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
     return;
   }
 #endif
+  // 使用内存池时，从 HostAllocator 的缓存中分配
+  if (HostAllocator::Get().mode() == HostAllocator::POOLED) {
+    *ptr = HostAllocator::Get().Allocate(size);
+    *use_cuda = false;
+    *pooled = true;
+    return;
+  }
 #ifdef USE_MKL
   *ptr = mkl_malloc(size ? size:1, 64); // 若使用MKL矩阵库，CPU模式下使用MKL的 mkl_malloc() 函数分配空间 
 #else
@@ -41,13 +51,18 @@ inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
 }
 
 // 全局函数，释放内存空间函数
-inline void CaffeFreeHost(void* ptr, bool use_cuda) {
+inline void CaffeFreeHost(void* ptr, bool use_cuda, bool pooled) {
 #ifndef CPU_ONLY
   if (use_cuda) {
     CUDA_CHECK(cudaFreeHost(ptr));
     return;
   }
 #endif
+  // 内存池分配的块交还给内存池
+  if (pooled) {
+    HostAllocator::Get().Free(ptr);
+    return;
+  }
 #ifdef USE_MKL
   mkl_free(ptr);
 #else
@@ -82,6 +97,15 @@ class SyncedMemory {
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() { return head_; } // 获取数据当前状态
   size_t size() { return size_; } // 获取数据当前存储空间大小
+  /**
+   * @brief Returns a counter that changes whenever the data may have been
+   *        written, i.e. on every mutable_*_data() and set_*_data() call.
+   *
+   * Lets a reader cache something derived from the data (e.g. transformed
+   * filters) and tell cheaply whether it is stale. Writes through a pointer
+   * obtained earlier are only seen at the next mutable_*_data() call.
+   */
+  size_t generation() const { return generation_; }
 
 #ifndef CPU_ONLY
   // 这是一个cuda拷贝的异步传输函数，从数据从cpu拷贝到gpu，异步传输是已经假定caller会在使用之前做同步操作。
@@ -99,8 +123,10 @@ class SyncedMemory {
   SyncedHead head_; // 数据当前状态
   bool own_cpu_data_; // 标志是否拥有CPU数据所有权（否，即从别的数据共享）
   bool cpu_malloc_use_cuda_; // 标志是否使用CUDA的内存分配和释放函数
+  bool cpu_malloc_pooled_; // 标志CPU数据是否由 HostAllocator 的内存池分配
   bool own_gpu_data_; // 标志是否拥有GPU数据所有权
   int device_; // GPU设备编号
+  size_t generation_; // 每次可能写入数据时加一
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory); // 禁止该类的拷贝与赋值
 };  // class SyncedMemory
@@ -18,6 +18,22 @@ class Cursor {
   virtual void Next() = 0;
   virtual string key() = 0;
   virtual string value() = 0;
+  /**
+   * @brief Returns the current value without copying it.
+   *
+   * The bytes are owned by the database (for LMDB they point into its
+   * memory map) and stay valid only until the next call to Next() or
+   * SeekToFirst().
+   */
+  // 直接访问当前记录的内存，不做拷贝
+  virtual const void* value_data() = 0;
+  virtual size_t value_size() = 0;
+  /**
+   * @brief Whether value_data() stays valid after Next() and SeekToFirst(),
+   *        for as long as the cursor exists. True for LMDB, whose read
+   *        transaction lives as long as the cursor.
+   */
+  virtual bool value_data_persists() { return false; }
   virtual bool valid() = 0;
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
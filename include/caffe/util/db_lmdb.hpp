@@ -34,6 +34,10 @@ class LMDBCursor : public Cursor {
     return string(static_cast<const char*>(mdb_value_.mv_data),
         mdb_value_.mv_size);
   }
+  virtual const void* value_data() { return mdb_value_.mv_data; }
+  virtual size_t value_size() { return mdb_value_.mv_size; }
+  // 只读事务中取得的数据在事务结束前一直有效
+  virtual bool value_data_persists() { return true; }
   virtual bool valid() { return valid_; }
 
  private:
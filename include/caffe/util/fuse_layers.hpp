@@ -0,0 +1,26 @@
+#ifndef _CAFFE_UTIL_FUSE_LAYERS_HPP_
+#define _CAFFE_UTIL_FUSE_LAYERS_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Copies an inference NetParameter, folding every
+ *        Convolution -> BatchNorm -> Scale -> ReLU chain into the Convolution.
+ *
+ * The layers of param must carry their trained blobs, e.g. as written by
+ * Net::ToProto. BatchNorm (with global statistics) and Scale are folded into
+ * the convolution weights and bias; a following ReLU becomes the convolution's
+ * fuse_relu epilogue. Each of the three stages is optional, but they must
+ * appear in this order, each directly after the previous one in the layer
+ * list, reading the previous output as its only bottom, with no other layer
+ * reading the intermediate outputs. The fused Convolution keeps its name and
+ * produces the top of the last folded layer.
+ */
+// 推理时把卷积后面的 BatchNorm / Scale 折叠进卷积的权重和偏置，并把 ReLU 融合进卷积
+void FuseInferenceLayers(const NetParameter& param, NetParameter* param_fused);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_FUSE_LAYERS_HPP_
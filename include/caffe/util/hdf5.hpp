@@ -34,6 +34,15 @@ void hdf5_save_string(hid_t loc_id, const string& dataset_name,
 int hdf5_get_num_links(hid_t loc_id);
 string hdf5_get_name_by_idx(hid_t loc_id, int idx);
 
+/**
+ * @brief Reads the weights of an HDF5 file written by Net::ToHDF5 into the
+ *        blobs of param's layers, i.e. the form of a .caffemodel, keeping
+ *        double datasets as double_data.
+ */
+void hdf5_load_net_weights(const string& filename, NetParameter* param);
+/// @brief Writes the blobs of param's layers in the layout of Net::ToHDF5.
+void hdf5_save_net_weights(const NetParameter& param, const string& filename);
+
 }  // namespace caffe
 
 #endif   // CAFFE_UTIL_HDF5_H_
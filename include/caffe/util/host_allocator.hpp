@@ -0,0 +1,96 @@
+#ifndef CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+#define CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Process-wide allocator behind CaffeMallocHost / CaffeFreeHost for
+ *        CPU (non-pinned) host memory.
+ *
+ * In SYSTEM mode (the default) every allocation goes straight to malloc or
+ * mkl_malloc, as before. In POOLED mode blocks are 64-byte aligned and rounded
+ * up to a size class (four classes per power of two, 64 bytes minimum); a
+ * freed block is kept on the free list of its class and handed out again to
+ * the next request of that class, so repeated Blob reshapes no longer hit the
+ * system allocator. Trim() returns all cached blocks to the system.
+ *
+ * Every pooled block starts with a header, one kAlignment before the
+ * returned pointer, that records its size class, so Free() needs no lookup;
+ * the caller must remember which blocks came from Allocate() (SyncedMemory
+ * does). Each size class has its own free list and lock, and the counters
+ * are atomic, so threads allocating different sizes do not contend. All
+ * methods are thread-safe, and switching modes while blocks are live is
+ * safe.
+ */
+// 可缓存的主机内存分配器：按大小分级回收已释放的内存块，减少频繁的 malloc/free
+class HostAllocator {
+ public:
+  enum Mode { SYSTEM, POOLED };
+
+  // 分配器的统计信息
+  struct Stats {
+    size_t bytes_live;    // 已分配且尚未释放的内存块总字节数（仅统计内存池的块）
+    size_t bytes_cached;  // 缓存在空闲链表中的字节数
+    size_t hits;          // 由缓存满足的分配次数
+    size_t misses;        // 需要向系统申请的分配次数
+    // 缓存命中率，没有分配时为 0
+    double hit_rate() const {
+      return hits + misses > 0 ?
+          static_cast<double>(hits) / (hits + misses) : 0.;
+    }
+  };
+
+  static const size_t kAlignment = 64;
+
+  // 全局唯一的分配器
+  static HostAllocator& Get();
+
+  Mode mode();
+  // 切换到 SYSTEM 模式时会释放所有缓存的内存块
+  void set_mode(Mode mode);
+  // 缓存字节数的上限，超过上限时释放的块直接还给系统；默认不限制
+  void set_cache_limit(size_t bytes);
+
+  // 从内存池分配至少 size 字节、按 kAlignment 对齐的内存
+  void* Allocate(size_t size);
+  /// @brief Returns a block obtained from Allocate() to the pool, or to the
+  ///        system in SYSTEM mode or when the cache is full.
+  void Free(void* ptr);
+  // 把所有缓存的内存块还给系统
+  void Trim();
+
+  Stats stats();
+  // 清零命中统计（不影响 bytes_live / bytes_cached）
+  void ResetStats();
+
+  // 返回 size 所属的大小级别，即实际分配的字节数
+  static size_t RoundSize(size_t size);
+  // 大小级别的个数，足以覆盖任意 size_t 大小
+  static const int kSizeClasses = 4 * 64;
+
+ protected:
+  HostAllocator();
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  // 返回 size 的大小级别编号，并在 rounded 中给出该级别的字节数
+  static int SizeClass(size_t size, size_t* rounded);
+  static size_t ClassSize(int size_class);
+  // 从最大的级别开始释放缓存的块，直到缓存字节数不超过 limit
+  void TrimTo(size_t limit);
+
+  // 各级别的空闲链表、锁与原子计数都放在 sync 中
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(HostAllocator);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_ALLOCATOR_HPP_
@@ -90,15 +90,32 @@ inline void WriteProtoToBinaryFile(
   WriteProtoToBinaryFile(proto, filename.c_str());
 }
 
+/**
+ * @brief Publishes a file that was written under a temporary name: fsyncs
+ *        temp_filename, renames it to filename and fsyncs the directory.
+ *        Readers of filename see either its previous contents or the
+ *        complete new file.
+ */
+void CommitFile(const string& temp_filename, const string& filename);
+
 bool ReadFileToDatum(const string& filename, const int label, Datum* datum);
 
 inline bool ReadFileToDatum(const string& filename, Datum* datum) {
   return ReadFileToDatum(filename, -1, datum);
 }
 
+/// @brief As below; reduced reads JPEG files with the reduced decode of
+///        ReadImageToCVMat when they are resized.
 bool ReadImageToDatum(const string& filename, const int label,
     const int height, const int width, const bool is_color,
-    const std::string & encoding, Datum* datum);
+    const std::string & encoding, const bool reduced, Datum* datum);
+
+inline bool ReadImageToDatum(const string& filename, const int label,
+    const int height, const int width, const bool is_color,
+    const std::string & encoding, Datum* datum) {
+  return ReadImageToDatum(filename, label, height, width, is_color,
+                          encoding, false, datum);
+}
 
 inline bool ReadImageToDatum(const string& filename, const int label,
     const int height, const int width, const bool is_color, Datum* datum) {
@@ -129,10 +146,51 @@ inline bool ReadImageToDatum(const string& filename, const int label,
 bool DecodeDatumNative(Datum* datum);
 bool DecodeDatum(Datum* datum, bool is_color);
 
+/**
+ * @brief The fields of a Datum, read in place: data points into the
+ *        serialized record (or into a Datum's data()), so the pixels or the
+ *        encoded image are never copied.
+ */
+struct DatumView {
+  DatumView() : channels(0), height(0), width(0), data(NULL), data_size(0),
+      float_data(NULL), float_data_size(0), label(0), encoded(false) {}
+  explicit DatumView(const Datum& datum);
+
+  int channels;
+  int height;
+  int width;
+  const char* data;  // uint8 像素，或 encoded 时编码后的图像
+  size_t data_size;
+  const float* float_data;
+  int float_data_size;
+  int label;
+  bool encoded;
+};
+
+/**
+ * @brief Reads a serialized Datum in place, e.g. straight from a DB cursor's
+ *        value_data(); the view refers to bytes and is valid as long as they
+ *        are. A record that cannot be read in place (one with float_data) is
+ *        parsed into *storage instead and the view refers to that.
+ */
+DatumView ParseDatumView(const void* bytes, size_t size, Datum* storage);
+
 #ifdef USE_OPENCV
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color);
 
+/**
+ * @brief Reads an image resized to height x width. With reduced, a JPEG
+ *        image at least twice as large is decoded straight at 1/2, 1/4 or
+ *        1/8 of its size (the smallest one still covering height x width)
+ *        before the resize, which is several times cheaper than a full
+ *        decode but not bit-exact with it. Other images, and reduced =
+ *        false, take the full-size path.
+ */
+cv::Mat ReadImageToCVMat(const string& filename,
+    const int height, const int width, const bool is_color,
+    const bool reduced);
+
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width);
 
@@ -143,6 +201,15 @@ cv::Mat ReadImageToCVMat(const string& filename);
 
 cv::Mat DecodeDatumToCVMatNative(const Datum& datum);
 cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color);
+/// @brief Decodes datum resized to height x width if both are positive,
+///        with the reduced JPEG decode of ReadImageToCVMat if reduced.
+cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color,
+    int height, int width, bool reduced);
+// 直接从 DatumView 指向的内存解码，不拷贝编码后的数据
+cv::Mat DecodeDatumToCVMatNative(const DatumView& datum);
+cv::Mat DecodeDatumToCVMat(const DatumView& datum, bool is_color);
+cv::Mat DecodeDatumToCVMat(const DatumView& datum, bool is_color,
+    int height, int width, bool reduced);
 
 void CVMatToDatum(const cv::Mat& cv_img, Datum* datum);
 #endif  // USE_OPENCV
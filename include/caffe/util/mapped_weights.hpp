@@ -0,0 +1,74 @@
+#ifndef CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
+#define CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A weights file (".caffeweights") that is loaded by mapping it into
+ *        memory instead of parsing it.
+ *
+ * The file starts with the 8 bytes "CAFFEMAP" and the uint64 size of a
+ * serialized WeightsIndex, followed by the index and, from the next 64-byte
+ * boundary on, the raw tensors in native byte order, each starting on a
+ * 64-byte boundary. Opening a file only parses the index;
+ * Net::CopyTrainedLayersFromMapped then points the blobs at the mapped
+ * tensors with SyncedMemory::set_cpu_data, so pages are only read when a
+ * layer first touches them and are shared between the processes that map
+ * the same file.
+ *
+ * The mapping is private: writing to a bound blob (e.g. when fine-tuning)
+ * copies the touched pages and never changes the file. It stays valid as
+ * long as this object lives.
+ */
+// 以 mmap 方式加载的权值文件，打开时只解析索引
+class MappedWeights {
+ public:
+  explicit MappedWeights(const string& filename);
+  ~MappedWeights();
+
+  inline const string& filename() const { return filename_; }
+  inline const WeightsIndex& index() const { return index_; }
+  /// @brief Returns the indices of the tensors of layer in blob order, or
+  ///        NULL if the file has no tensors for layer.
+  const vector<int>* layer_tensors(const string& layer) const;
+  /// @brief Returns the mapped data of tensor i.
+  inline const void* data(int i) const {
+    return static_cast<const char*>(addr_) + data_begin_ +
+        index_.tensor(i).offset();
+  }
+  static int64_t count(const WeightsIndex::Tensor& tensor);
+
+ protected:
+  string filename_;
+  void* addr_;
+  size_t size_;
+  size_t data_begin_;  // 张量数据在文件中的起点
+  WeightsIndex index_;
+  std::map<string, vector<int> > layers_;
+
+DISABLE_COPY_AND_ASSIGN(MappedWeights);
+};
+
+/// @brief Returns whether filename names a mapped weights file.
+bool IsMappedWeightsFile(const string& filename);
+
+/**
+ * @brief Writes the blobs of the layers in param (e.g. a .caffemodel) as a
+ *        mapped weights file. Blobs with double_data are stored as DOUBLE.
+ */
+void WriteMappedWeights(const NetParameter& param, const string& filename);
+
+/// @brief Reads a mapped weights file into the blobs of param's layers,
+///        i.e. the form of a .caffemodel.
+void ReadMappedWeights(const string& filename, NetParameter* param);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
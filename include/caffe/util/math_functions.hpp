@@ -2,6 +2,7 @@
 #define CAFFE_UTIL_MATH_FUNCTIONS_H_
 
 #include <stdint.h>
+#include <boost/function.hpp>
 #include <cmath>  // for std::fabs and std::signbit
 
 #include "glog/logging.h"
@@ -67,6 +68,31 @@ void caffe_div(const int N, const Dtype* a, const Dtype* b, Dtype* y);
 template <typename Dtype>
 void caffe_powx(const int n, const Dtype* a, const Dtype b, Dtype* y);
 
+// Calls kernel(begin, end) on consecutive ranges that cover [0, n). The ranges
+// are run on ThreadPool::Global() if each thread gets at least
+// caffe_cpu_parallel_threshold() elements, otherwise kernel(0, n) is called on
+// the calling thread. Range boundaries are multiples of 16 elements so that
+// threads do not write to the same cache line.
+// 把 [0, n) 切分成若干段，交给全局线程池并行处理
+void caffe_cpu_parallel_for(const int n,
+    const boost::function<void(int, int)>& kernel);
+// 每个线程至少处理的元素个数，数组更短时不并行
+int caffe_cpu_parallel_threshold();
+void caffe_set_cpu_parallel_threshold(const int n);
+
+// Element-wise CPU kernels are built with CAFFE_SIMD_CLONES to be cloned for
+// AVX-512 and AVX2; the dynamic loader picks the clone for the running CPU.
+// The vectorizer is enabled explicitly since -O2 does not vectorize loops
+// that need an aliasing check, which is every kernel that may run in place.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 6 && \
+    defined(__x86_64__) && defined(__linux__) && !defined(__CUDACC__)
+#define CAFFE_SIMD_CLONES \
+  __attribute__((target_clones("avx512f", "avx2", "default"), \
+      optimize("tree-vectorize", "vect-cost-model=dynamic")))
+#else
+#define CAFFE_SIMD_CLONES
+#endif
+
 unsigned int caffe_rng_rand();
 
 template <typename Dtype>
@@ -0,0 +1,89 @@
+#ifndef CAFFE_UTIL_PROFILER_HPP_
+#define CAFFE_UTIL_PROFILER_HPP_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Collects per-layer timing and memory traffic events, e.g. from
+ *        Net::ForwardFromTo and Net::BackwardFromTo (see Net::set_profiler).
+ *
+ * Every event is added to a per-layer summary. The first max_events events
+ * are also kept individually and can be written as a Chrome trace
+ * (chrome://tracing or https://ui.perfetto.dev). In GPU mode Now() waits for
+ * the device, so the times are exact but the profiled run is slower. One
+ * profiler may be shared by nets running on different threads.
+ */
+// 逐层性能分析器：记录每一层前向/后向的耗时、读写字节数，可导出为 Chrome trace
+class Profiler {
+ public:
+  struct Event {
+    string name;              // 层的名字
+    string type;              // 层的类型
+    string phase;             // "Forward" 或 "Backward"
+    int thread;               // 记录事件的 solver rank
+    int64_t start_us;         // 相对于分析器创建时刻的开始时间（微秒）
+    int64_t duration_us;      // 耗时（微秒）
+    size_t bytes_read;        // 读取的 blob 字节数
+    size_t bytes_written;     // 写入的 blob 字节数
+    size_t bytes_allocated;   // 输出 blob 已分配内存的字节数，共享的只算一次
+  };
+
+  // 同一层同一阶段所有事件的汇总
+  struct Summary {
+    string name;
+    string type;
+    string phase;
+    int64_t calls;
+    int64_t total_us;
+    size_t bytes_read;
+    size_t bytes_written;
+    size_t bytes_allocated;   // 最近一次记录的值
+  };
+
+  explicit Profiler(size_t max_events = 1000000);
+
+  // Microseconds since the profiler was created; waits for the GPU first.
+  int64_t Now();
+  // 记录一个从 start_us 开始、到现在结束的事件
+  void Record(const string& name, const string& type, const string& phase,
+      int64_t start_us, size_t bytes_read, size_t bytes_written,
+      size_t bytes_allocated);
+
+  vector<Event> events();
+  // 按第一次出现的顺序返回每一层每个阶段的汇总
+  vector<Summary> summary();
+  void Clear();
+
+  // 打印每一层的平均耗时和带宽
+  void LogSummary();
+  // Writes the kept events in the Chrome trace event format.
+  void WriteChromeTrace(const string& filename);
+
+ protected:
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  shared_ptr<sync> sync_;
+  size_t max_events_;
+  vector<Event> events_;
+  vector<Summary> summary_;
+  // (phase, name) -> summary_ 中的下标
+  std::map<pair<string, string>, int> summary_index_;
+
+DISABLE_COPY_AND_ASSIGN(Profiler);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PROFILER_HPP_
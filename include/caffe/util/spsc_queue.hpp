@@ -0,0 +1,64 @@
+#ifndef CAFFE_UTIL_SPSC_QUEUE_HPP_
+#define CAFFE_UTIL_SPSC_QUEUE_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A bounded lock-free queue with exactly one producer thread and one
+ *        consumer thread.
+ *
+ * push and pop only touch two atomic indices on the fast path. A thread that
+ * finds the queue full (producer) or empty (consumer) spins briefly, then
+ * yields, and finally parks on a condition variable until the other side
+ * makes progress; the other side only takes the lock when somebody is
+ * parked. Parking is a boost::thread interruption point, so a blocked
+ * InternalThread can still be stopped.
+ *
+ * The number of pushes that found the queue full and of pops that found it
+ * empty are counted, to show which side of a pipeline is the bottleneck.
+ */
+// 单生产者单消费者的无锁环形队列
+template<typename T>
+class SPSCQueue {
+ public:
+  explicit SPSCQueue(size_t capacity);
+
+  // 只能由生产者线程调用；队列满时等待
+  void push(const T& t);
+  bool try_push(const T& t);
+
+  // 只能由消费者线程调用；队列空时等待，等待时每 1000 次打印一次 log_on_wait
+  T pop(const string& log_on_wait = "");
+  bool try_pop(T* t);
+
+  // Approximate when called from a third thread.
+  size_t size() const;
+  inline size_t capacity() const { return slots_.size(); }
+
+  // 生产者发现队列已满的次数
+  size_t producer_stalls() const;
+  // 消费者发现队列为空的次数
+  size_t consumer_stalls() const;
+
+ protected:
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX. Also fails on
+   Linux CUDA 7.0.18.
+   */
+  class sync;
+
+  vector<T> slots_;
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(SPSCQueue);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SPSC_QUEUE_HPP_
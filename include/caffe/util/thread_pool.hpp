@@ -0,0 +1,61 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A fixed-size pool of worker threads for data-parallel CPU loops.
+ *
+ * Run(n, fn) calls fn(i) once for every i in [0, n) and returns when all
+ * calls have finished. The calling thread takes part in the work, so a pool
+ * of num_threads() threads only spawns num_threads() - 1 workers, and Run may
+ * be nested or called from several threads at once without deadlocking.
+ *
+ * Tasks run on threads that do not carry the caller's Caffe thread-local
+ * state (mode, RNG, ...), so they should only touch raw pointers and other
+ * state that was prepared by the caller.
+ */
+// 固定大小的CPU线程池，用于把一个循环拆分到多个线程上并行执行
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  // 线程池的线程总数（包括调用 Run 的线程本身）
+  inline int num_threads() const { return num_threads_; }
+
+  // 对 [0, n) 中的每个 i 调用 fn(i)，全部完成后返回
+  void Run(int n, const boost::function<void(int)>& fn);
+
+  /**
+   * @brief The process-wide pool used by CPU layers and math routines.
+   *
+   * It has a single thread (i.e. everything runs serially on the caller)
+   * until SetGlobalThreads is called. Resizing must not race with Run.
+   */
+  static ThreadPool& Global();
+  static void SetGlobalThreads(int num_threads);
+  static int global_threads();
+
+ protected:
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  void WorkerEntry();
+
+  int num_threads_;
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
@@ -0,0 +1,107 @@
+#ifndef CAFFE_UTIL_TRANSPORT_HPP_
+#define CAFFE_UTIL_TRANSPORT_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Point-to-point messaging between the ranks (processes) of a
+ *        multi-process training job.
+ *
+ * Messages between two ranks arrive in the order they were sent. A
+ * transport is used by one thread at a time. The collective operations
+ * below (RingAllReduce, TreeAllReduce, TreeBroadcast) only rely on this
+ * interface, so new backends only have to implement it.
+ */
+// 进程间点对点通信的抽象接口
+class Transport {
+ public:
+  virtual ~Transport() {}
+
+  virtual int rank() const = 0;
+  virtual int size() const = 0;
+  // 阻塞直到数据全部发出 / 收到
+  virtual void Send(int peer, const void* data, size_t bytes) = 0;
+  virtual void Recv(int peer, void* data, size_t bytes) = 0;
+  /**
+   * @brief Sends to send_peer while receiving from recv_peer, so that all
+   *        ranks of a ring may exchange large messages at once without
+   *        deadlocking on full socket buffers.
+   */
+  virtual void SendRecv(int send_peer, const void* send_data,
+      size_t send_bytes, int recv_peer, void* recv_data,
+      size_t recv_bytes) = 0;
+
+  /**
+   * @brief Connects rank to the other size - 1 ranks.
+   *
+   * address is "unix:<path prefix>" for Unix domain sockets or
+   * "tcp:<host>:<base port>" for TCP; see SocketTransport.
+   */
+  static shared_ptr<Transport> Create(const string& address, int rank,
+      int size);
+};
+
+/**
+ * @brief Transport over a full mesh of stream sockets.
+ *
+ * With "unix:<prefix>" rank r listens on the socket file <prefix>.<r>; with
+ * "tcp:<host>:<port>" rank r listens on port + r and all ranks must be able
+ * to reach host (so one host per job). Every rank accepts connections from
+ * the higher ranks and connects to the lower ones, retrying for up to a
+ * minute, so the processes may be started in any order.
+ */
+class SocketTransport : public Transport {
+ public:
+  SocketTransport(const string& address, int rank, int size);
+  virtual ~SocketTransport();
+
+  virtual int rank() const { return rank_; }
+  virtual int size() const { return size_; }
+  virtual void Send(int peer, const void* data, size_t bytes);
+  virtual void Recv(int peer, void* data, size_t bytes);
+  virtual void SendRecv(int send_peer, const void* send_data,
+      size_t send_bytes, int recv_peer, void* recv_data, size_t recv_bytes);
+
+ protected:
+  // 创建监听 socket / 连接到 peer，地址由 address_ 和 rank 决定
+  int Listen();
+  int Connect(int peer);
+
+  string address_;
+  string unix_path_;      // 本 rank 监听的 socket 文件，TCP 时为空
+  int rank_;
+  int size_;
+  vector<int> sockets_;   // 到每个 rank 的连接，自己的位置为 -1
+
+DISABLE_COPY_AND_ASSIGN(SocketTransport);
+};
+
+/**
+ * @brief Sums data over all ranks in place with a ring: a reduce-scatter
+ *        and an all-gather of size - 1 steps each. Every rank sends and
+ *        receives 2 (size - 1) / size of the buffer, the minimum for large
+ *        buffers.
+ */
+template <typename Dtype>
+void RingAllReduce(Transport* transport, Dtype* data, int count);
+
+/**
+ * @brief Sums data over all ranks in place with a binomial tree: reduce to
+ *        rank 0, then broadcast. Takes 2 log2(size) steps of the whole
+ *        buffer, which is faster than the ring for small buffers.
+ */
+template <typename Dtype>
+void TreeAllReduce(Transport* transport, Dtype* data, int count);
+
+/// @brief Copies data of rank 0 to all ranks along a binomial tree.
+template <typename Dtype>
+void TreeBroadcast(Transport* transport, Dtype* data, int count);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TRANSPORT_HPP_
@@ -23,6 +23,8 @@
 // You're strongly advised to upgrade to >= 1.7.
 #ifndef NPY_ARRAY_C_CONTIGUOUS
 #define NPY_ARRAY_C_CONTIGUOUS NPY_C_CONTIGUOUS
+#define NPY_ARRAY_ALIGNED NPY_ALIGNED
+#define NPY_ARRAY_WRITEABLE NPY_WRITEABLE
 #define PyArray_SetBaseObject(arr, x) (PyArray_BASE(arr) = (x))
 #endif
 
@@ -66,6 +68,20 @@ void Log(const string& s) {
 
 void set_random_seed(unsigned int seed) { Caffe::set_random_seed(seed); }
 
+// Releases the GIL while long-running native code runs, so that other Python
+// threads can go on meanwhile. Python layers and callbacks take it back with
+// PyGILAcquire (see python_layer.hpp).
+class PyGILRelease {
+ public:
+  PyGILRelease() : state_(PyEval_SaveThread()) { }
+  ~PyGILRelease() { PyEval_RestoreThread(state_); }
+
+ private:
+  PyThreadState* state_;
+
+DISABLE_COPY_AND_ASSIGN(PyGILRelease);
+};
+
 // For convenience, check that input files can be opened, and raise an
 // exception that boost will send to Python if not (caffe could still crash
 // later if the input files are disturbed before they are actually used, but
@@ -266,6 +282,72 @@ bp::object BlobVec_add_blob(bp::tuple args, bp::dict kwargs) {
   return bp::object();
 }
 
+// Heavy Net and Solver calls, run without the GIL.
+Dtype Net_ForwardFromTo(Net<Dtype>* net, int start, int end) {
+  PyGILRelease gil;
+  return net->ForwardFromTo(start, end);
+}
+void Net_BackwardFromTo(Net<Dtype>* net, int start, int end) {
+  PyGILRelease gil;
+  net->BackwardFromTo(start, end);
+}
+void Net_Reshape(Net<Dtype>* net) {
+  PyGILRelease gil;
+  net->Reshape();
+}
+void Net_CopyTrainedLayersFrom(Net<Dtype>* net, const string filename) {
+  PyGILRelease gil;
+  net->CopyTrainedLayersFrom(filename);
+}
+void Solver_Step(Solver<Dtype>* solver, int iters) {
+  PyGILRelease gil;
+  solver->Step(iters);
+}
+void Solver_Solve(Solver<Dtype>* solver) {
+  PyGILRelease gil;
+  solver->Solve();
+}
+void Solver_SolveFrom(Solver<Dtype>* solver, const char* resume_file) {
+  PyGILRelease gil;
+  solver->Solve(resume_file);
+}
+void Solver_Restore(Solver<Dtype>* solver, const char* state_file) {
+  PyGILRelease gil;
+  solver->Restore(state_file);
+}
+void Solver_Snapshot(Solver<Dtype>* solver) {
+  PyGILRelease gil;
+  solver->Snapshot();
+}
+
+// Uses the memory of a float32 array of any rank as the data of the blob,
+// reshaped to the shape of the array, without copying. The array must stay
+// alive while the blob uses it: Net.bind in pycaffe.py keeps a reference.
+void Blob_BindData(Blob<Dtype>* blob, bp::object array_obj) {
+  if (!PyArray_Check(array_obj.ptr())) {
+    throw std::runtime_error("data must be a numpy array");
+  }
+  PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(array_obj.ptr());
+  const int flags =
+      NPY_ARRAY_C_CONTIGUOUS | NPY_ARRAY_ALIGNED | NPY_ARRAY_WRITEABLE;
+  if ((PyArray_FLAGS(arr) & flags) != flags) {
+    throw std::runtime_error("data must be C contiguous, aligned and"
+        " writeable");
+  }
+  if (PyArray_TYPE(arr) != NPY_DTYPE) {
+    throw std::runtime_error("data must be float32");
+  }
+  if (PyArray_NDIM(arr) > kMaxBlobAxes) {
+    throw std::runtime_error("data has too many axes");
+  }
+  if (PyArray_SIZE(arr) == 0) {
+    throw std::runtime_error("data must not be empty");
+  }
+  vector<int> shape(PyArray_DIMS(arr), PyArray_DIMS(arr) + PyArray_NDIM(arr));
+  blob->Reshape(shape);
+  blob->set_cpu_data(static_cast<Dtype*>(PyArray_DATA(arr)));
+}
+
 template<typename Dtype>
 class SolverCallback: public Solver<Dtype>::Callback {
  protected:
@@ -275,9 +357,11 @@ class SolverCallback: public Solver<Dtype>::Callback {
   SolverCallback(bp::object on_start, bp::object on_gradients_ready)
     : on_start_(on_start), on_gradients_ready_(on_gradients_ready) { }
   virtual void on_gradients_ready() {
+    PyGILAcquire gil;
     on_gradients_ready_();
   }
   virtual void on_start() {
+    PyGILAcquire gil;
     on_start_();
   }
 };
@@ -305,6 +389,7 @@ class NetCallback: public Net<Dtype>::Callback {
 
  protected:
   virtual void run(int layer) {
+    PyGILAcquire gil;
     run_(layer);
   }
   bp::object run_;
@@ -339,8 +424,6 @@ class NCCL {
 };
 #endif
 
-BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SolveOverloads, Solve, 0, 1);
-
 BOOST_PYTHON_MODULE(_caffe) {
   // below, we prepend an underscore to methods that will be replaced
   // in Python
@@ -372,13 +455,11 @@ BOOST_PYTHON_MODULE(_caffe) {
             bp::arg("weights")=bp::object())))
     // Legacy constructor
     .def("__init__", bp::make_constructor(&Net_Init_Load))
-    .def("_forward", &Net<Dtype>::ForwardFromTo)
-    .def("_backward", &Net<Dtype>::BackwardFromTo)
-    .def("reshape", &Net<Dtype>::Reshape)
+    .def("_forward", &Net_ForwardFromTo)
+    .def("_backward", &Net_BackwardFromTo)
+    .def("reshape", &Net_Reshape)
     .def("clear_param_diffs", &Net<Dtype>::ClearParamDiffs)
-    // The cast is to select a particular overload.
-    .def("copy_from", static_cast<void (Net<Dtype>::*)(const string)>(
-        &Net<Dtype>::CopyTrainedLayersFrom))
+    .def("copy_from", &Net_CopyTrainedLayersFrom)
     .def("share_with", &Net<Dtype>::ShareTrainedLayersWith)
     .add_property("_blob_loss_weights", bp::make_function(
         &Net<Dtype>::blob_loss_weights, bp::return_internal_reference<>()))
@@ -425,6 +506,7 @@ BOOST_PYTHON_MODULE(_caffe) {
     .add_property("count",    static_cast<int (Blob<Dtype>::*)() const>(
         &Blob<Dtype>::count))
     .def("reshape",           bp::raw_function(&Blob_Reshape))
+    .def("_bind_data",        &Blob_BindData)
     .add_property("data",     bp::make_function(&Blob<Dtype>::mutable_cpu_data,
           NdarrayCallPolicies()))
     .add_property("diff",     bp::make_function(&Blob<Dtype>::mutable_cpu_diff,
@@ -454,11 +536,11 @@ BOOST_PYTHON_MODULE(_caffe) {
     .add_property("iter", &Solver<Dtype>::iter)
     .def("add_callback", &Solver_add_callback<Dtype>)
     .def("add_callback", &Solver_add_nccl)
-    .def("solve", static_cast<void (Solver<Dtype>::*)(const char*)>(
-          &Solver<Dtype>::Solve), SolveOverloads())
-    .def("step", &Solver<Dtype>::Step)
-    .def("restore", &Solver<Dtype>::Restore)
-    .def("snapshot", &Solver<Dtype>::Snapshot)
+    .def("solve", &Solver_Solve)
+    .def("solve", &Solver_SolveFrom)
+    .def("step", &Solver_Step)
+    .def("restore", &Solver_Restore)
+    .def("snapshot", &Solver_Snapshot)
     .add_property("param", bp::make_function(&Solver<Dtype>::param,
               bp::return_value_policy<bp::copy_const_reference>()));
   BP_REGISTER_SHARED_PTR_TO_PYTHON(Solver<Dtype>);
@@ -522,6 +604,12 @@ BOOST_PYTHON_MODULE(_caffe) {
     .add_property("ms", &Timer::MilliSeconds);
   BP_REGISTER_SHARED_PTR_TO_PYTHON(Timer);
 
+  // Create the GIL, which Python before 3.7 only does when asked, so that
+  // the calls above can release it.
+#if PY_VERSION_HEX < 0x03070000
+  PyEval_InitThreads();
+#endif
+
   // boost python expects a void (missing) return value, while import_array
   // returns NULL for python3. import_array1() forces a void return value.
   import_array1();
@@ -259,6 +259,21 @@ def _Net_set_input_arrays(self, data, labels):
     return self._set_input_arrays(data, labels)
 
 
+def _Net_bind(self, blob_name, array):
+    """
+    Use the memory of array as the data of blob blob_name, without copying:
+    the blob takes the shape of array, and forward reads an input from it
+    or writes an output to it. array must be a C-contiguous float32 ndarray
+    of any rank. The net keeps a reference to array until the blob is bound
+    again; reshaping the blob to a larger size detaches it from array.
+    Call reshape() after binding an input of a new shape.
+    """
+    self.blobs[blob_name]._bind_data(array)
+    if not hasattr(self, '_bound_arrays'):
+        self._bound_arrays = {}
+    self._bound_arrays[blob_name] = array
+
+
 def _Net_batch(self, blobs):
     """
     Batch blob lists according to net's batch size.
@@ -327,6 +342,7 @@ Net.backward = _Net_backward
 Net.forward_all = _Net_forward_all
 Net.forward_backward_all = _Net_forward_backward_all
 Net.set_input_arrays = _Net_set_input_arrays
+Net.bind = _Net_bind
 Net._batch = _Net_batch
 Net.inputs = _Net_inputs
 Net.outputs = _Net_outputs
@@ -35,6 +35,22 @@ def simple_net_file(num_output):
     return f.name
 
 
+def input_net_file():
+    """Make a net with an input blob, returning the name of the (temporary)
+    file."""
+
+    f = tempfile.NamedTemporaryFile(mode='w+', delete=False)
+    f.write("""name: 'inputnet'
+    layer { type: 'Input' name: 'data' top: 'data'
+      input_param { shape { dim: 2 dim: 3 } } }
+    layer { type: 'InnerProduct' name: 'ip' bottom: 'data' top: 'ip'
+      inner_product_param { num_output: 4
+        weight_filler { type: 'gaussian' std: 1 }
+        bias_filler { type: 'constant' value: 1 } } }""")
+    f.close()
+    return f.name
+
+
 class TestNet(unittest.TestCase):
     def setUp(self):
         self.num_output = 13
@@ -75,6 +91,35 @@ class TestNet(unittest.TestCase):
         # Check that the diffs are now 0
         self.assertTrue((diff == 0).all())
 
+    def test_bind(self):
+        net_file = input_net_file()
+        net = caffe.Net(net_file, caffe.TEST)
+        os.remove(net_file)
+        x = np.random.randn(2, 3).astype(np.float32)
+        net.blobs['data'].data[...] = x
+        expected = net.forward()['ip'].copy()
+
+        # forward reads the bound input and writes the bound output in place
+        data = x.copy()
+        ip = np.zeros((2, 4), dtype=np.float32)
+        net.bind('data', data)
+        net.bind('ip', ip)
+        out = net.forward()['ip']
+        self.assertTrue(np.allclose(ip, expected))
+        self.assertEqual(out.__array_interface__['data'][0],
+                         ip.__array_interface__['data'][0])
+        data *= 2
+        net.forward()
+        self.assertTrue(np.allclose(ip - 1, 2 * (expected - 1), atol=1e-5))
+
+        # any rank binds, with the shape of the array
+        net.bind('data', np.ones((2, 1, 3), dtype=np.float32))
+        self.assertEqual(net.blobs['data'].data.shape, (2, 1, 3))
+        self.assertRaises(RuntimeError, net.bind, 'data',
+                          np.ones((2, 3), dtype=np.float64))
+        self.assertRaises(RuntimeError, net.bind, 'data',
+                          np.ones((3, 2), dtype=np.float32).T)
+
     def test_inputs_outputs(self):
         self.assertEqual(self.net.inputs, [])
         self.assertEqual(self.net.outputs, ['loss'])
@@ -0,0 +1,182 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "caffe/batching_server.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+struct BatchingServer<Dtype>::Request {
+  const Dtype* input;
+  Dtype* output;
+  boost::system_time arrival;
+  bool done;
+};
+
+template <typename Dtype>
+class BatchingServer<Dtype>::sync {
+ public:
+  boost::mutex mutex_;
+  boost::condition_variable queue_condition_;  // 有新请求或停止
+  boost::condition_variable done_condition_;   // 有请求完成
+  boost::thread_group threads_;
+  boost::system_time start_;
+};
+
+template <typename Dtype>
+BatchingServer<Dtype>::BatchingServer(
+    const shared_ptr<InferenceReplicas<Dtype> >& replicas, int max_batch,
+    int max_latency_us)
+    : replicas_(replicas), max_batch_(max_batch),
+      max_latency_us_(max_latency_us), output_count_(0), stopping_(false),
+      requests_(0), batches_(0), sync_(new sync()) {
+  CHECK_GE(max_batch, 1);
+  CHECK_GE(max_latency_us, 0);
+  const Net<Dtype>& net = *replicas_->replica(0);
+  CHECK_EQ(net.input_blobs().size(), 1)
+      << "The batching server needs a net with one input blob.";
+  const Blob<Dtype>& input = *net.input_blobs()[0];
+  CHECK_GE(input.num_axes(), 1);
+  input_count_ = input.count(1);
+  for (int i = 0; i < net.output_blobs().size(); ++i) {
+    const Blob<Dtype>& output = *net.output_blobs()[i];
+    CHECK(output.num_axes() >= 1 && output.shape(0) == input.shape(0))
+        << "Output " << net.blob_names()[net.output_blob_indices()[i]]
+        << " does not have the batch as its first axis.";
+    output_count_ += output.count(1);
+  }
+  sync_->start_ = boost::get_system_time();
+  for (int i = 0; i < replicas_->size(); ++i) {
+    sync_->threads_.create_thread(
+        boost::bind(&BatchingServer<Dtype>::Work, this, i));
+  }
+}
+
+template <typename Dtype>
+BatchingServer<Dtype>::~BatchingServer() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    stopping_ = true;
+  }
+  sync_->queue_condition_.notify_all();
+  sync_->threads_.join_all();
+}
+
+template <typename Dtype>
+void BatchingServer<Dtype>::Predict(const Dtype* input, Dtype* output) {
+  Request request;
+  request.input = input;
+  request.output = output;
+  request.done = false;
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  CHECK(!stopping_);
+  request.arrival = boost::get_system_time();
+  queue_.push_back(&request);
+  // 正在凑批次的线程也需要知道队列变长了
+  sync_->queue_condition_.notify_all();
+  while (!request.done) {
+    sync_->done_condition_.wait(lock);
+  }
+}
+
+template <typename Dtype>
+void BatchingServer<Dtype>::Work(int replica) {
+  Net<Dtype>* net = replicas_->replica(replica).get();
+  Blob<Dtype>* input = net->input_blobs()[0];
+  vector<int> shape = input->shape();
+  vector<Request*> batch;
+  while (true) {
+    batch.clear();
+    {
+      boost::mutex::scoped_lock lock(sync_->mutex_);
+      while (batch.empty()) {
+        while (queue_.empty() && !stopping_) {
+          sync_->queue_condition_.wait(lock);
+        }
+        if (queue_.empty()) {
+          return;
+        }
+        // 等到批次已满或最早的请求等满 max_latency_us
+        const boost::system_time deadline = queue_.front()->arrival +
+            boost::posix_time::microseconds(max_latency_us_);
+        while (!queue_.empty() && queue_.size() < max_batch_ && !stopping_ &&
+            sync_->queue_condition_.timed_wait(lock, deadline)) {
+        }
+        while (!queue_.empty() && batch.size() < max_batch_) {
+          batch.push_back(queue_.front());
+          queue_.pop_front();
+        }
+      }
+    }
+
+    const int n = batch.size();
+    if (shape[0] != n) {
+      shape[0] = n;
+      input->Reshape(shape);
+      net->Reshape();
+    }
+    Dtype* input_data = input->mutable_cpu_data();
+    for (int i = 0; i < n; ++i) {
+      std::copy(batch[i]->input, batch[i]->input + input_count_,
+          input_data + i * input_count_);
+    }
+    const vector<Blob<Dtype>*>& outputs = net->Forward();
+    int offset = 0;
+    for (int j = 0; j < outputs.size(); ++j) {
+      const int count = outputs[j]->count(1);
+      const Dtype* output_data = outputs[j]->cpu_data();
+      for (int i = 0; i < n; ++i) {
+        std::copy(output_data + i * count, output_data + (i + 1) * count,
+            batch[i]->output + offset);
+      }
+      offset += count;
+    }
+
+    {
+      boost::mutex::scoped_lock lock(sync_->mutex_);
+      const boost::system_time now = boost::get_system_time();
+      for (int i = 0; i < n; ++i) {
+        const float latency_ms =
+            (now - batch[i]->arrival).total_microseconds() / 1000.0;
+        if (latencies_ms_.size() < kLatencyWindow) {
+          latencies_ms_.push_back(latency_ms);
+        } else {
+          latencies_ms_[requests_ % kLatencyWindow] = latency_ms;
+        }
+        ++requests_;
+        batch[i]->done = true;
+      }
+      ++batches_;
+    }
+    sync_->done_condition_.notify_all();
+  }
+}
+
+template <typename Dtype>
+typename BatchingServer<Dtype>::Stats BatchingServer<Dtype>::stats() const {
+  Stats stats;
+  vector<float> latencies;
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    stats.requests = requests_;
+    stats.batches = batches_;
+    latencies = latencies_ms_;
+  }
+  stats.seconds = (boost::get_system_time() - sync_->start_)
+      .total_microseconds() / 1e6;
+  stats.p50_latency_ms = 0;
+  stats.p99_latency_ms = 0;
+  if (!latencies.empty()) {
+    std::sort(latencies.begin(), latencies.end());
+    stats.p50_latency_ms = latencies[latencies.size() / 2];
+    stats.p99_latency_ms = latencies[std::min(latencies.size() - 1,
+        latencies.size() * 99 / 100)];
+  }
+  return stats;
+}
+
+INSTANTIATE_CLASS(BatchingServer);
+
+}  // namespace caffe
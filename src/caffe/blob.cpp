@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <climits>
 #include <vector>
 
@@ -103,6 +104,8 @@ void Blob<Dtype>::set_cpu_data(Dtype* data) {
   if (data_->size() != size) {
     data_.reset(new SyncedMemory(size));
     diff_.reset(new SyncedMemory(size));
+    // 新的 data 只有 count_ 大小，之后更大的 Reshape 必须重新分配
+    capacity_ = count_;
   }
   data_->set_cpu_data(data);
 }
@@ -124,6 +127,8 @@ void Blob<Dtype>::set_gpu_data(Dtype* data) {
   if (data_->size() != size) {
     data_.reset(new SyncedMemory(size));
     diff_.reset(new SyncedMemory(size));
+    // 新的 data 只有 count_ 大小，之后更大的 Reshape 必须重新分配
+    capacity_ = count_;
   }
   data_->set_gpu_data(data);
 }
@@ -184,6 +189,18 @@ void Blob<Dtype>::ShareDiff(const Blob& other) {
   diff_ = other.diff();
 }
 
+// 将data指向共用的内存缓冲区
+template <typename Dtype>
+void Blob<Dtype>::ShareDataBuffer(const shared_ptr<SyncedMemory>& buffer) {
+  CHECK(buffer);
+  const int buffer_count = static_cast<int>(
+      std::min<size_t>(buffer->size() / sizeof(Dtype), INT_MAX));
+  CHECK_LE(count_, buffer_count);
+  data_ = buffer;
+  // 容量不能超过缓冲区大小，否则之后的 Reshape 可能越界
+  capacity_ = std::min(capacity_, buffer_count);
+}
+
 // The "update" method is used for parameter blobs in a Net, which are stored
 // as Blob<float> or Blob<double> -- hence we do not define it for
 // Blob<int> or Blob<unsigned int>.
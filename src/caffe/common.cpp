@@ -9,14 +9,73 @@
 
 namespace caffe {
 
+// The Caffe state of a thread: its own context, created on first use, and
+// the context installed by a ContextScope, if any.
+struct ThreadContext {
+  ThreadContext() : active(NULL) {}
+  shared_ptr<Caffe> own;
+  Caffe* active;
+};
+
 // Make sure each thread can have different values.
-static boost::thread_specific_ptr<Caffe> thread_instance_;
+static boost::thread_specific_ptr<ThreadContext> thread_instance_;
 
-Caffe& Caffe::Get() {
+static ThreadContext* GetThreadContext() {
   if (!thread_instance_.get()) {
-    thread_instance_.reset(new Caffe());
+    thread_instance_.reset(new ThreadContext());
+  }
+  return thread_instance_.get();
+}
+
+Caffe& Caffe::Get() {
+  ThreadContext* thread = GetThreadContext();
+  if (thread->active) {
+    return *thread->active;
+  }
+  if (!thread->own) {
+    thread->own.reset(new Caffe());
+  }
+  return *thread->own;
+}
+
+shared_ptr<Caffe> Caffe::CreateContext() {
+  shared_ptr<Caffe> context(new Caffe());
+  context->mode_ = Get().mode_;
+  context->solver_count_ = Get().solver_count_;
+  context->solver_rank_ = Get().solver_rank_;
+  context->multiprocess_ = Get().multiprocess_;
+  return context;
+}
+
+Caffe::ContextScope::ContextScope(Caffe* context)
+    : context_(context), previous_(NULL), previous_device_(-1) {
+  if (!context_) {
+    return;
+  }
+  ThreadContext* thread = GetThreadContext();
+  previous_ = thread->active;
+  thread->active = context_;
+#ifndef CPU_ONLY
+  // cuBLAS / cuRAND 句柄属于创建它们的设备
+  if (context_->mode_ == Caffe::GPU && context_->device_ >= 0) {
+    CUDA_CHECK(cudaGetDevice(&previous_device_));
+    if (previous_device_ != context_->device_) {
+      CUDA_CHECK(cudaSetDevice(context_->device_));
+    }
+  }
+#endif
+}
+
+Caffe::ContextScope::~ContextScope() {
+  if (!context_) {
+    return;
   }
-  return *(thread_instance_.get());
+  GetThreadContext()->active = previous_;
+#ifndef CPU_ONLY
+  if (previous_device_ >= 0 && previous_device_ != context_->device_) {
+    CUDA_CHECK(cudaSetDevice(previous_device_));
+  }
+#endif
 }
 
 // random seeding
@@ -52,7 +111,7 @@ void GlobalInit(int* pargc, char*** pargv) {
 #ifdef CPU_ONLY  // CPU-only Caffe.
 
 Caffe::Caffe()
-    : random_generator_(), mode_(Caffe::CPU),
+    : random_generator_(), mode_(Caffe::CPU), device_(-1),
       solver_count_(1), solver_rank_(0), multiprocess_(false) { }
 
 Caffe::~Caffe() { }
@@ -106,8 +165,11 @@ void* Caffe::RNG::generator() {
 
 Caffe::Caffe()
     : cublas_handle_(NULL), curand_generator_(NULL), random_generator_(),
-    mode_(Caffe::CPU),
+    mode_(Caffe::CPU), device_(-1),
     solver_count_(1), solver_rank_(0), multiprocess_(false) {
+  if (cudaGetDevice(&device_) != cudaSuccess) {
+    device_ = -1;
+  }
   // Try to create a cublas handler, and report an error if failed (but we will
   // keep the program running as one might just want to run CPU code).
   if (cublasCreate(&cublas_handle_) != CUBLAS_STATUS_SUCCESS) {
@@ -151,6 +213,7 @@ void Caffe::SetDevice(const int device_id) {
   int current_device;
   CUDA_CHECK(cudaGetDevice(&current_device));
   if (current_device == device_id) {
+    Get().device_ = device_id;
     return;
   }
   // The call to cudaSetDevice must come before any calls to Get, which
@@ -165,6 +228,7 @@ void Caffe::SetDevice(const int device_id) {
       CURAND_RNG_PSEUDO_DEFAULT));
   CURAND_CHECK(curandSetPseudoRandomGeneratorSeed(Get().curand_generator_,
       cluster_seedgen()));
+  Get().device_ = device_id;
 }
 
 void Caffe::DeviceQuery() {
@@ -39,18 +39,18 @@ DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
 }
 
 template<typename Dtype>
-void DataTransformer<Dtype>::Transform(const Datum& datum,
+void DataTransformer<Dtype>::Transform(const DatumView& datum,
                                        Dtype* transformed_data) {
-  const string& data = datum.data();
-  const int datum_channels = datum.channels();
-  const int datum_height = datum.height();
-  const int datum_width = datum.width();
+  const char* data = datum.data;
+  const int datum_channels = datum.channels;
+  const int datum_height = datum.height;
+  const int datum_width = datum.width;
 
   const int crop_size = param_.crop_size();
   const Dtype scale = param_.scale();
   const bool do_mirror = param_.mirror() && Rand(2);
   const bool has_mean_file = param_.has_mean_file();
-  const bool has_uint8 = data.size() > 0;
+  const bool has_uint8 = datum.data_size > 0;
   const bool has_mean_values = mean_values_.size() > 0;
 
   CHECK_GT(datum_channels, 0);
@@ -108,7 +108,7 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
           datum_element =
             static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
         } else {
-          datum_element = datum.float_data(data_index);
+          datum_element = datum.float_data[data_index];
         }
         if (has_mean_file) {
           transformed_data[top_index] =
@@ -130,8 +130,14 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
                                        Blob<Dtype>* transformed_blob) {
+  Transform(DatumView(datum), transformed_blob);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const DatumView& datum,
+                                       Blob<Dtype>* transformed_blob) {
   // If datum is encoded, decode and transform the cv::image.
-  if (datum.encoded()) {
+  if (datum.encoded) {
 #ifdef USE_OPENCV
     CHECK(!(param_.force_color() && param_.force_gray()))
         << "cannot set both force_color and force_gray";
@@ -154,9 +160,9 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   }
 
   const int crop_size = param_.crop_size();
-  const int datum_channels = datum.channels();
-  const int datum_height = datum.height();
-  const int datum_width = datum.width();
+  const int datum_channels = datum.channels;
+  const int datum_height = datum.height;
+  const int datum_width = datum.width;
 
   // Check dimensions.
   const int channels = transformed_blob->channels();
@@ -440,7 +446,12 @@ void DataTransformer<Dtype>::Transform(Blob<Dtype>* input_blob,
 
 template<typename Dtype>
 vector<int> DataTransformer<Dtype>::InferBlobShape(const Datum& datum) {
-  if (datum.encoded()) {
+  return InferBlobShape(DatumView(datum));
+}
+
+template<typename Dtype>
+vector<int> DataTransformer<Dtype>::InferBlobShape(const DatumView& datum) {
+  if (datum.encoded) {
 #ifdef USE_OPENCV
     CHECK(!(param_.force_color() && param_.force_gray()))
         << "cannot set both force_color and force_gray";
@@ -458,9 +469,9 @@ vector<int> DataTransformer<Dtype>::InferBlobShape(const Datum& datum) {
 #endif  // USE_OPENCV
   }
   const int crop_size = param_.crop_size();
-  const int datum_channels = datum.channels();
-  const int datum_height = datum.height();
-  const int datum_width = datum.width();
+  const int datum_channels = datum.channels;
+  const int datum_height = datum.height;
+  const int datum_width = datum.width;
   // Check dimensions.
   CHECK_GT(datum_channels, 0);
   CHECK_GE(datum_height, crop_size);
@@ -0,0 +1,93 @@
+#include <set>
+#include <string>
+#include <vector>
+
+#include "caffe/inference_replicas.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+InferenceReplicas<Dtype>::InferenceReplicas(const string& param_file,
+    const string& weights_file, int count) {
+  NetParameter param;
+  ReadNetParamsFromTextFileOrDie(param_file, &param);
+  param.mutable_state()->set_phase(TEST);
+  replicas_.push_back(shared_ptr<Net<Dtype> >(new Net<Dtype>(param)));
+  replicas_[0]->CopyTrainedLayersFrom(weights_file);
+  Init(param, count);
+}
+
+template <typename Dtype>
+InferenceReplicas<Dtype>::InferenceReplicas(const NetParameter& param,
+    shared_ptr<Net<Dtype> > net, int count) {
+  CHECK_EQ(net->phase(), TEST) << "Inference replicas must be TEST nets.";
+  NetParameter test_param(param);
+  test_param.mutable_state()->set_phase(TEST);
+  replicas_.push_back(net);
+  Init(test_param, count);
+}
+
+template <typename Dtype>
+void InferenceReplicas<Dtype>::Init(const NetParameter& param, int count) {
+  CHECK_GE(count, 1);
+  // 先把权值同步到当前模式的内存，之后 Forward 只读，不会改变 SyncedMemory 的状态
+  const vector<Blob<Dtype>*>& weights = replicas_[0]->learnable_params();
+  weights_bytes_ = 0;
+  for (int i = 0; i < weights.size(); ++i) {
+    if (Caffe::mode() == Caffe::CPU) {
+      weights[i]->cpu_data();
+    } else {
+      weights[i]->gpu_data();
+    }
+    weights_bytes_ += weights[i]->count() * sizeof(Dtype);
+  }
+  for (int i = 1; i < count; ++i) {
+    shared_ptr<Net<Dtype> > replica(new Net<Dtype>(param));
+    replica->ShareTrainedLayersWith(replicas_[0].get());
+    // 重新 Reshape，让由权值派生的缓存（如 Winograd 变换后的卷积核）改用共享的那份
+    replica->Reshape();
+    replicas_.push_back(replica);
+  }
+  for (int i = 0; i < count; ++i) {
+    replicas_[i]->set_context(Caffe::CreateContext());
+  }
+  // 共享激活内存的 blob 只计算一次
+  std::set<SyncedMemory*> activations;
+  activations_bytes_ = 0;
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = replicas_[0]->blobs();
+  for (int i = 0; i < blobs.size(); ++i) {
+    if (blobs[i]->data() && activations.insert(blobs[i]->data().get()).second) {
+      activations_bytes_ += blobs[i]->data()->size();
+    }
+  }
+  LOG(INFO) << count << " inference replicas share "
+      << weights_bytes() / 1048576.0 << " MB of weights; each replica uses "
+      << activations_bytes_ / 1048576.0 << " MB of activations.";
+}
+
+template <typename Dtype>
+size_t InferenceReplicas<Dtype>::weights_bytes() const {
+  // 变换后的卷积核按层的当前形状分配，各副本共享的只计算一次
+  std::set<const Blob<Dtype>*> transformed;
+  size_t bytes = weights_bytes_;
+  for (int i = 0; i < replicas_.size(); ++i) {
+    const vector<shared_ptr<Layer<Dtype> > >& layers = replicas_[i]->layers();
+    for (int j = 0; j < layers.size(); ++j) {
+      const WinogradConvolutionLayer<Dtype>* winograd =
+          dynamic_cast<const WinogradConvolutionLayer<Dtype>*>(
+              layers[j].get());
+      const Blob<Dtype>* blob =
+          winograd ? winograd->transformed_weights() : NULL;
+      if (blob && transformed.insert(blob).second) {
+        bytes += blob->count() * sizeof(Dtype);
+      }
+    }
+  }
+  return bytes;
+}
+
+INSTANTIATE_CLASS(InferenceReplicas);
+
+}  // namespace caffe
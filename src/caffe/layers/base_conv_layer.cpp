@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <vector>
 
@@ -5,6 +6,7 @@
 #include "caffe/layers/base_conv_layer.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -17,6 +19,11 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   ConvolutionParameter conv_param = this->layer_param_.convolution_param();
   //im2col,一般情况下 num_spatial_axes_ == 2,即将2维图像拉成向量，但 force_nd_im2col_ 针对的是更general的情况N维图像
   force_nd_im2col_ = conv_param.force_nd_im2col();
+  // 融合的 ReLU 只在卷积层的输出上使用
+  fuse_relu_ = conv_param.fuse_relu();
+  relu_negative_slope_ = conv_param.relu_negative_slope();
+  CHECK(!fuse_relu_ || !reverse_dimensions())
+      << "fuse_relu is only supported by the Convolution layer.";
   // 输入图像的第几个轴是通道，对输入(N, C, H, W)，那么 axis() = 1，我们可以对输入(H, W)单独进行卷积操作 
   channel_axis_ = bottom[0]->CanonicalAxisIndex(conv_param.axis()); 
   // (H, W)，即 axis() = 2 或 3 可以看成是 spatial_axis
@@ -313,6 +320,15 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
+  forward_cpu_gemm_col(input, weights, output,
+      is_1x1_ ? NULL : col_buffer_.mutable_cpu_data(), skip_im2col);
+}
+
+// 在给定的 col buffer 上实现前向传播卷积操作
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_col(const Dtype* input,
+    const Dtype* weights, Dtype* output, Dtype* col_buffer,
+    bool skip_im2col) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
     if (!skip_im2col) {
@@ -320,9 +336,9 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
       // 则使用 conv_im2col_cpu 对使用卷积核滑动过程中的每一个 kernel 大小的图像块    
       // 变成一个列向量，形成一个 height = kernel_dim_ 的    
       // width = 卷积后图像height * 卷积后图像width   
-      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+      conv_im2col_cpu(input, col_buffer);
     }
-    col_buff = col_buffer_.cpu_data();
+    col_buff = col_buffer;
   }
 
   // 使用caffe的 cpu_gemm 来进行计算  
@@ -359,7 +375,15 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+  backward_cpu_gemm_col(output, weights, input,
+      is_1x1_ ? NULL : col_buffer_.mutable_cpu_data());
+}
+
+// 在给定的 col buffer 上计算关于bottom data的导数
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_gemm_col(const Dtype* output,
+    const Dtype* weights, Dtype* input, Dtype* col_buffer) {
+  Dtype* col_buff = col_buffer;
   if (is_1x1_) {
     col_buff = input;
   }
@@ -383,10 +407,18 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
     const Dtype* output, Dtype* weights) {
+  weight_cpu_gemm_col(input, output, weights,
+      is_1x1_ ? NULL : col_buffer_.mutable_cpu_data());
+}
+
+// 在给定的 col buffer 上计算关于权重的导数
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::weight_cpu_gemm_col(const Dtype* input,
+    const Dtype* output, Dtype* weights, Dtype* col_buffer) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
-    col_buff = col_buffer_.cpu_data();
+    conv_im2col_cpu(input, col_buffer);
+    col_buff = col_buffer;
   }
   for (int g = 0; g < group_; ++g) {
     // 式子： weights = weights + output * (Trans)col_buff
@@ -408,6 +440,123 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
       input, bias_multiplier_.cpu_data(), 1., bias);
 }
 
+// 为 batch 并行准备每个任务的 col buffer（以及权重导数部分和），返回任务数
+template <typename Dtype>
+int BaseConvolutionLayer<Dtype>::setup_cpu_batch(bool need_weight_partials) {
+  const int num_tasks =
+      std::max(1, std::min(ThreadPool::global_threads(), num_));
+  while (task_col_buffers_.size() < num_tasks - 1) {
+    task_col_buffers_.push_back(
+        shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    task_weight_diffs_.push_back(
+        shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  // Pointers are fetched here, on the calling thread, so that the workers
+  // never touch the SyncedMemory state machine.
+  task_col_data_.assign(num_tasks, NULL);
+  task_weight_diff_data_.assign(num_tasks, NULL);
+  for (int task = 0; task < num_tasks; ++task) {
+    if (!is_1x1_) {
+      if (task == 0) {
+        task_col_data_[task] = col_buffer_.mutable_cpu_data();
+      } else {
+        Blob<Dtype>* col_buffer = task_col_buffers_[task - 1].get();
+        col_buffer->Reshape(col_buffer_shape_);
+        task_col_data_[task] = col_buffer->mutable_cpu_data();
+      }
+    }
+    if (need_weight_partials && task > 0) {
+      Blob<Dtype>* partial = task_weight_diffs_[task - 1].get();
+      partial->ReshapeLike(*this->blobs_[0]);
+      task_weight_diff_data_[task] = partial->mutable_cpu_data();
+      caffe_set(partial->count(), Dtype(0), task_weight_diff_data_[task]);
+    }
+  }
+  return num_tasks;
+}
+
+// 一个任务对 batch 中 [n_begin, n_end) 范围内的图像做前向传播
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_task(int task, int num_tasks,
+    const Dtype* input, const Dtype* weights, const Dtype* bias,
+    Dtype* output) {
+  const int n_begin = num_ * task / num_tasks;
+  const int n_end = num_ * (task + 1) / num_tasks;
+  for (int n = n_begin; n < n_end; ++n) {
+    forward_cpu_gemm_col(input + n * bottom_dim_, weights,
+        output + n * top_dim_, task_col_data_[task], false);
+    if (bias) {
+      forward_cpu_bias(output + n * top_dim_, bias);
+    }
+    // The output of the image is still in cache: apply the ReLU here rather
+    // than in another pass over the whole blob.
+    forward_cpu_relu(output + n * top_dim_, top_dim_);
+  }
+}
+
+// 一个任务对 batch 中 [n_begin, n_end) 范围内的图像做后向传播
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_task(int task, int num_tasks,
+    const Dtype* input, const Dtype* output, const Dtype* weights,
+    Dtype* input_diff) {
+  const int n_begin = num_ * task / num_tasks;
+  const int n_end = num_ * (task + 1) / num_tasks;
+  Dtype* weight_diff = task_weight_diff_data_[task];
+  for (int n = n_begin; n < n_end; ++n) {
+    if (weight_diff) {
+      weight_cpu_gemm_col(input + n * bottom_dim_, output + n * top_dim_,
+          weight_diff, task_col_data_[task]);
+    }
+    if (input_diff) {
+      backward_cpu_gemm_col(output + n * top_dim_, weights,
+          input_diff + n * bottom_dim_, task_col_data_[task]);
+    }
+  }
+}
+
+// 对整个 batch 做前向传播，batch 内的图像分配到全局线程池上并行计算
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_batch(const Dtype* input,
+    const Dtype* weights, const Dtype* bias, Dtype* output) {
+  const int num_tasks = setup_cpu_batch(false);
+  if (bias) {
+    bias_multiplier_.cpu_data();
+  }
+  ThreadPool::Global().Run(num_tasks,
+      boost::bind(&BaseConvolutionLayer<Dtype>::forward_cpu_task, this, _1,
+          num_tasks, input, weights, bias, output));
+}
+
+// 融合的 ReLU 只保存了输出；负斜率非负时输出与输入同号，据此即可求导
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_relu(const Dtype* output,
+    Dtype* output_diff, int count) {
+  for (int i = 0; i < count; ++i) {
+    output_diff[i] *= output[i] > 0 ? Dtype(1) : relu_negative_slope_;
+  }
+}
+
+// 对整个 batch 做后向传播；各任务的权重导数部分和按任务顺序归约，保证结果确定
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_batch(const Dtype* input,
+    const Dtype* output, const Dtype* weights, Dtype* weight_diff,
+    Dtype* input_diff) {
+  const int num_tasks = setup_cpu_batch(weight_diff != NULL);
+  if (weight_diff) {
+    // The first chunk accumulates straight into the weight gradient.
+    task_weight_diff_data_[0] = weight_diff;
+  }
+  ThreadPool::Global().Run(num_tasks,
+      boost::bind(&BaseConvolutionLayer<Dtype>::backward_cpu_task, this, _1,
+          num_tasks, input, output, weights, input_diff));
+  if (weight_diff) {
+    for (int task = 1; task < num_tasks; ++task) {
+      caffe_axpy<Dtype>(this->blobs_[0]->count(), Dtype(1),
+          task_weight_diff_data_[task], weight_diff);
+    }
+  }
+}
+
 #ifndef CPU_ONLY
 
 // 实现前向传播卷积操作
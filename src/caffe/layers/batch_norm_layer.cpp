@@ -272,7 +272,7 @@ void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       spatial_dim, 1, 1., this->num_by_chans_.cpu_data(),
       this->spatial_sum_multiplier_.cpu_data(), 0., this->temp_.mutable_cpu_data());
   // 实现 element-wise 相除
-  caffe_div(this->temp_.count(), top_data, this->djfde.cpu_data(), top_data);
+  caffe_div(this->temp_.count(), top_data, this->temp_.cpu_data(), top_data);
   // TODO(cdoersch): The caching is only needed because later in-place layers
   //                 might clobber the data.  Can we skip this if they won't?
   caffe_copy(this->x_norm_.count(), top_data, this->x_norm_.mutable_cpu_data());
@@ -34,17 +34,12 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const Dtype* bottom_data = bottom[i]->cpu_data(); 
     // 获取读写 top_data 指针
     Dtype* top_data = top[i]->mutable_cpu_data();
-    // num_ == batch size 依次对每一个 batch 进行操作
-    for (int n = 0; n < this->num_; ++n) {
-      // bottom_dim_  = 输入通道数c * 输入h * 输入w
-      // top_dim_ = 输出通道数 * 输出h * 输出w
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
-      }
-    }
+    // 获取只读 bias 指针（无偏置项时为 NULL）
+    const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+    // num_ == batch size, batch 中的每张图像被分配到线程池的各个任务上
+    // bottom_dim_  = 输入通道数c * 输入h * 输入w
+    // top_dim_ = 输出通道数 * 输出h * 输出w
+    this->forward_cpu_batch(bottom_data, weight, bias, top_data);
   }
 }
 
@@ -57,6 +52,12 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   // 获取读写 weight_diff 指针
   Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
   for (int i = 0; i < top.size(); ++i) { // 依次对 top 中的每一个 blob 进行操作
+    // Turn the gradient w.r.t. the fused ReLU's output into the gradient
+    // w.r.t. the convolution output, in place like an in-place ReLU layer.
+    if (this->fuse_relu_) {
+      this->backward_cpu_relu(top[i]->cpu_data(), top[i]->mutable_cpu_diff(),
+          top[i]->count());
+    }
     // 获取只读 top_diff 指针
     const Dtype* top_diff = top[i]->cpu_diff();
     // 获取只读 bottom_data 指针
@@ -72,20 +73,13 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       }
     }
     if (this->param_propagate_down_[0] || propagate_down[i]) {
-      for (int n = 0; n < this->num_; ++n) {    // 依次对每一个 batch 进行操作
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
-        // 计算对 weight 的梯度: 这个地方的 top_diff 实际上就是激活函数回传的导数
-        if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
-              top_diff + n * this->top_dim_, weight_diff);
-        }
-        // gradient w.r.t. bottom data, if necessary. 
-        // 这里的 bottom_diff 实际上就是下一层的 top_diff
-        if (propagate_down[i]) {
-          this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
-              bottom_diff + n * this->bottom_dim_);
-        }
-      }
+      // gradient w.r.t. weight. Note that we will accumulate diffs.
+      // 计算对 weight 的梯度: 这个地方的 top_diff 实际上就是激活函数回传的导数
+      // gradient w.r.t. bottom data, if necessary.
+      // 这里的 bottom_diff 实际上就是下一层的 top_diff
+      this->backward_cpu_batch(bottom_data, top_diff, weight,
+          this->param_propagate_down_[0] ? weight_diff : NULL,
+          propagate_down[i] ? bottom_diff : NULL);
     }
   }
 }
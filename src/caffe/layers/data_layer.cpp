@@ -1,13 +1,16 @@
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
 #endif  // USE_OPENCV
 #include <stdint.h>
+#include <boost/bind.hpp>
 
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/io.hpp"
 
 namespace caffe {
 
@@ -28,13 +31,19 @@ DataLayer<Dtype>::~DataLayer() {
 template <typename Dtype>
 void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  const int batch_size = this->layer_param_.data_param().batch_size();
+  const DataParameter& data_param = this->layer_param_.data_param();
+  const int batch_size = data_param.batch_size();
+  CHECK((data_param.new_height() == 0 && data_param.new_width() == 0) ||
+      (data_param.new_height() > 0 && data_param.new_width() > 0))
+      << "Current implementation requires new_height and new_width to be "
+      << "set at the same time.";
   // Read a data point, and use it to initialize the top blob.
-  Datum datum;
-  datum.ParseFromString(cursor_->value());
+  Datum storage;
+  const DatumView datum = ParseDatumView(cursor_->value_data(),
+      cursor_->value_size(), &storage);
 
   // Use data_transformer to infer the expected blob shape from datum.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
+  vector<int> top_shape = InferItemShape(datum);
   this->transformed_data_.Reshape(top_shape);
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size;
@@ -54,6 +63,26 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
+  // Transform workers. Each task has its own transformer, seeded here from
+  // the layer's RNG stream, and always handles the same items of a batch, so
+  // batches are reproducible for a fixed seed and number of threads.
+  const int num_threads = this->layer_param_.data_param().transform_threads();
+  CHECK_GE(num_threads, 1) << "transform_threads must be positive.";
+  transform_pool_.reset(new ThreadPool(num_threads));
+  task_transformers_.resize(num_threads);
+  task_transformed_data_.resize(num_threads);
+  task_decode_time_.resize(num_threads);
+  task_trans_time_.resize(num_threads);
+  task_datums_.resize(num_threads);
+  task_transformers_[0] = this->data_transformer_;
+  for (int t = 0; t < num_threads; ++t) {
+    if (t > 0) {
+      task_transformers_[t].reset(new DataTransformer<Dtype>(
+          this->transform_param_, this->phase_));
+      task_transformers_[t]->InitRand();
+    }
+    task_transformed_data_[t].reset(new Blob<Dtype>());
+  }
 }
 
 template <typename Dtype>
@@ -82,54 +111,157 @@ template<typename Dtype>
 void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CPUTimer batch_timer;
   batch_timer.Start();
-  double read_time = 0;
-  double trans_time = 0;
   CPUTimer timer;
   CHECK(batch->data_.count());
   CHECK(this->transformed_data_.count());
   const int batch_size = this->layer_param_.data_param().batch_size();
 
-  Datum datum;
+  // Collect the records of the whole batch; the cursor is only used here.
+  // LMDB values stay valid while the cursor moves on, so only pointers into
+  // the database are kept; other backends' values are copied once into
+  // buffers reused across batches.
+  timer.Start();
+  const bool persists = cursor_->value_data_persists();
+  value_data_.resize(batch_size);
+  value_size_.resize(batch_size);
+  if (!persists) {
+    value_copies_.resize(batch_size);
+  }
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    timer.Start();
     while (Skip()) {
       Next();
     }
-    datum.ParseFromString(cursor_->value());
-    read_time += timer.MicroSeconds();
-
-    if (item_id == 0) {
-      // Reshape according to the first datum of each batch
-      // on single input batches allows for inputs of varying dimension.
-      // Use data_transformer to infer the expected blob shape from datum.
-      vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
-      this->transformed_data_.Reshape(top_shape);
-      // Reshape batch according to the batch_size.
-      top_shape[0] = batch_size;
-      batch->data_.Reshape(top_shape);
+    if (persists) {
+      value_data_[item_id] = cursor_->value_data();
+      value_size_[item_id] = cursor_->value_size();
+    } else {
+      value_copies_[item_id].assign(
+          static_cast<const char*>(cursor_->value_data()),
+          cursor_->value_size());
+      value_data_[item_id] = value_copies_[item_id].data();
+      value_size_[item_id] = value_copies_[item_id].size();
+    }
+    Next();
+  }
+  const double read_time = timer.MicroSeconds();
+
+  // Reshape according to the first datum of each batch
+  // on single input batches allows for inputs of varying dimension.
+  // Use data_transformer to infer the expected blob shape from datum.
+  vector<int> top_shape = InferItemShape(
+      ParseDatumView(value_data_[0], value_size_[0], &first_datum_));
+  this->transformed_data_.Reshape(top_shape);
+  for (int t = 0; t < task_transformed_data_.size(); ++t) {
+    task_transformed_data_[t]->Reshape(top_shape);
+  }
+  // Reshape batch according to the batch_size.
+  top_shape[0] = batch_size;
+  batch->data_.Reshape(top_shape);
+
+  // Decode and transform the items in parallel; every task writes to its own
+  // slots of the batch.
+  Dtype* top_data = batch->data_.mutable_cpu_data();
+  Dtype* top_label = this->output_labels_ ?
+      batch->label_.mutable_cpu_data() : NULL;
+  const int num_tasks = task_transformers_.size();
+  transform_pool_->Run(num_tasks,
+      boost::bind(&DataLayer<Dtype>::transform_task, this, _1, num_tasks,
+          top_data, top_label));
+  double decode_time = 0;
+  double trans_time = 0;
+  for (int t = 0; t < num_tasks; ++t) {
+    decode_time += task_decode_time_[t];
+    trans_time += task_trans_time_[t];
+  }
+  batch_timer.Stop();
+  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
+  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
+  DLOG(INFO) << "   Decode time: " << decode_time / 1000 << " ms.";
+  DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+}
+
+template<typename Dtype>
+void DataLayer<Dtype>::transform_task(int task, int num_tasks,
+    Dtype* top_data, Dtype* top_label) {
+  const int batch_size = value_data_.size();
+  const int item_begin = batch_size * task / num_tasks;
+  const int item_end = batch_size * (task + 1) / num_tasks;
+  DataTransformer<Dtype>* transformer = task_transformers_[task].get();
+  Blob<Dtype>* transformed_data = task_transformed_data_[task].get();
+  const int item_count = transformed_data->count();
+  CPUTimer timer;
+  double decode_time = 0;
+  double trans_time = 0;
+  for (int item_id = item_begin; item_id < item_end; ++item_id) {
+    timer.Start();
+    // The pixels, or the encoded image, are read where the record lies.
+    const DatumView datum = ParseDatumView(value_data_[item_id],
+        value_size_[item_id], &task_datums_[task]);
+#ifdef USE_OPENCV
+    cv::Mat cv_img;
+    if (datum.encoded) {
+      cv_img = DecodeItem(datum);
     }
+#endif  // USE_OPENCV
+    decode_time += timer.MicroSeconds();
 
     // Apply data transformations (mirror, scale, crop...)
     timer.Start();
-    int offset = batch->data_.offset(item_id);
-    Dtype* top_data = batch->data_.mutable_cpu_data();
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
+    transformed_data->set_cpu_data(top_data + item_id * item_count);
+#ifdef USE_OPENCV
+    if (datum.encoded) {
+      transformer->Transform(cv_img, transformed_data);
+    } else {
+      transformer->Transform(datum, transformed_data);
+    }
+#else
+    transformer->Transform(datum, transformed_data);
+#endif  // USE_OPENCV
     // Copy label.
-    if (this->output_labels_) {
-      Dtype* top_label = batch->label_.mutable_cpu_data();
-      top_label[item_id] = datum.label();
+    if (top_label) {
+      top_label[item_id] = datum.label;
     }
     trans_time += timer.MicroSeconds();
-    Next();
   }
-  timer.Stop();
-  batch_timer.Stop();
-  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
-  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
-  DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  task_decode_time_[task] = decode_time;
+  task_trans_time_[task] = trans_time;
 }
 
+template<typename Dtype>
+vector<int> DataLayer<Dtype>::InferItemShape(const DatumView& datum) {
+#ifdef USE_OPENCV
+  const DataParameter& data_param = this->layer_param_.data_param();
+  if (datum.encoded && data_param.new_height() > 0) {
+    return this->data_transformer_->InferBlobShape(DecodeItem(datum));
+  }
+#endif  // USE_OPENCV
+  return this->data_transformer_->InferBlobShape(datum);
+}
+
+#ifdef USE_OPENCV
+template<typename Dtype>
+cv::Mat DataLayer<Dtype>::DecodeItem(const DatumView& datum) {
+  const TransformationParameter& param = this->transform_param_;
+  const DataParameter& data_param = this->layer_param_.data_param();
+  CHECK(!(param.force_color() && param.force_gray()))
+      << "cannot set both force_color and force_gray";
+  const int height = data_param.new_height();
+  const int width = data_param.new_width();
+  if (param.force_color() || param.force_gray()) {
+    return DecodeDatumToCVMat(datum, param.force_color(), height, width,
+        data_param.reduced_decode());
+  }
+  // 保持原有通道数时只能按原尺寸解码
+  cv::Mat cv_img = DecodeDatumToCVMatNative(datum);
+  if (height > 0 && width > 0 && cv_img.data) {
+    cv::Mat cv_img_resized;
+    cv::resize(cv_img, cv_img_resized, cv::Size(width, height));
+    return cv_img_resized;
+  }
+  return cv_img;
+}
+#endif  // USE_OPENCV
+
 INSTANTIATE_CLASS(DataLayer);
 REGISTER_LAYER_CLASS(Data);
 
@@ -0,0 +1,161 @@
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/direct_conv_layer.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+const int DirectConvolutionLayer<Dtype>::kOutputBlock;
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  use_direct_ = this->num_spatial_axes_ == 2 && !this->force_nd_im2col_;
+  if (use_direct_ && this->layer_param_.convolution_param().engine() ==
+      ConvolutionParameter_Engine_DEFAULT) {
+    // Picked automatically: only take over the shapes where im2col + GEMM
+    // does little arithmetic per byte of column buffer.
+    const int* kernel_shape = this->kernel_shape_.cpu_data();
+    const bool depthwise = this->channels_ / this->group_ <= 2;
+    const bool strided_1x1 = !this->is_1x1_ &&
+        kernel_shape[0] == 1 && kernel_shape[1] == 1;
+    use_direct_ = depthwise || strided_1x1;
+  }
+  output_blocks_ = (this->num_output_ / this->group_ + kOutputBlock - 1)
+      / kOutputBlock;
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::forward_cpu_task(int task, int num_tasks,
+    const Dtype* input, const Dtype* weights, const Dtype* bias,
+    Dtype* output) {
+  const int channels_g = this->channels_ / this->group_;
+  const int num_output_g = this->num_output_ / this->group_;
+  const int height = this->conv_input_shape_.cpu_data()[1];
+  const int width = this->conv_input_shape_.cpu_data()[2];
+  const int kernel_h = this->kernel_shape_.cpu_data()[0];
+  const int kernel_w = this->kernel_shape_.cpu_data()[1];
+  const int stride_h = this->stride_.cpu_data()[0];
+  const int stride_w = this->stride_.cpu_data()[1];
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  const int dilation_h = this->dilation_.cpu_data()[0];
+  const int dilation_w = this->dilation_.cpu_data()[1];
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  const int kernel_dim = channels_g * kernel_h * kernel_w;
+  // Work items enumerate (image, group, block of output channels).
+  const int items_per_image = this->group_ * output_blocks_;
+  const int num_items = this->num_ * items_per_image;
+  const int item_begin = num_items * static_cast<int64_t>(task) / num_tasks;
+  const int item_end = num_items * static_cast<int64_t>(task + 1) / num_tasks;
+  Dtype* out[kOutputBlock];
+  Dtype w[kOutputBlock];
+  for (int item = item_begin; item < item_end; ++item) {
+    const int n = item / items_per_image;
+    const int g = (item % items_per_image) / output_blocks_;
+    const int block = item % output_blocks_;
+    const int oc_begin = g * num_output_g + block * kOutputBlock;
+    const int oc_count =
+        std::min(kOutputBlock, num_output_g - block * kOutputBlock);
+    const Dtype* image = input + n * this->bottom_dim_ +
+        g * channels_g * height * width;
+    for (int oh = 0; oh < output_h; ++oh) {
+      for (int j = 0; j < oc_count; ++j) {
+        out[j] = output + n * this->top_dim_ +
+            ((oc_begin + j) * output_h + oh) * output_w;
+        const Dtype value = bias ? bias[oc_begin + j] : Dtype(0);
+        for (int ow = 0; ow < output_w; ++ow) {
+          out[j][ow] = value;
+        }
+      }
+      for (int ic = 0; ic < channels_g; ++ic) {
+        const Dtype* plane = image + ic * height * width;
+        for (int kh = 0; kh < kernel_h; ++kh) {
+          const int ih = oh * stride_h - pad_h + kh * dilation_h;
+          if (ih < 0 || ih >= height) { continue; }
+          const Dtype* row = plane + ih * width;
+          for (int kw = 0; kw < kernel_w; ++kw) {
+            // Output columns whose input column iw = ow * stride_w + offset
+            // falls inside the image; the padding contributes nothing.
+            const int offset = kw * dilation_w - pad_w;
+            const int ow_begin = offset >= 0 ? 0 :
+                (-offset + stride_w - 1) / stride_w;
+            const int ow_end = (width - 1 - offset) < 0 ? 0 :
+                std::min(output_w, (width - 1 - offset) / stride_w + 1);
+            const int k = (ic * kernel_h + kh) * kernel_w + kw;
+            for (int j = 0; j < oc_count; ++j) {
+              w[j] = weights[(oc_begin + j) * kernel_dim + k];
+            }
+            if (oc_count == kOutputBlock) {
+              Dtype* out0 = out[0];
+              Dtype* out1 = out[1];
+              Dtype* out2 = out[2];
+              Dtype* out3 = out[3];
+              const Dtype w0 = w[0], w1 = w[1], w2 = w[2], w3 = w[3];
+              if (stride_w == 1) {
+                const Dtype* x = row + offset;
+                for (int ow = ow_begin; ow < ow_end; ++ow) {
+                  const Dtype value = x[ow];
+                  out0[ow] += w0 * value;
+                  out1[ow] += w1 * value;
+                  out2[ow] += w2 * value;
+                  out3[ow] += w3 * value;
+                }
+              } else {
+                for (int ow = ow_begin; ow < ow_end; ++ow) {
+                  const Dtype value = row[ow * stride_w + offset];
+                  out0[ow] += w0 * value;
+                  out1[ow] += w1 * value;
+                  out2[ow] += w2 * value;
+                  out3[ow] += w3 * value;
+                }
+              }
+            } else {
+              for (int j = 0; j < oc_count; ++j) {
+                Dtype* out_row = out[j];
+                const Dtype weight = w[j];
+                for (int ow = ow_begin; ow < ow_end; ++ow) {
+                  out_row[ow] += weight * row[ow * stride_w + offset];
+                }
+              }
+            }
+          }
+        }
+      }
+      // The output rows are complete and still in cache.
+      for (int j = 0; j < oc_count; ++j) {
+        this->forward_cpu_relu(out[j], output_w);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!use_direct_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  const int num_items = this->num_ * this->group_ * output_blocks_;
+  const int num_tasks =
+      std::max(1, std::min(ThreadPool::global_threads(), num_items));
+  this->conv_input_shape_.cpu_data();
+  for (int i = 0; i < bottom.size(); ++i) {
+    ThreadPool::Global().Run(num_tasks,
+        boost::bind(&DirectConvolutionLayer<Dtype>::forward_cpu_task, this,
+            _1, num_tasks, bottom[i]->cpu_data(), weight, bias,
+            top[i]->mutable_cpu_data()));
+  }
+}
+
+INSTANTIATE_CLASS(DirectConvolutionLayer);
+
+}  // namespace caffe
@@ -1,6 +1,7 @@
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
 
+#include <boost/bind.hpp>
 #include <fstream>  // NOLINT(readability/streams)
 #include <iostream>  // NOLINT(readability/streams)
 #include <string>
@@ -77,7 +78,8 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Read an image, and use it to initialize the top blob.
   // 读入一张图片，用来初始化top blob
   cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-                                    new_height, new_width, is_color);
+      new_height, new_width, is_color,
+      this->layer_param_.image_data_param().reduced_decode());
   CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
   // Use data_transformer to infer the expected blob shape from a cv_image.
   // 使用 data_transformer 来预测 top blob 的形状
@@ -104,6 +106,25 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < this->prefetch_.size(); ++i) {
     this->prefetch_[i]->label_.Reshape(label_shape);
   }
+  // Decode workers, set up as in DataLayer: each task has its own
+  // transformer, seeded here from the layer's RNG stream.
+  const int num_threads =
+      this->layer_param_.image_data_param().decode_threads();
+  CHECK_GE(num_threads, 1) << "decode_threads must be positive.";
+  decode_pool_.reset(new ThreadPool(num_threads));
+  task_transformers_.resize(num_threads);
+  task_transformed_data_.resize(num_threads);
+  task_decode_time_.resize(num_threads);
+  task_trans_time_.resize(num_threads);
+  task_transformers_[0] = this->data_transformer_;
+  for (int t = 0; t < num_threads; ++t) {
+    if (t > 0) {
+      task_transformers_[t].reset(new DataTransformer<Dtype>(
+          this->transform_param_, this->phase_));
+      task_transformers_[t]->InitRand();
+    }
+    task_transformed_data_[t].reset(new Blob<Dtype>());
+  }
 }
 
 template <typename Dtype>
@@ -118,52 +139,18 @@ template <typename Dtype>
 void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CPUTimer batch_timer;
   batch_timer.Start();
-  double read_time = 0;
-  double trans_time = 0;
-  CPUTimer timer;
   CHECK(batch->data_.count());
   CHECK(this->transformed_data_.count());
-  ImageDataParameter image_data_param = this->layer_param_.image_data_param();
-  const int batch_size = image_data_param.batch_size();
-  const int new_height = image_data_param.new_height();
-  const int new_width = image_data_param.new_width();
-  const bool is_color = image_data_param.is_color();
-  string root_folder = image_data_param.root_folder();
-
-  // Reshape according to the first image of each batch
-  // on single input batches allows for inputs of varying dimension.
-  // 先读一张图进来 reshape top blob
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-      new_height, new_width, is_color);
-  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-  // Use data_transformer to infer the expected blob shape from a cv_img.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
-  this->transformed_data_.Reshape(top_shape);
-  // Reshape batch according to the batch_size.
-  top_shape[0] = batch_size;
-  batch->data_.Reshape(top_shape);
-
-  Dtype* prefetch_data = batch->data_.mutable_cpu_data();
-  Dtype* prefetch_label = batch->label_.mutable_cpu_data();
+  const int batch_size = this->layer_param_.image_data_param().batch_size();
 
-  // datum scales
+  // Pick the images of the batch in list order, so the order (and the
+  // shuffles at the end of each epoch) do not depend on the thread count.
   const int lines_size = lines_.size();
+  Dtype* prefetch_label = batch->label_.mutable_cpu_data();
+  batch_filenames_.resize(batch_size);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    // get a blob
-    timer.Start();
     CHECK_GT(lines_size, lines_id_);
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-        new_height, new_width, is_color);
-    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply transformations (mirror, crop...) to the image
-    // 使用 transformation 对图像做预处理
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(prefetch_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
-    trans_time += timer.MicroSeconds();
-
+    batch_filenames_[item_id] = lines_[lines_id_].first;
     prefetch_label[item_id] = lines_[lines_id_].second;
     // go to the next iter
     lines_id_++;
@@ -177,12 +164,80 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       }
     }
   }
+  batch_images_.resize(batch_size);
+  const int num_tasks = task_transformers_.size();
+  decode_pool_->Run(num_tasks, boost::bind(
+      &ImageDataLayer<Dtype>::decode_task, this, _1, num_tasks));
+
+  // Reshape according to the first image of each batch
+  // on single input batches allows for inputs of varying dimension.
+  // Use data_transformer to infer the expected blob shape from a cv_img.
+  vector<int> top_shape =
+      this->data_transformer_->InferBlobShape(batch_images_[0]);
+  this->transformed_data_.Reshape(top_shape);
+  for (int t = 0; t < num_tasks; ++t) {
+    task_transformed_data_[t]->Reshape(top_shape);
+  }
+  // Reshape batch according to the batch_size.
+  top_shape[0] = batch_size;
+  batch->data_.Reshape(top_shape);
+
+  // Apply transformations (mirror, crop...) to the images; every task
+  // writes to its own slots of the batch.
+  Dtype* prefetch_data = batch->data_.mutable_cpu_data();
+  decode_pool_->Run(num_tasks, boost::bind(
+      &ImageDataLayer<Dtype>::transform_task, this, _1, num_tasks,
+      prefetch_data));
+  double read_time = 0;
+  double trans_time = 0;
+  for (int t = 0; t < num_tasks; ++t) {
+    read_time += task_decode_time_[t];
+    trans_time += task_trans_time_[t];
+  }
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+template <typename Dtype>
+void ImageDataLayer<Dtype>::decode_task(int task, int num_tasks) {
+  const ImageDataParameter& image_data_param =
+      this->layer_param_.image_data_param();
+  const int batch_size = batch_filenames_.size();
+  const int item_begin = batch_size * task / num_tasks;
+  const int item_end = batch_size * (task + 1) / num_tasks;
+  CPUTimer timer;
+  timer.Start();
+  for (int item_id = item_begin; item_id < item_end; ++item_id) {
+    batch_images_[item_id] = ReadImageToCVMat(
+        image_data_param.root_folder() + batch_filenames_[item_id],
+        image_data_param.new_height(), image_data_param.new_width(),
+        image_data_param.is_color(), image_data_param.reduced_decode());
+    CHECK(batch_images_[item_id].data) << "Could not load "
+        << batch_filenames_[item_id];
+  }
+  task_decode_time_[task] = timer.MicroSeconds();
+}
+
+template <typename Dtype>
+void ImageDataLayer<Dtype>::transform_task(int task, int num_tasks,
+    Dtype* top_data) {
+  const int batch_size = batch_images_.size();
+  const int item_begin = batch_size * task / num_tasks;
+  const int item_end = batch_size * (task + 1) / num_tasks;
+  DataTransformer<Dtype>* transformer = task_transformers_[task].get();
+  Blob<Dtype>* transformed_data = task_transformed_data_[task].get();
+  const int item_count = transformed_data->count();
+  CPUTimer timer;
+  timer.Start();
+  for (int item_id = item_begin; item_id < item_end; ++item_id) {
+    transformed_data->set_cpu_data(top_data + item_id * item_count);
+    transformer->Transform(batch_images_[item_id], transformed_data);
+  }
+  task_trans_time_[task] = timer.MicroSeconds();
+}
+
 INSTANTIATE_CLASS(ImageDataLayer);
 REGISTER_LAYER_CLASS(ImageData);
 
@@ -100,7 +100,7 @@ void SigmoidCrossEntropyLossLayer<Dtype>::Forward_cpu(
   Dtype loss = 0;
   for (int i = 0; i < bottom[0]->count(); ++i) {
     const int target_value = static_cast<int>(target[i]);
-    if (this->has_ignore_label_ && this->target_value == this->ignore_label_) {
+    if (this->has_ignore_label_ && target_value == this->ignore_label_) {
       continue;
     }
     // 将 x >= 0 和 x < 0 两个部分分开计算，这样使得 loss 值更加稳定
@@ -0,0 +1,350 @@
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Transform matrices of F(2x2,3x3): B^T (4x4), G (4x3) and A^T (2x4).
+const double kInputTransform2[4 * 4] = {
+  1,  0, -1,  0,
+  0,  1,  1,  0,
+  0, -1,  1,  0,
+  0,  1,  0, -1
+};
+const double kFilterTransform2[4 * 3] = {
+  1,    0,   0,
+  0.5,  0.5, 0.5,
+  0.5, -0.5, 0.5,
+  0,    0,   1
+};
+const double kOutputTransform2[2 * 4] = {
+  1, 1,  1,  0,
+  0, 1, -1, -1
+};
+
+// Transform matrices of F(4x4,3x3): B^T (6x6), G (6x3) and A^T (4x6).
+const double kInputTransform4[6 * 6] = {
+  4,  0, -5,  0, 1, 0,
+  0, -4, -4,  1, 1, 0,
+  0,  4, -4, -1, 1, 0,
+  0, -2, -1,  2, 1, 0,
+  0,  2, -1, -2, 1, 0,
+  0,  4,  0, -5, 0, 1
+};
+const double kFilterTransform4[6 * 3] = {
+  1.0 / 4,        0,         0,
+  -1.0 / 6,  -1.0 / 6,  -1.0 / 6,
+  -1.0 / 6,   1.0 / 6,  -1.0 / 6,
+  1.0 / 24,  1.0 / 12,   1.0 / 6,
+  1.0 / 24, -1.0 / 12,   1.0 / 6,
+  0,               0,          1
+};
+const double kOutputTransform4[4 * 6] = {
+  1, 1,  1, 1,  1, 0,
+  0, 1, -1, 2, -2, 0,
+  0, 1,  1, 4,  4, 0,
+  0, 1, -1, 8, -8, 1
+};
+
+// out (rows x rows) = L * X * L^T, with L (rows x k) and X (k x k).
+template <typename Dtype>
+inline void winograd_sandwich(const double* L, int rows, int k,
+    const Dtype* X, Dtype* out) {
+  Dtype tmp[6 * 6];
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < k; ++j) {
+      Dtype sum = 0;
+      for (int l = 0; l < k; ++l) {
+        sum += static_cast<Dtype>(L[i * k + l]) * X[l * k + j];
+      }
+      tmp[i * k + j] = sum;
+    }
+  }
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < rows; ++j) {
+      Dtype sum = 0;
+      for (int l = 0; l < k; ++l) {
+        sum += tmp[i * k + l] * static_cast<Dtype>(L[j * k + l]);
+      }
+      out[i * rows + j] = sum;
+    }
+  }
+}
+
+}  // namespace
+
+/**
+ * Transformed filters of one weight SyncedMemory for one tile size. Every
+ * layer whose weights are that SyncedMemory holds the same instance, so
+ * replicas sharing trained weights also share the transformed copy.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer<Dtype>::TransformedWeights {
+ public:
+  TransformedWeights(const shared_ptr<SyncedMemory>& source, int tile)
+      : source_(source), tile_(tile), generation_(0), valid_(false) {}
+
+  boost::weak_ptr<SyncedMemory> source_;
+  int tile_;
+  // 变换时 source_ 的 generation()，不同则需要重新变换
+  size_t generation_;
+  bool valid_;
+  /// @brief Laid out as [alpha^2][num_output][C / group].
+  Blob<Dtype> filters_;
+  // 保护 filters_ 的变换：多个副本可能在不同线程上同时 Forward
+  boost::mutex mutex_;
+
+  typedef std::pair<const SyncedMemory*, int> Key;
+  // 所有仍在使用的缓存，只保存 weak_ptr，最后一个层释放时缓存随之释放
+  static std::map<Key, boost::weak_ptr<TransformedWeights> >& registry() {
+    static std::map<Key, boost::weak_ptr<TransformedWeights> > registry;
+    return registry;
+  }
+  static boost::mutex& registry_mutex() {
+    static boost::mutex mutex;
+    return mutex;
+  }
+};
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  // The shape is only known here (e.g. 3D inputs with a single kernel_size),
+  // so the per-shape fallback to im2col + GEMM is decided on every reshape.
+  use_winograd_ = this->num_spatial_axes_ == 2 && !this->force_nd_im2col_;
+  for (int i = 0; use_winograd_ && i < this->num_spatial_axes_; ++i) {
+    use_winograd_ = this->kernel_shape_.cpu_data()[i] == 3 &&
+        this->stride_.cpu_data()[i] == 1 &&
+        this->dilation_.cpu_data()[i] == 1;
+  }
+  if (!use_winograd_) { return; }
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  // F(4x4,3x3) does 4x fewer multiplications than direct convolution against
+  // 2.25x for F(2x2,3x3), but wastes more work on partial border tiles and
+  // has a larger rounding error, so it is only used when asked for.
+  const bool large_tiles = this->layer_param_.convolution_param().engine() ==
+      ConvolutionParameter_Engine_WINOGRAD;
+  tile_ = (large_tiles && output_h >= 8 && output_w >= 8) ? 4 : 2;
+  alpha_ = tile_ + 2;
+  tiles_h_ = (output_h + tile_ - 1) / tile_;
+  tiles_w_ = (output_w + tile_ - 1) / tile_;
+  // 块大小改变，或权值已换成另一个 SyncedMemory（如 ShareTrainedLayersWith）时
+  // 换用对应的缓存。Forward 每次都会先调用 Reshape，这里只做廉价的比较。
+  if (!transformed_weights_ || transformed_weights_->tile_ != tile_ ||
+      transformed_weights_->source_.lock() != this->blobs_[0]->data()) {
+    acquire_transformed_weights();
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::acquire_transformed_weights() {
+  const shared_ptr<SyncedMemory>& source = this->blobs_[0]->data();
+  typedef typename TransformedWeights::Key Key;
+  std::map<Key, boost::weak_ptr<TransformedWeights> >& registry =
+      TransformedWeights::registry();
+  boost::mutex::scoped_lock lock(TransformedWeights::registry_mutex());
+  // 顺便清除已释放的缓存；地址相同但 SyncedMemory 已被替换的缓存不再使用
+  for (typename std::map<Key, boost::weak_ptr<TransformedWeights> >::iterator
+       it = registry.begin(); it != registry.end();) {
+    if (it->second.expired()) {
+      registry.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  const Key key(source.get(), tile_);
+  transformed_weights_ = registry[key].lock();
+  if (!transformed_weights_ ||
+      transformed_weights_->source_.lock() != source) {
+    transformed_weights_.reset(new TransformedWeights(source, tile_));
+    vector<int> weight_shape(3);
+    weight_shape[0] = alpha_ * alpha_;
+    weight_shape[1] = this->num_output_;
+    weight_shape[2] = this->channels_ / this->group_;
+    transformed_weights_->filters_.Reshape(weight_shape);
+    registry[key] = transformed_weights_;
+  }
+}
+
+template <typename Dtype>
+const Blob<Dtype>* WinogradConvolutionLayer<Dtype>::transformed_weights()
+    const {
+  return (use_winograd_ && transformed_weights_) ?
+      &transformed_weights_->filters_ : NULL;
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::transform_weights(const Dtype* weights,
+    Dtype* U) {
+  const double* G = (tile_ == 4) ? kFilterTransform4 : kFilterTransform2;
+  const int num_coeffs = alpha_ * alpha_;
+  const int filters = this->num_output_ * (this->channels_ / this->group_);
+  Dtype u[6 * 6];
+  for (int f = 0; f < filters; ++f) {
+    winograd_sandwich(G, alpha_, 3, weights + f * 9, u);
+    for (int xi = 0; xi < num_coeffs; ++xi) {
+      U[xi * filters + f] = u[xi];
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::forward_cpu_task(int task,
+    int num_tasks, const Dtype* input, const Dtype* bias, Dtype* output) {
+  const double* BT = (tile_ == 4) ? kInputTransform4 : kInputTransform2;
+  const double* AT = (tile_ == 4) ? kOutputTransform4 : kOutputTransform2;
+  const int num_coeffs = alpha_ * alpha_;
+  const int channels = this->channels_;
+  const int num_output = this->num_output_;
+  const int group = this->group_;
+  const int channels_g = channels / group;
+  const int num_output_g = num_output / group;
+  const int height = this->conv_input_shape_.cpu_data()[1];
+  const int width = this->conv_input_shape_.cpu_data()[2];
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  const int num_tiles = tiles_h_ * tiles_w_;
+  const Dtype* U = transformed_weights_->filters_.cpu_data();
+  // Slope applied to negative outputs: the fused ReLU's, or 1 without one.
+  const Dtype negative_slope =
+      this->fuse_relu_ ? this->relu_negative_slope_ : Dtype(1);
+  Dtype* V = task_input_data_[task];
+  Dtype* M = task_product_data_[task];
+  Dtype d[6 * 6];
+  Dtype v[6 * 6];
+  Dtype y[4 * 4];
+  const int n_begin = this->num_ * task / num_tasks;
+  const int n_end = this->num_ * (task + 1) / num_tasks;
+  for (int n = n_begin; n < n_end; ++n) {
+    const Dtype* image = input + n * this->bottom_dim_;
+    // Input transform: V = B^T d B for every channel and tile.
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* plane = image + c * height * width;
+      for (int th = 0; th < tiles_h_; ++th) {
+        for (int tw = 0; tw < tiles_w_; ++tw) {
+          const int h0 = th * tile_ - pad_h;
+          const int w0 = tw * tile_ - pad_w;
+          for (int i = 0; i < alpha_; ++i) {
+            const int h = h0 + i;
+            for (int j = 0; j < alpha_; ++j) {
+              const int w = w0 + j;
+              d[i * alpha_ + j] = (h >= 0 && h < height && w >= 0 &&
+                  w < width) ? plane[h * width + w] : Dtype(0);
+            }
+          }
+          winograd_sandwich(BT, alpha_, alpha_, d, v);
+          const int t = th * tiles_w_ + tw;
+          for (int xi = 0; xi < num_coeffs; ++xi) {
+            V[(xi * channels + c) * num_tiles + t] = v[xi];
+          }
+        }
+      }
+    }
+    // One GEMM per transform coefficient and group:
+    // M[xi] (num_output_g x tiles) = U[xi] (num_output_g x channels_g)
+    //                                * V[xi] (channels_g x tiles)
+    for (int xi = 0; xi < num_coeffs; ++xi) {
+      for (int g = 0; g < group; ++g) {
+        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_g,
+            num_tiles, channels_g, (Dtype)1.,
+            U + (xi * num_output + g * num_output_g) * channels_g,
+            V + (xi * channels + g * channels_g) * num_tiles,
+            (Dtype)0., M + (xi * num_output + g * num_output_g) * num_tiles);
+      }
+    }
+    // Output transform: y = A^T m A, cropped at the bottom/right border.
+    Dtype* top_image = output + n * this->top_dim_;
+    for (int oc = 0; oc < num_output; ++oc) {
+      Dtype* plane = top_image + oc * output_h * output_w;
+      const Dtype bias_value = bias ? bias[oc] : Dtype(0);
+      for (int th = 0; th < tiles_h_; ++th) {
+        for (int tw = 0; tw < tiles_w_; ++tw) {
+          const int t = th * tiles_w_ + tw;
+          for (int xi = 0; xi < num_coeffs; ++xi) {
+            d[xi] = M[(xi * num_output + oc) * num_tiles + t];
+          }
+          winograd_sandwich(AT, tile_, alpha_, d, y);
+          const int h_end = std::min(tile_, output_h - th * tile_);
+          const int w_end = std::min(tile_, output_w - tw * tile_);
+          for (int i = 0; i < h_end; ++i) {
+            Dtype* row = plane + (th * tile_ + i) * output_w + tw * tile_;
+            for (int j = 0; j < w_end; ++j) {
+              const Dtype value = y[i * tile_ + j] + bias_value;
+              row[j] = value > 0 ? value : value * negative_slope;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!use_winograd_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  const shared_ptr<SyncedMemory>& source = this->blobs_[0]->data();
+  {
+    // 只在权值被写过之后重新变换，例如训练中每次更新之后
+    TransformedWeights& cache = *transformed_weights_;
+    boost::mutex::scoped_lock lock(cache.mutex_);
+    const size_t generation = source->generation();
+    if (!cache.valid_ || cache.generation_ != generation) {
+      transform_weights(this->blobs_[0]->cpu_data(),
+          cache.filters_.mutable_cpu_data());
+      cache.generation_ = generation;
+      cache.valid_ = true;
+    }
+  }
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  const int num_tasks =
+      std::max(1, std::min(ThreadPool::global_threads(), this->num_));
+  const int num_coeffs = alpha_ * alpha_;
+  const int num_tiles = tiles_h_ * tiles_w_;
+  while (task_input_.size() < num_tasks) {
+    task_input_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    task_product_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  task_input_data_.resize(num_tasks);
+  task_product_data_.resize(num_tasks);
+  vector<int> input_shape(3);
+  input_shape[0] = num_coeffs;
+  input_shape[1] = this->channels_;
+  input_shape[2] = num_tiles;
+  vector<int> product_shape(input_shape);
+  product_shape[1] = this->num_output_;
+  for (int task = 0; task < num_tasks; ++task) {
+    task_input_[task]->Reshape(input_shape);
+    task_product_[task]->Reshape(product_shape);
+    task_input_data_[task] = task_input_[task]->mutable_cpu_data();
+    task_product_data_[task] = task_product_[task]->mutable_cpu_data();
+  }
+  this->conv_input_shape_.cpu_data();
+  for (int i = 0; i < bottom.size(); ++i) {
+    ThreadPool::Global().Run(num_tasks,
+        boost::bind(&WinogradConvolutionLayer<Dtype>::forward_cpu_task, this,
+            _1, num_tasks, bottom[i]->cpu_data(), bias,
+            top[i]->mutable_cpu_data()));
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
@@ -14,6 +14,7 @@
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
+#include "caffe/util/mapped_weights.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
@@ -253,10 +254,248 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  InitFlatParams(param);
   debug_info_ = param.debug_info();
+  InitActivationSharing(param);
+  ShareActivations();
+  if (share_activations_) {
+    size_t shared_memory = 0;
+    for (int i = 0; i < activation_buffers_.size(); ++i) {
+      shared_memory += activation_buffers_[i]->size();
+    }
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Intermediate blobs share " << activation_buffers_.size()
+        << " buffers of " << shared_memory << " bytes in total";
+  }
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
+// 返回 memory 中第一个 64 字节对齐的位置
+template <typename Dtype>
+static Dtype* AlignedFlatBuffer(SyncedMemory* memory) {
+  char* ptr = static_cast<char*>(memory->mutable_cpu_data());
+  const size_t misalignment = reinterpret_cast<size_t>(ptr) % 64;
+  return reinterpret_cast<Dtype*>(misalignment ? ptr + 64 - misalignment : ptr);
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitFlatParams(const NetParameter& param) {
+  flat_params_ = false;
+  flat_params_count_ = 0;
+  flat_param_offsets_.clear();
+  flat_data_.reset();
+  flat_diff_.reset();
+  LOG_IF(WARNING, param.flat_params() && phase_ != TRAIN &&
+      Caffe::root_solver())
+      << "flat_params only applies to the TRAIN phase; ignoring it.";
+  if (param.flat_params() && phase_ == TRAIN) {
+    PackFlatParams();
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::PackFlatParams() {
+  if (flat_params_) {
+    return;
+  }
+  flat_params_ = true;
+  // 每个参数的起始位置都按 64 字节对齐，中间的填充为 0
+  const int align = 64 / sizeof(Dtype);
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    flat_param_offsets_.push_back(flat_params_count_);
+    const int count = learnable_params_[i]->count();
+    flat_params_count_ += (count + align - 1) / align * align;
+  }
+  const size_t bytes = (flat_params_count_ + align) * sizeof(Dtype);
+  flat_data_.reset(new SyncedMemory(bytes));
+  flat_diff_.reset(new SyncedMemory(bytes));
+  Dtype* data = AlignedFlatBuffer<Dtype>(flat_data_.get());
+  Dtype* diff = AlignedFlatBuffer<Dtype>(flat_diff_.get());
+  // 与 NCCL 的 apply_buffers 相同：拷贝当前的值，再让 blob 指向平坦缓冲区。
+  // 共享权重的 blob 与其 owner 共用同一个 SyncedMemory，因此也一并迁移。
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    Blob<Dtype>* blob = learnable_params_[i];
+    const int offset = flat_param_offsets_[i];
+    caffe_copy(blob->count(), blob->cpu_data(), data + offset);
+    caffe_copy(blob->count(), blob->cpu_diff(), diff + offset);
+    blob->data()->set_cpu_data(data + offset);
+    blob->diff()->set_cpu_data(diff + offset);
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Learnable params packed into flat buffers of "
+      << flat_params_count_ << " elements";
+}
+
+template <typename Dtype>
+Dtype* Net<Dtype>::FlatBuffer(const bool diff, const bool for_write) {
+  CHECK(flat_params_) << "The learnable params are not packed; see "
+      << "NetParameter.flat_params.";
+  Dtype* buffer = AlignedFlatBuffer<Dtype>(
+      diff ? flat_diff_.get() : flat_data_.get());
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    Blob<Dtype>* blob = learnable_params_[i];
+    const Dtype* ptr;
+    if (for_write) {
+      ptr = diff ? blob->mutable_cpu_diff() : blob->mutable_cpu_data();
+    } else {
+      ptr = diff ? blob->cpu_diff() : blob->cpu_data();
+    }
+    CHECK(ptr == buffer + flat_param_offsets_[i])
+        << "Learnable param " << i << " no longer lives in the flat buffer.";
+  }
+  return buffer;
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitActivationSharing(const NetParameter& param) {
+  share_activations_ = param.share_activations() && phase_ == TEST;
+  LOG_IF(WARNING, param.share_activations() && phase_ != TEST &&
+      Caffe::root_solver())
+      << "share_activations only applies to the TEST phase; ignoring it.";
+  activation_group_.clear();
+  activation_begin_.clear();
+  activation_end_.clear();
+  activation_buffers_.clear();
+  if (!share_activations_) {
+    return;
+  }
+  // 需要保留独立内存的 blob: 网络的输入输出、用户指定的 blob、数据层的输出
+  // (数据层通过 set_cpu_data 直接替换 top 的内存)
+  vector<bool> keep(blobs_.size(), false);
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    keep[net_input_blob_indices_[i]] = true;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    keep[net_output_blob_indices_[i]] = true;
+  }
+  for (int i = 0; i < param.keep_blob_size(); ++i) {
+    CHECK(has_blob(param.keep_blob(i)))
+        << "Unknown keep_blob " << param.keep_blob(i);
+    keep[blob_names_index_[param.keep_blob(i)]] = true;
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if (bottom_vecs_[layer_id].empty()) {
+      for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+        keep[top_id_vecs_[layer_id][top_id]] = true;
+      }
+    }
+  }
+  // Blobs that already share one SyncedMemory (the tops of Split, Flatten,
+  // Reshape, ... layers) have to live in the same buffer: group them.
+  map<const SyncedMemory*, int> memory_group;
+  vector<bool> group_keep;
+  activation_group_.resize(blobs_.size(), -1);
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blobs_[blob_id]->count() == 0) {
+      continue;
+    }
+    const SyncedMemory* memory = blobs_[blob_id]->data().get();
+    if (memory_group.find(memory) == memory_group.end()) {
+      const int group = memory_group.size();
+      memory_group[memory] = group;
+      group_keep.push_back(false);
+      activation_begin_.push_back(layers_.size());
+      activation_end_.push_back(-1);
+    }
+    const int group = memory_group[memory];
+    activation_group_[blob_id] = group;
+    group_keep[group] = group_keep[group] || keep[blob_id];
+  }
+  // 每组 blob 从第一个产生它的层开始存活，到最后一个使用它的层为止
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+      const int group = activation_group_[top_id_vecs_[layer_id][top_id]];
+      if (group < 0) { continue; }
+      activation_begin_[group] = std::min(activation_begin_[group], layer_id);
+      activation_end_[group] = std::max(activation_end_[group], layer_id);
+    }
+    for (int bottom_id = 0; bottom_id < bottom_id_vecs_[layer_id].size();
+         ++bottom_id) {
+      const int group =
+          activation_group_[bottom_id_vecs_[layer_id][bottom_id]];
+      if (group < 0) { continue; }
+      activation_end_[group] = std::max(activation_end_[group], layer_id);
+    }
+  }
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const int group = activation_group_[blob_id];
+    if (group >= 0 && group_keep[group]) {
+      activation_group_[blob_id] = -1;
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ShareActivations() {
+  if (!share_activations_) {
+    return;
+  }
+  const int num_groups = activation_begin_.size();
+  vector<size_t> group_bytes(num_groups, 0);
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const int group = activation_group_[blob_id];
+    if (group >= 0) {
+      group_bytes[group] = std::max(group_bytes[group],
+          blobs_[blob_id]->count() * sizeof(Dtype));
+    }
+  }
+  // Visit the groups in the order they are produced. Each one takes the
+  // best fitting buffer whose previous user is dead by then, i.e. was last
+  // used by an earlier layer, or a new buffer if there is none.
+  vector<pair<int, int> > order;
+  for (int group = 0; group < num_groups; ++group) {
+    if (group_bytes[group] > 0) {
+      order.push_back(std::make_pair(activation_begin_[group], group));
+    }
+  }
+  std::sort(order.begin(), order.end());
+  vector<size_t> buffer_bytes;
+  vector<int> buffer_free_after;
+  vector<int> group_buffer(num_groups, -1);
+  for (int i = 0; i < order.size(); ++i) {
+    const int group = order[i].second;
+    const size_t bytes = group_bytes[group];
+    int best = -1;
+    for (int b = 0; b < buffer_bytes.size(); ++b) {
+      if (buffer_free_after[b] >= activation_begin_[group]) {
+        continue;
+      }
+      // 优先选择能装下的最小缓冲区，否则选择最大的缓冲区并扩大它
+      const bool fits = buffer_bytes[b] >= bytes;
+      if (best < 0 ||
+          (fits && (buffer_bytes[best] < bytes ||
+                    buffer_bytes[b] < buffer_bytes[best])) ||
+          (!fits && buffer_bytes[best] < bytes &&
+           buffer_bytes[b] > buffer_bytes[best])) {
+        best = b;
+      }
+    }
+    if (best < 0) {
+      best = buffer_bytes.size();
+      buffer_bytes.push_back(0);
+      buffer_free_after.push_back(-1);
+    }
+    buffer_bytes[best] = std::max(buffer_bytes[best], bytes);
+    buffer_free_after[best] = activation_end_[group];
+    group_buffer[group] = best;
+  }
+  // 已有的缓冲区足够大时直接复用，避免每次 Reshape 都重新分配
+  activation_buffers_.resize(buffer_bytes.size());
+  for (int b = 0; b < buffer_bytes.size(); ++b) {
+    if (!activation_buffers_[b] ||
+        activation_buffers_[b]->size() < buffer_bytes[b]) {
+      activation_buffers_[b].reset(new SyncedMemory(buffer_bytes[b]));
+    }
+  }
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const int group = activation_group_[blob_id];
+    if (group >= 0 && group_buffer[group] >= 0) {
+      blobs_[blob_id]->ShareDataBuffer(
+          activation_buffers_[group_buffer[group]]);
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::FilterNet(const NetParameter& param,
     NetParameter* param_filtered) {
@@ -518,12 +757,16 @@ template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  // 若网络有自己的执行上下文，则在其中运行
+  Caffe::ContextScope scope(context_.get());
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
     for (int c = 0; c < before_forward_.size(); ++c) {
       before_forward_[c]->run(i);
     }
+    const int64_t profile_start = profiler_ ? profiler_->Now() : 0;
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    if (profiler_) { ProfileLayer(i, false, profile_start); }
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
     for (int c = 0; c < after_forward_.size(); ++c) {
@@ -569,13 +812,16 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  Caffe::ContextScope scope(context_.get());
   for (int i = start; i >= end; --i) {
     for (int c = 0; c < before_backward_.size(); ++c) {
       before_backward_[c]->run(i);
     }
     if (layer_need_backward_[i]) {
+      const int64_t profile_start = profiler_ ? profiler_->Now() : 0;
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+      if (profiler_) { ProfileLayer(i, true, profile_start); }
       if (debug_info_) { BackwardDebugInfo(i); }
     }
     for (int c = 0; c < after_backward_.size(); ++c) {
@@ -584,6 +830,54 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
   }
 }
 
+// 读写字节数按 blob 大小估计：前向读 bottom 和参数、写 top；
+// 后向读 top 的数据和导数、bottom 和参数，写需要回传的 bottom 导数和参数导数
+template <typename Dtype>
+void Net<Dtype>::ProfileLayer(const int layer_id, const bool backward,
+    const int64_t start_us) {
+  const vector<Blob<Dtype>*>& bottom = bottom_vecs_[layer_id];
+  const vector<Blob<Dtype>*>& top = top_vecs_[layer_id];
+  const vector<shared_ptr<Blob<Dtype> > >& params = layers_[layer_id]->blobs();
+  size_t bytes_read = 0;
+  size_t bytes_written = 0;
+  size_t bytes_allocated = 0;
+  std::set<SyncedMemory*> top_memory;
+  for (int i = 0; i < bottom.size(); ++i) {
+    bytes_read += bottom[i]->count();
+    if (backward && bottom_need_backward_[layer_id][i]) {
+      bytes_written += bottom[i]->count();
+    }
+  }
+  for (int i = 0; i < top.size(); ++i) {
+    if (backward) {
+      bytes_read += 2 * top[i]->count();
+    } else {
+      bytes_written += top[i]->count();
+    }
+    // 共享或复用的内存只算一次，未分配的 (还未用过的 diff) 不算
+    if (top[i]->count() > 0) {
+      top_memory.insert(top[i]->data().get());
+      top_memory.insert(top[i]->diff().get());
+    }
+  }
+  for (std::set<SyncedMemory*>::const_iterator it = top_memory.begin();
+       it != top_memory.end(); ++it) {
+    if ((*it)->head() != SyncedMemory::UNINITIALIZED) {
+      bytes_allocated += (*it)->size();
+    }
+  }
+  for (int i = 0; i < params.size(); ++i) {
+    bytes_read += params[i]->count();
+    if (backward && layers_[layer_id]->param_propagate_down(i)) {
+      bytes_written += params[i]->count();
+    }
+  }
+  profiler_->Record(layer_names_[layer_id], layers_[layer_id]->type(),
+      backward ? "Backward" : "Forward", start_us,
+      bytes_read * sizeof(Dtype), bytes_written * sizeof(Dtype),
+      bytes_allocated);
+}
+
 template <typename Dtype>
 void Net<Dtype>::ForwardDebugInfo(const int layer_id) {
   for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
@@ -726,9 +1020,11 @@ void Net<Dtype>::Backward() {
 
 template <typename Dtype>
 void Net<Dtype>::Reshape() {
+  Caffe::ContextScope scope(context_.get());
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  ShareActivations();
 }
 
 template <typename Dtype>
@@ -774,6 +1070,8 @@ void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
   if (trained_filename.size() >= 3 &&
       trained_filename.compare(trained_filename.size() - 3, 3, ".h5") == 0) {
     CopyTrainedLayersFromHDF5(trained_filename);
+  } else if (IsMappedWeightsFile(trained_filename)) {
+    CopyTrainedLayersFromMapped(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
   }
@@ -837,6 +1135,78 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   H5Fclose(file_hid);
 }
 
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromMapped(const string trained_filename) {
+  shared_ptr<MappedWeights> weights(new MappedWeights(trained_filename));
+  const WeightsIndex& index = weights->index();
+  bool bound = false;
+  // 已从文件中载入的参数（按 owner 记录）
+  vector<bool> loaded(params_.size(), false);
+  for (int target_layer_id = 0; target_layer_id < layers_.size();
+       ++target_layer_id) {
+    const string& layer_name = layer_names_[target_layer_id];
+    const vector<int>* tensors = weights->layer_tensors(layer_name);
+    if (!tensors) {
+      continue;
+    }
+    DLOG(INFO) << "Mapping source layer " << layer_name;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[target_layer_id]->blobs();
+    CHECK_EQ(target_blobs.size(), tensors->size())
+        << "Incompatible number of blobs for layer " << layer_name;
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      const int i = (*tensors)[j];
+      const WeightsIndex::Tensor& tensor = index.tensor(i);
+      vector<int> shape(tensor.shape().dim().begin(),
+          tensor.shape().dim().end());
+      if (target_blobs[j]->shape() != shape) {
+        Blob<Dtype> source_blob(shape);
+        LOG(FATAL) << "Cannot copy param " << j << " weights from layer '"
+            << layer_name << "'; shape mismatch.  Source param shape is "
+            << source_blob.shape_string() << "; target param shape is "
+            << target_blobs[j]->shape_string() << ". "
+            << "To learn this layer's parameters from scratch rather than "
+            << "copying from a saved net, rename the layer.";
+      }
+      // 共享的权值与其 owner 使用同一块内存，owner 已载入时无需再载入；
+      // owner 所在的层不在文件中时，经由共享的 blob 载入（与 owner 为同一内存）
+      const int param_id = param_id_vecs_[target_layer_id][j];
+      const int owner_id = param_owners_[param_id] == -1 ?
+          param_id : param_owners_[param_id];
+      if (loaded[owner_id]) {
+        continue;
+      }
+      loaded[owner_id] = true;
+      const bool is_double = tensor.type() == WeightsIndex::DOUBLE;
+      const int count = target_blobs[j]->count();
+      if (is_double == (sizeof(Dtype) == sizeof(double)) && !flat_params_) {
+        // 直接指向映射的内存，页在第一次访问时才读入
+        target_blobs[j]->data()->set_cpu_data(
+            const_cast<void*>(weights->data(i)));
+        bound = true;
+      } else if (is_double) {
+        const double* source = static_cast<const double*>(weights->data(i));
+        std::copy(source, source + count,
+            target_blobs[j]->mutable_cpu_data());
+      } else {
+        const float* source = static_cast<const float*>(weights->data(i));
+        std::copy(source, source + count,
+            target_blobs[j]->mutable_cpu_data());
+      }
+    }
+  }
+  for (int i = 0; i < index.tensor_size(); ++i) {
+    const string& layer_name = index.tensor(i).layer();
+    if (!layer_names_index_.count(layer_name) &&
+        weights->layer_tensors(layer_name)->front() == i) {
+      LOG(INFO) << "Ignoring source layer " << layer_name;
+    }
+  }
+  if (bound) {
+    mapped_weights_.push_back(weights);
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
   param->Clear();
@@ -849,8 +1219,33 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::ToProto(const vector<shared_ptr<Blob<Dtype> > >& params,
+    NetParameter* param, bool write_diff) const {
+  CHECK_EQ(params_.size(), params.size());
+  param->Clear();
+  param->set_name(name_);
+  // 与 Layer::ToProto 相同，只是 blob 取自 params
+  for (int i = 0; i < layers_.size(); ++i) {
+    LayerParameter* layer_param = param->add_layer();
+    layer_param->CopyFrom(layers_[i]->layer_param());
+    layer_param->clear_blobs();
+    for (int j = 0; j < param_id_vecs_[i].size(); ++j) {
+      params[param_id_vecs_[i][j]]->ToProto(layer_param->add_blobs(),
+          write_diff);
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
+  ToHDF5(params_, filename, write_diff);
+}
+
+template <typename Dtype>
+void Net<Dtype>::ToHDF5(const vector<shared_ptr<Blob<Dtype> > >& params,
+    const string& filename, bool write_diff) const {
+  CHECK_EQ(params_.size(), params.size());
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -886,12 +1281,12 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
       if (param_owners_[net_param_id] == -1) {
         // Only save params that own themselves
         hdf5_save_nd_dataset<Dtype>(layer_data_hid, dataset_name.str(),
-            *params_[net_param_id]);
+            *params[net_param_id]);
       }
       if (write_diff) {
         // Write diffs regardless of weight-sharing
         hdf5_save_nd_dataset<Dtype>(layer_diff_hid, dataset_name.str(),
-            *params_[net_param_id], true);
+            *params[net_param_id], true);
       }
     }
     H5Gclose(layer_data_hid);
@@ -908,6 +1303,12 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::Update() {
+  if (flat_params_ && Caffe::mode() == Caffe::CPU) {
+    // 所有参数连续存放，一次 axpy 即可完成更新
+    caffe_axpy<Dtype>(flat_params_count_, Dtype(-1), cpu_flat_diff(),
+        mutable_cpu_flat_data());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     learnable_params_[i]->Update();
   }
@@ -915,6 +1316,10 @@ void Net<Dtype>::Update() {
 
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
+  if (flat_params_ && Caffe::mode() == Caffe::CPU) {
+    caffe_set(flat_params_count_, Dtype(0), mutable_cpu_flat_diff());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     Blob<Dtype>* blob = learnable_params_[i];
     switch (Caffe::mode()) {
@@ -1,8 +1,18 @@
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
 #ifdef USE_NCCL
-
 #include <cuda_runtime.h>
+#endif
 #include <glog/logging.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include <stdio.h>
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -10,9 +20,511 @@
 #include "caffe/caffe.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/sgd_solvers.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+// 把当前线程（以及之后由它创建的线程）绑定到第 index % (节点数) 个 NUMA 节点
+static void PinToNumaNode(const int index) {
+#ifdef __linux__
+  vector<vector<int> > nodes;
+  for (int node = 0; ; ++node) {
+    const string path = "/sys/devices/system/node/node" +
+        boost::lexical_cast<string>(node) + "/cpulist";
+    std::ifstream file(path.c_str());
+    if (!file) { break; }
+    // 格式形如 "0-3,8-11"
+    string list;
+    std::getline(file, list);
+    boost::trim(list);
+    vector<string> ranges;
+    boost::split(ranges, list, boost::is_any_of(","));
+    vector<int> cpus;
+    for (int i = 0; i < ranges.size(); ++i) {
+      if (ranges[i].empty()) { continue; }
+      const size_t dash = ranges[i].find('-');
+      const int first = boost::lexical_cast<int>(ranges[i].substr(0, dash));
+      const int last = dash == string::npos ? first :
+          boost::lexical_cast<int>(ranges[i].substr(dash + 1));
+      for (int cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    }
+    if (!cpus.empty()) {  // 只有内存没有 CPU 的节点
+      nodes.push_back(cpus);
+    }
+  }
+  if (nodes.empty()) {
+    LOG(WARNING) << "No NUMA nodes found; solver " << index
+        << " is not pinned.";
+    return;
+  }
+  const int node = index % nodes.size();
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int i = 0; i < nodes[node].size(); ++i) {
+    CPU_SET(nodes[node][i], &set);
+  }
+  CHECK_EQ(0, pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+      << "Failed to pin solver " << index << " to NUMA node " << node;
+  LOG(INFO) << "Solver " << index << " pinned to NUMA node " << node;
+#else
+  LOG(WARNING) << "Pinning solvers to NUMA nodes requires Linux.";
+#endif
+}
+
+// 梯度按 bucket 归约，每个 bucket 的元素数 (float 时为 1 MB)
+static const int kBucketSize = 1 << 18;
+
+// 反向传播到第 l 层之后，平坦梯度中 (*offsets)[l] 及其后的部分都已算完
+// (共享参数的 owner 是第一个使用它的层)
+template<typename Dtype>
+static void LayerReadyOffsets(const Net<Dtype>& net, vector<int>* offsets) {
+  const vector<Blob<Dtype>*>& params = net.learnable_params();
+  std::map<const Blob<Dtype>*, int> param_index;
+  for (int i = 0; i < params.size(); ++i) {
+    param_index[params[i]] = i;
+  }
+  offsets->resize(net.layers().size());
+  int ready = net.flat_params_count();
+  for (int l = net.layers().size() - 1; l >= 0; --l) {
+    const vector<shared_ptr<Blob<Dtype> > >& blobs = net.layers()[l]->blobs();
+    for (int i = 0; i < blobs.size(); ++i) {
+      typename std::map<const Blob<Dtype>*, int>::const_iterator it =
+          param_index.find(blobs[i].get());
+      if (it != param_index.end()) {
+        ready = std::min(ready, net.flat_param_offsets()[it->second]);
+      }
+    }
+    (*offsets)[l] = ready;
+  }
+}
+
+// 所有副本共享的状态
+template<typename Dtype>
+class CPUParallel<Dtype>::sync {
+ public:
+  explicit sync(int solver_count)
+      : barrier_(solver_count), data_(solver_count), diff_(solver_count),
+        count_(0), bucket_size_(kBucketSize), iteration_(solver_count, 0),
+        ready_(solver_count, 0), done_(solver_count, 0) {
+  }
+
+  inline int solver_count() const { return data_.size(); }
+  inline int buckets() const {
+    return (count_ + bucket_size_ - 1) / bucket_size_;
+  }
+  // bucket 中第 part 个切片的范围，切片起点按 64 字节对齐
+  void Slice(const int bucket, const int part, int* begin, int* end) const {
+    const int bucket_begin = bucket * bucket_size_;
+    const int bucket_end = std::min(bucket_begin + bucket_size_, count_);
+    const int align = 64 / sizeof(Dtype);
+    const int per_part = ((bucket_end - bucket_begin + solver_count() - 1) /
+        solver_count() + align - 1) / align * align;
+    *begin = std::min(bucket_begin + part * per_part, bucket_end);
+    *end = std::min(*begin + per_part, bucket_end);
+  }
+
+  boost::mutex mutex_;
+  boost::condition_variable cond_;
+  boost::barrier barrier_;
+  vector<Dtype*> data_;     // 每个副本的平坦参数
+  vector<Dtype*> diff_;     // 每个副本的平坦梯度
+  int count_;               // 平坦缓冲区的长度
+  int bucket_size_;
+  // 以下由 mutex_ 保护
+  vector<int> iteration_;   // 每个副本已开始的迭代数
+  vector<int> ready_;       // 每个副本从该位置到末尾的梯度已经算完
+  vector<int> reduced_;     // 每个 bucket 累计完成 reduce-scatter 的切片数
+  vector<int> done_;        // 每个副本的 reducer 已完成的迭代数
+};
+
+template<typename Dtype>
+class CPUParallel<Dtype>::Reducer : public InternalThread {
+ public:
+  explicit Reducer(CPUParallel<Dtype>* parallel) : parallel_(parallel) {}
+  virtual ~Reducer() { StopInternalThread(); }
+
+ protected:
+  virtual void InternalThreadEntry() {
+    for (int iteration = 1; !must_stop(); ++iteration) {
+      parallel_->Reduce(iteration);
+    }
+  }
+
+  CPUParallel<Dtype>* parallel_;
+};
+
+template<typename Dtype>
+CPUParallel<Dtype>::CPUParallel(shared_ptr<Solver<Dtype> > root_solver)
+  : solver_(root_solver), rank_(0), iterations_(0), backward_passes_(0) {
+}
+
+template<typename Dtype>
+CPUParallel<Dtype>::CPUParallel(shared_ptr<Solver<Dtype> > solver,
+    shared_ptr<sync> shared)
+  : solver_(solver), sync_(shared), rank_(0), iterations_(0),
+    backward_passes_(0) {
+}
+
+template<typename Dtype>
+CPUParallel<Dtype>::~CPUParallel() {
+  // reducer_ 使用 this，必须先停止
+  if (reducer_) {
+    reducer_->StopInternalThread();
+  }
+}
+
+template<typename Dtype>
+void CPUParallel<Dtype>::Init() {
+  CHECK_EQ(Caffe::mode(), Caffe::CPU) << "CPUParallel only runs in CPU mode.";
+  rank_ = Caffe::solver_rank();
+  Net<Dtype>& net = *solver_->net();
+  net.PackFlatParams();
+  CHECK_EQ(net.flat_params_count(), sync_->count_)
+      << "All solvers must train the same net.";
+  LayerReadyOffsets(net, &layer_ready_offset_);
+  sync_->data_[rank_] = net.mutable_cpu_flat_data();
+  sync_->diff_[rank_] = net.mutable_cpu_flat_diff();
+  solver_->add_callback(this);
+  if (solver_->param().layer_wise_reduce()) {
+    net.add_after_backward(this);
+  }
+  reducer_.reset(new Reducer(this));
+  reducer_->StartInternalThread();
+}
+
+template<typename Dtype>
+void CPUParallel<Dtype>::Broadcast() {
+  sync_->barrier_.wait();
+  if (rank_ != 0) {
+    // 经由 mutable_cpu_flat_data 写入，使权值的 generation 随之改变
+    caffe_copy(sync_->count_, sync_->data_[0],
+        solver_->net()->mutable_cpu_flat_data());
+  }
+  sync_->barrier_.wait();
+}
+
+template<typename Dtype>
+void CPUParallel<Dtype>::on_start() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  sync_->iteration_[rank_] = ++iterations_;
+  sync_->ready_[rank_] = sync_->count_;
+  backward_passes_ = 0;
+  sync_->cond_.notify_all();
+}
+
+template<typename Dtype>
+void CPUParallel<Dtype>::run(int layer) {
+  // 梯度在 iter_size 次反向传播中累加，只有最后一次之后才能开始归约
+  if (backward_passes_ == solver_->param().iter_size() - 1 &&
+      layer_ready_offset_[layer] < sync_->ready_[rank_]) {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->ready_[rank_] = layer_ready_offset_[layer];
+    sync_->cond_.notify_all();
+  }
+  if (layer == 0) {
+    ++backward_passes_;
+  }
+}
+
+template<typename Dtype>
+void CPUParallel<Dtype>::on_gradients_ready() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->ready_[rank_] = 0;
+    sync_->cond_.notify_all();
+    while (sync_->done_[rank_] < iterations_) {
+      sync_->cond_.wait(lock);
+    }
+  }
+  // 其它副本读完本副本的切片之后，才能清零梯度开始下一次迭代
+  sync_->barrier_.wait();
+}
+
+template<typename Dtype>
+void CPUParallel<Dtype>::Reduce(const int iteration) {
+  sync& s = *sync_;
+  const int solvers = s.solver_count();
+  const int buckets = s.buckets();
+  boost::unique_lock<boost::mutex> lock(s.mutex_);
+  while (s.iteration_[rank_] < iteration) {
+    s.cond_.wait(lock);
+  }
+  // 从最后一个 bucket 开始，它们最先在反向传播中算完
+  int gathered = buckets;
+  for (int b = buckets - 1; b >= 0; --b) {
+    const int bucket_begin = b * s.bucket_size_;
+    for (int i = 0; i < solvers; ++i) {
+      while (s.iteration_[i] != iteration || s.ready_[i] > bucket_begin) {
+        s.cond_.wait(lock);
+      }
+    }
+    lock.unlock();
+    // reduce-scatter: 本副本负责的切片对所有副本求平均
+    int begin, end;
+    s.Slice(b, rank_, &begin, &end);
+    if (end > begin) {
+      for (int i = 0; i < solvers; ++i) {
+        if (i != rank_) {
+          caffe_axpy(end - begin, Dtype(1), s.diff_[i] + begin,
+              s.diff_[rank_] + begin);
+        }
+      }
+      caffe_scal(end - begin, Dtype(1) / solvers, s.diff_[rank_] + begin);
+    }
+    lock.lock();
+    ++s.reduced_[b];
+    s.cond_.notify_all();
+    // all-gather: 取回已经全部归约完的 bucket 中其它副本的切片，
+    // 最后一个 bucket 之后等待剩下的
+    while (gathered > 0 && (b == 0 ||
+        s.reduced_[gathered - 1] == iteration * solvers)) {
+      while (s.reduced_[gathered - 1] < iteration * solvers) {
+        s.cond_.wait(lock);
+      }
+      --gathered;
+      lock.unlock();
+      for (int i = 0; i < solvers; ++i) {
+        s.Slice(gathered, i, &begin, &end);
+        if (i != rank_ && end > begin) {
+          caffe_copy(end - begin, s.diff_[i] + begin, s.diff_[rank_] + begin);
+        }
+      }
+      lock.lock();
+    }
+  }
+  s.done_[rank_] = iteration;
+  s.cond_.notify_all();
+}
+
+template<typename Dtype>
+class CPUParallelWorker : public InternalThread {
+ public:
+  CPUParallelWorker(shared_ptr<Solver<Dtype> > rank0,
+      shared_ptr<typename CPUParallel<Dtype>::sync> shared, bool pin_numa,
+      const char* restore)
+    : rank0_(rank0), sync_(shared), pin_numa_(pin_numa), restore_(restore) {
+  }
+  virtual ~CPUParallelWorker() {}
+
+ protected:
+  void InternalThreadEntry() {
+    // 先绑定线程，solver 的内存和数据预取线程都会留在这个节点上
+    if (pin_numa_) {
+      PinToNumaNode(Caffe::solver_rank());
+    }
+    SolverParameter param(rank0_->param());
+    param.set_type(rank0_->type());
+    shared_ptr<Solver<Dtype> > s(SolverRegistry<Dtype>::CreateSolver(param));
+    CHECK_EQ(s->type(), rank0_->type());
+    if (restore_) {
+      s->Restore(restore_);
+    }
+    CPUParallel<Dtype> parallel(s, sync_);
+    parallel.Init();
+    parallel.Broadcast();
+    s->Step(param.max_iter() - s->iter());
+    // 等待 rank 0 完成 Solve (最后的测试和快照)
+    sync_->barrier_.wait();
+  }
+
+  shared_ptr<Solver<Dtype> > rank0_;
+  shared_ptr<typename CPUParallel<Dtype>::sync> sync_;
+  bool pin_numa_;
+  const char* restore_;
+};
+
+template<typename Dtype>
+void CPUParallel<Dtype>::Run(bool pin_numa, const char* restore) {
+  const int solver_count = Caffe::solver_count();
+  sync_.reset(new sync(solver_count));
+  solver_->net()->PackFlatParams();
+  sync_->count_ = solver_->net()->flat_params_count();
+  sync_->reduced_.resize(sync_->buckets(), 0);
+  LOG(INFO) << "Training " << solver_count << " solvers on CPU threads, "
+      << "reducing " << sync_->buckets() << " gradient buckets";
+  if (pin_numa) {
+    PinToNumaNode(0);
+  }
+  vector<shared_ptr<CPUParallelWorker<Dtype> > > workers(solver_count);
+  for (int i = 1; i < solver_count; ++i) {
+    Caffe::set_solver_rank(i);
+    workers[i].reset(new CPUParallelWorker<Dtype>(solver_, sync_, pin_numa,
+        restore));
+    workers[i]->StartInternalThread();
+  }
+  Caffe::set_solver_rank(0);
+  Init();
+  Broadcast();
+  solver_->Solve();
+  sync_->barrier_.wait();
+  for (int i = 1; i < solver_count; ++i) {
+    workers[i]->StopInternalThread();
+  }
+  reducer_->StopInternalThread();
+}
+
+INSTANTIATE_CLASS(CPUParallel);
+INSTANTIATE_CLASS(CPUParallelWorker);
+
+template<typename Dtype>
+class TransportParallel<Dtype>::sync {
+ public:
+  sync() : iteration_(0), ready_(0), done_(0), communication_ms_(0) {}
+
+  boost::mutex mutex_;
+  boost::condition_variable cond_;
+  // 以下由 mutex_ 保护
+  int iteration_;           // 已开始的迭代数
+  int ready_;               // 从该位置到末尾的梯度已经算完
+  int done_;                // 通信线程已完成的迭代数
+  float communication_ms_;  // 最近一次迭代 all-reduce 的耗时
+};
+
+template<typename Dtype>
+class TransportParallel<Dtype>::Communicator : public InternalThread {
+ public:
+  explicit Communicator(TransportParallel<Dtype>* parallel)
+    : parallel_(parallel) {}
+  virtual ~Communicator() { StopInternalThread(); }
+
+ protected:
+  virtual void InternalThreadEntry() {
+    for (int iteration = 1; !must_stop(); ++iteration) {
+      parallel_->Communicate(iteration);
+    }
+  }
+
+  TransportParallel<Dtype>* parallel_;
+};
+
+template<typename Dtype>
+TransportParallel<Dtype>::TransportParallel(shared_ptr<Solver<Dtype> > solver,
+    shared_ptr<Transport> transport, const string& algorithm)
+  : solver_(solver), transport_(transport), sync_(new sync()), diff_(NULL),
+    count_(0), iterations_(0), backward_passes_(0) {
+  CHECK_EQ(transport->rank(), Caffe::solver_rank());
+  CHECK_EQ(transport->size(), Caffe::solver_count());
+  if (algorithm == "ring") {
+    all_reduce_ = &RingAllReduce<Dtype>;
+  } else if (algorithm == "tree") {
+    all_reduce_ = &TreeAllReduce<Dtype>;
+  } else {
+    LOG(FATAL) << "Unknown all-reduce algorithm: " << algorithm;
+  }
+}
+
+template<typename Dtype>
+TransportParallel<Dtype>::~TransportParallel() {
+  // communicator_ 使用 this，必须先停止
+  if (communicator_) {
+    communicator_->StopInternalThread();
+  }
+}
+
+template<typename Dtype>
+void TransportParallel<Dtype>::Run() {
+  CHECK_EQ(Caffe::mode(), Caffe::CPU)
+      << "TransportParallel only runs in CPU mode.";
+  Net<Dtype>& net = *solver_->net();
+  net.PackFlatParams();
+  count_ = net.flat_params_count();
+  diff_ = net.mutable_cpu_flat_diff();
+  LayerReadyOffsets(net, &layer_ready_offset_);
+  LOG_IF(INFO, Caffe::root_solver()) << "Training on " << transport_->size()
+      << " ranks, reducing " << (count_ + kBucketSize - 1) / kBucketSize
+      << " gradient buckets";
+  // 通信线程启动之前 transport 只由当前线程使用
+  TreeBroadcast(transport_.get(), net.mutable_cpu_flat_data(), count_);
+  solver_->add_callback(this);
+  if (solver_->param().layer_wise_reduce()) {
+    net.add_after_backward(this);
+  }
+  communicator_.reset(new Communicator(this));
+  communicator_->StartInternalThread();
+  if (Caffe::root_solver()) {
+    solver_->Solve();
+  } else {
+    solver_->Step(solver_->param().max_iter() - solver_->iter());
+  }
+  communicator_->StopInternalThread();
+}
+
+template<typename Dtype>
+void TransportParallel<Dtype>::on_start() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  sync_->iteration_ = ++iterations_;
+  sync_->ready_ = count_;
+  backward_passes_ = 0;
+  sync_->cond_.notify_all();
+}
+
+template<typename Dtype>
+void TransportParallel<Dtype>::run(int layer) {
+  // 梯度在 iter_size 次反向传播中累加，只有最后一次之后才能开始通信
+  if (backward_passes_ == solver_->param().iter_size() - 1 &&
+      layer_ready_offset_[layer] < sync_->ready_) {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->ready_ = layer_ready_offset_[layer];
+    sync_->cond_.notify_all();
+  }
+  if (layer == 0) {
+    ++backward_passes_;
+  }
+}
+
+template<typename Dtype>
+void TransportParallel<Dtype>::on_gradients_ready() {
+  CPUTimer timer;
+  timer.Start();
+  float communication_ms;
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->ready_ = 0;
+    sync_->cond_.notify_all();
+    while (sync_->done_ < iterations_) {
+      sync_->cond_.wait(lock);
+    }
+    communication_ms = sync_->communication_ms_;
+  }
+  // 等待的时间即没有被反向传播掩盖的通信时间
+  solver_->add_communication_time(communication_ms,
+      timer.MicroSeconds() / 1000);
+}
+
+template<typename Dtype>
+void TransportParallel<Dtype>::Communicate(const int iteration) {
+  sync& s = *sync_;
+  boost::unique_lock<boost::mutex> lock(s.mutex_);
+  while (s.iteration_ < iteration) {
+    s.cond_.wait(lock);
+  }
+  CPUTimer timer;
+  float communication_ms = 0;
+  // 从最后一个 bucket 开始，它们最先在反向传播中算完
+  for (int b = (count_ + kBucketSize - 1) / kBucketSize - 1; b >= 0; --b) {
+    const int begin = b * kBucketSize;
+    const int end = std::min(begin + kBucketSize, count_);
+    while (s.ready_ > begin) {
+      s.cond_.wait(lock);
+    }
+    lock.unlock();
+    timer.Start();
+    all_reduce_(transport_.get(), diff_ + begin, end - begin);
+    caffe_scal(end - begin, Dtype(1) / transport_->size(), diff_ + begin);
+    communication_ms += timer.MicroSeconds() / 1000;
+    lock.lock();
+  }
+  s.communication_ms_ = communication_ms;
+  s.done_ = iteration;
+  s.cond_.notify_all();
+}
+
+INSTANTIATE_CLASS(TransportParallel);
+
+#ifdef USE_NCCL
+
 enum Op {
   copy,
   replace_cpu,
@@ -366,6 +878,6 @@ INSTANTIATE_CLASS(GPUParams);
 INSTANTIATE_CLASS(Worker);
 INSTANTIATE_CLASS(NCCL);
 
-}  // namespace caffe
-
 #endif  // USE_NCCL
+
+}  // namespace caffe
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/shape_buckets.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+ShapeBuckets<Dtype>::ShapeBuckets(const NetParameter& param,
+    shared_ptr<Net<Dtype> > net, const vector<vector<int> >& shapes)
+    : shapes_(shapes) {
+  CHECK_GT(shapes.size(), 0) << "Need at least one shape bucket.";
+  CHECK_EQ(net->input_blobs().size(), 1)
+      << "Shape buckets need a net with one input blob.";
+  replicas_.reset(new InferenceReplicas<Dtype>(param, net, shapes.size()));
+  for (int i = 0; i < shapes_.size(); ++i) {
+    Net<Dtype>* bucket_net = replicas_->replica(i).get();
+    CHECK_EQ(shapes_[i].size(), bucket_net->input_blobs()[0]->num_axes())
+        << "Shape bucket " << i << " has the wrong number of axes.";
+    bucket_net->input_blobs()[0]->Reshape(shapes_[i]);
+    bucket_net->Reshape();
+    LOG(INFO) << "Shape bucket " << i << ": "
+        << bucket_net->input_blobs()[0]->shape_string();
+  }
+  // 各 bucket 的形状确定之后才知道 Winograd 的块大小，所以在这里统计
+  LOG(INFO) << shapes_.size() << " shape buckets share "
+      << weights_bytes() / 1048576.0 << " MB of weights.";
+}
+
+template <typename Dtype>
+int ShapeBuckets<Dtype>::Find(const vector<int>& shape) const {
+  int best = -1;
+  int64_t best_count = 0;
+  for (int i = 0; i < shapes_.size(); ++i) {
+    if (shapes_[i].size() != shape.size()) {
+      continue;
+    }
+    bool fits = true;
+    int64_t count = 1;
+    for (int j = 0; j < shape.size(); ++j) {
+      fits = fits && shape[j] <= shapes_[i][j];
+      count *= shapes_[i][j];
+    }
+    if (fits && (best < 0 || count < best_count)) {
+      best = i;
+      best_count = count;
+    }
+  }
+  return best;
+}
+
+template <typename Dtype>
+int ShapeBuckets<Dtype>::Prepare(const Dtype* data, const vector<int>& shape) {
+  const int bucket = Find(shape);
+  CHECK_GE(bucket, 0) << "No shape bucket fits the input.";
+  const vector<int>& padded = shapes_[bucket];
+  Blob<Dtype>* input = net(bucket)->input_blobs()[0];
+  Dtype* input_data = input->mutable_cpu_data();
+  const int axes = shape.size();
+  if (shape == padded) {
+    std::copy(data, data + input->count(), input_data);
+    return bucket;
+  }
+  // 逐行（最后一维）拷贝，多出的部分补 0
+  std::fill(input_data, input_data + input->count(), Dtype(0));
+  const int row = shape[axes - 1];
+  int rows = 1;
+  for (int j = 0; j < axes - 1; ++j) {
+    rows *= shape[j];
+  }
+  vector<int> index(axes - 1, 0);
+  for (int r = 0; r < rows; ++r) {
+    int offset = 0;
+    for (int j = 0; j < axes - 1; ++j) {
+      offset = offset * padded[j] + index[j];
+    }
+    offset *= padded[axes - 1];
+    std::copy(data + r * row, data + (r + 1) * row, input_data + offset);
+    for (int j = axes - 2; j >= 0 && ++index[j] == shape[j]; --j) {
+      index[j] = 0;
+    }
+  }
+  return bucket;
+}
+
+INSTANTIATE_CLASS(ShapeBuckets);
+
+}  // namespace caffe
@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <cstdio>
 
 #include <string>
@@ -7,10 +9,28 @@
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
 
+// 后台写快照的线程，以及暂存的参数副本
+template <typename Dtype>
+class Solver<Dtype>::AsyncSnapshot {
+ public:
+  ~AsyncSnapshot() { Wait(); }
+
+  void Wait() {
+    if (thread_) {
+      thread_->join();
+      thread_.reset();
+    }
+  }
+
+  vector<shared_ptr<Blob<Dtype> > > params_;  // net_->params() 的副本
+  shared_ptr<boost::thread> thread_;
+};
+
 template<typename Dtype>
 void Solver<Dtype>::SetActionFunction(ActionCallback func) {
   action_request_function_ = func;
@@ -27,13 +47,15 @@ SolverAction::Enum Solver<Dtype>::GetRequestedAction() {
 
 template <typename Dtype>
 Solver<Dtype>::Solver(const SolverParameter& param)
-    : net_(), callbacks_(), requested_early_exit_(false) {
+    : net_(), callbacks_(), requested_early_exit_(false),
+      communication_ms_(0), communication_blocked_ms_(0) {
   Init(param);
 }
 
 template <typename Dtype>
 Solver<Dtype>::Solver(const string& param_file)
-    : net_(), callbacks_(), requested_early_exit_(false) {
+    : net_(), callbacks_(), requested_early_exit_(false),
+      communication_ms_(0), communication_blocked_ms_(0) {
   SolverParameter param;
   ReadSolverParamsFromTextFileOrDie(param_file, &param);
   Init(param);
@@ -216,9 +238,20 @@ void Solver<Dtype>::Step(int iters) {
     if (display) {
       float lapse = iteration_timer_.Seconds();
       float per_s = (iter_ - iterations_last_) / (lapse ? lapse : 1);
+      ostringstream communication;
+      if (communication_ms_ > 0) {
+        const float elapsed_iters = iter_ - iterations_last_;
+        communication << ", communication "
+            << communication_ms_ / elapsed_iters << " ms/iter, waited "
+            << communication_blocked_ms_ / elapsed_iters
+            << " ms/iter";
+        communication_ms_ = 0;
+        communication_blocked_ms_ = 0;
+      }
       LOG_IF(INFO, Caffe::root_solver()) << "Iteration " << iter_
           << " (" << per_s << " iter/s, " << lapse << "s/"
-          << param_.display() << " iters), loss = " << smoothed_loss_;
+          << param_.display() << " iters" << communication.str()
+          << "), loss = " << smoothed_loss_;
       iteration_timer_.Start();
       iterations_last_ = iter_;
       const vector<Blob<Dtype>*>& result = net_->output_blobs();
@@ -291,6 +324,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
       && (!param_.snapshot() || iter_ % param_.snapshot() != 0)) {
     Snapshot();
   }
+  WaitForSnapshot();
   if (requested_early_exit_) {
     LOG(INFO) << "Optimization stopped early.";
     return;
@@ -403,6 +437,10 @@ void Solver<Dtype>::Test(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  if (param_.snapshot_async()) {
+    SnapshotAsync();
+    return;
+  }
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -418,6 +456,91 @@ void Solver<Dtype>::Snapshot() {
   SnapshotSolverState(model_filename);
 }
 
+template <typename Dtype>
+void Solver<Dtype>::WaitForSnapshot() {
+  if (async_snapshot_) {
+    async_snapshot_->Wait();
+  }
+}
+
+template <typename Dtype>
+boost::function<void(const string&)> Solver<Dtype>::StageSolverState() {
+  LOG(FATAL) << type() << " solvers do not support snapshot_async.";
+  return boost::function<void(const string&)>();
+}
+
+template <typename Dtype>
+void Solver<Dtype>::StageBlob(const Blob<Dtype>& blob, bool copy_diff,
+    Blob<Dtype>* staged) {
+  staged->ReshapeLike(blob);
+  caffe_copy(blob.count(), blob.cpu_data(), staged->mutable_cpu_data());
+  if (copy_diff) {
+    caffe_copy(blob.count(), blob.cpu_diff(), staged->mutable_cpu_diff());
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::SnapshotAsync() {
+  CPUTimer timer;
+  timer.Start();
+  if (!async_snapshot_) {
+    async_snapshot_.reset(new AsyncSnapshot());
+  }
+  // 同一时间至多一个快照在写
+  async_snapshot_->Wait();
+  const float wait_ms = timer.MicroSeconds() / 1000;
+  timer.Start();
+  const vector<shared_ptr<Blob<Dtype> > >& params = net_->params();
+  vector<shared_ptr<Blob<Dtype> > >& staged = async_snapshot_->params_;
+  staged.resize(params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    if (!staged[i]) {
+      staged[i].reset(new Blob<Dtype>());
+    }
+    StageBlob(*params[i], param_.snapshot_diff(), staged[i].get());
+  }
+  boost::function<void(const string&)> write_state = StageSolverState();
+  const string model_filename = SnapshotFilename(
+      param_.snapshot_format() == caffe::SolverParameter_SnapshotFormat_HDF5 ?
+      ".caffemodel.h5" : ".caffemodel");
+  LOG(INFO) << "Snapshot of iteration " << iter_ << " staged in "
+      << timer.MicroSeconds() / 1000 << " ms (waited " << wait_ms
+      << " ms for the previous snapshot)";
+  async_snapshot_->thread_.reset(new boost::thread(
+      &Solver<Dtype>::WriteStagedSnapshot, this, iter_, model_filename,
+      write_state));
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WriteStagedSnapshot(const int iter,
+    const string& model_filename,
+    const boost::function<void(const string&)>& write_state) {
+  CPUTimer timer;
+  timer.Start();
+  // 先写临时文件，同步后再改名，读者不会看到写了一半的快照
+  const string temp_filename = model_filename + ".tmp";
+  const vector<shared_ptr<Blob<Dtype> > >& staged = async_snapshot_->params_;
+  switch (param_.snapshot_format()) {
+  case caffe::SolverParameter_SnapshotFormat_BINARYPROTO: {
+    LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
+    NetParameter net_param;
+    net_->ToProto(staged, &net_param, param_.snapshot_diff());
+    WriteProtoToBinaryFile(net_param, temp_filename);
+    break;
+  }
+  case caffe::SolverParameter_SnapshotFormat_HDF5:
+    LOG(INFO) << "Snapshotting to HDF5 file " << model_filename;
+    net_->ToHDF5(staged, temp_filename, param_.snapshot_diff());
+    break;
+  default:
+    LOG(FATAL) << "Unsupported snapshot format.";
+  }
+  CommitFile(temp_filename, model_filename);
+  write_state(model_filename);
+  LOG(INFO) << "Snapshot of iteration " << iter << " written in "
+      << timer.MicroSeconds() / 1000 << " ms";
+}
+
 template <typename Dtype>
 void Solver<Dtype>::CheckSnapshotWritePermissions() {
   if (Caffe::root_solver() && param_.snapshot()) {
@@ -462,6 +585,7 @@ string Solver<Dtype>::SnapshotToHDF5() {
 
 template <typename Dtype>
 void Solver<Dtype>::Restore(const char* state_file) {
+  WaitForSnapshot();
   string state_filename(state_file);
   if (state_filename.size() >= 3 &&
       state_filename.compare(state_filename.size() - 3, 3, ".h5") == 0) {
@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -106,6 +108,34 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype> CAFFE_SIMD_CLONES
+static void adadelta_update_cpu(const int begin, const int end,
+    const SolverUpdateArgs<Dtype>* args) {
+  const SolverUpdateArgs<Dtype> a = *args;
+  for (int i = begin; i < end; ++i) {
+    const Dtype g = a.gradient(i);
+    // history of gradients, then of updates
+    const Dtype h = a.momentum * a.history[i] + (1 - a.momentum) * g * g;
+    const Dtype u = g * std::sqrt((a.history2[i] + a.delta) / (h + a.delta));
+    a.history[i] = h;
+    a.history2[i] = a.momentum * a.history2[i] + (1 - a.momentum) * u * u;
+    a.diff[i] = a.rate * u;
+    a.data[i] -= a.rate * u;
+  }
+}
+
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::FusedUpdate(int param_id, Dtype rate,
+    Dtype diff_scale) {
+  const int update_history_offset = this->net_->learnable_params().size();
+  SolverUpdateArgs<Dtype> args =
+      this->GetUpdateArgs(param_id, rate, diff_scale);
+  args.history2 =
+      this->history_[update_history_offset + param_id]->mutable_cpu_data();
+  caffe_cpu_parallel_for(this->net_->learnable_params()[param_id]->count(),
+      boost::bind(&adadelta_update_cpu<Dtype>, _1, _2, &args));
+}
+
 INSTANTIATE_CLASS(AdaDeltaSolver);
 REGISTER_SOLVER_CLASS(AdaDelta);
 
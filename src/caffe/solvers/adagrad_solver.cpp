@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -63,6 +65,29 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype> CAFFE_SIMD_CLONES
+static void adagrad_update_cpu(const int begin, const int end,
+    const SolverUpdateArgs<Dtype>* args) {
+  const SolverUpdateArgs<Dtype> a = *args;
+  for (int i = begin; i < end; ++i) {
+    const Dtype g = a.gradient(i);
+    const Dtype h = a.history[i] + g * g;
+    a.history[i] = h;
+    const Dtype u = a.rate * g / (std::sqrt(h) + a.delta);
+    a.diff[i] = u;
+    a.data[i] -= u;
+  }
+}
+
+template <typename Dtype>
+void AdaGradSolver<Dtype>::FusedUpdate(int param_id, Dtype rate,
+    Dtype diff_scale) {
+  const SolverUpdateArgs<Dtype> args =
+      this->GetUpdateArgs(param_id, rate, diff_scale);
+  caffe_cpu_parallel_for(this->net_->learnable_params()[param_id]->count(),
+      boost::bind(&adagrad_update_cpu<Dtype>, _1, _2, &args));
+}
+
 INSTANTIATE_CLASS(AdaGradSolver);
 REGISTER_SOLVER_CLASS(AdaGrad);
 
@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -88,6 +90,38 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype> CAFFE_SIMD_CLONES
+static void adam_update_cpu(const int begin, const int end,
+    const SolverUpdateArgs<Dtype>* args) {
+  const SolverUpdateArgs<Dtype> a = *args;
+  for (int i = begin; i < end; ++i) {
+    const Dtype g = a.gradient(i);
+    const Dtype m = a.momentum * a.history[i] + (1 - a.momentum) * g;
+    const Dtype v = a.momentum2 * a.history2[i] + (1 - a.momentum2) * g * g;
+    a.history[i] = m;
+    a.history2[i] = v;
+    const Dtype u = a.rate * m / (std::sqrt(v) + a.delta);
+    a.diff[i] = u;
+    a.data[i] -= u;
+  }
+}
+
+template <typename Dtype>
+void AdamSolver<Dtype>::FusedUpdate(int param_id, Dtype rate,
+    Dtype diff_scale) {
+  const int update_history_offset = this->net_->learnable_params().size();
+  SolverUpdateArgs<Dtype> args =
+      this->GetUpdateArgs(param_id, rate, diff_scale);
+  args.history2 =
+      this->history_[update_history_offset + param_id]->mutable_cpu_data();
+  // 学习率中包含偏差修正
+  const int t = this->iter_ + 1;
+  args.rate *= std::sqrt(Dtype(1) - pow(args.momentum2, t)) /
+      (Dtype(1.) - pow(args.momentum, t));
+  caffe_cpu_parallel_for(this->net_->learnable_params()[param_id]->count(),
+      boost::bind(&adam_update_cpu<Dtype>, _1, _2, &args));
+}
+
 INSTANTIATE_CLASS(AdamSolver);
 REGISTER_SOLVER_CLASS(Adam);
 
@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -55,6 +57,30 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype> CAFFE_SIMD_CLONES
+static void nesterov_update_cpu(const int begin, const int end,
+    const SolverUpdateArgs<Dtype>* args) {
+  const SolverUpdateArgs<Dtype> a = *args;
+  for (int i = begin; i < end; ++i) {
+    const Dtype h_old = a.history[i];
+    const Dtype h = a.momentum * h_old + a.rate * a.gradient(i);
+    a.history[i] = h;
+    // step back then over step
+    const Dtype u = (1 + a.momentum) * h - a.momentum * h_old;
+    a.diff[i] = u;
+    a.data[i] -= u;
+  }
+}
+
+template <typename Dtype>
+void NesterovSolver<Dtype>::FusedUpdate(int param_id, Dtype rate,
+    Dtype diff_scale) {
+  const SolverUpdateArgs<Dtype> args =
+      this->GetUpdateArgs(param_id, rate, diff_scale);
+  caffe_cpu_parallel_for(this->net_->learnable_params()[param_id]->count(),
+      boost::bind(&nesterov_update_cpu<Dtype>, _1, _2, &args));
+}
+
 INSTANTIATE_CLASS(NesterovSolver);
 REGISTER_SOLVER_CLASS(Nesterov);
 
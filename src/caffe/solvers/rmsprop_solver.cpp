@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -64,6 +66,32 @@ void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype> CAFFE_SIMD_CLONES
+static void rmsprop_update_cpu(const int begin, const int end,
+    const SolverUpdateArgs<Dtype>* args) {
+  const SolverUpdateArgs<Dtype> a = *args;
+  // momentum 字段存放 rms_decay
+  const Dtype rms_decay = a.momentum;
+  for (int i = begin; i < end; ++i) {
+    const Dtype g = a.gradient(i);
+    const Dtype h = rms_decay * a.history[i] + (1 - rms_decay) * g * g;
+    a.history[i] = h;
+    const Dtype u = a.rate * g / (std::sqrt(h) + a.delta);
+    a.diff[i] = u;
+    a.data[i] -= u;
+  }
+}
+
+template <typename Dtype>
+void RMSPropSolver<Dtype>::FusedUpdate(int param_id, Dtype rate,
+    Dtype diff_scale) {
+  SolverUpdateArgs<Dtype> args =
+      this->GetUpdateArgs(param_id, rate, diff_scale);
+  args.momentum = this->param_.rms_decay();
+  caffe_cpu_parallel_for(this->net_->learnable_params()[param_id]->count(),
+      boost::bind(&rmsprop_update_cpu<Dtype>, _1, _2, &args));
+}
+
 INSTANTIATE_CLASS(RMSPropSolver);
 REGISTER_SOLVER_CLASS(RMSProp);
 
@@ -1,4 +1,7 @@
+#include <boost/bind.hpp>
+
 #include <string>
+#include <typeinfo>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -78,24 +81,43 @@ void SGDSolver<Dtype>::PreSolve() {
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::ClipGradients() {
+Dtype SGDSolver<Dtype>::GetClipScale() {
   const Dtype clip_gradients = this->param_.clip_gradients();
-  if (clip_gradients < 0) { return; }
+  if (clip_gradients < 0) { return 1; }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
   Dtype sumsq_diff = 0;
-  for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
-  }
-  const Dtype l2norm_diff = std::sqrt(sumsq_diff);
-  if (l2norm_diff > clip_gradients) {
-    Dtype scale_factor = clip_gradients / l2norm_diff;
-    LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
-        << l2norm_diff << " > " << clip_gradients << ") "
-        << "by scale factor " << scale_factor;
+  if (this->net_->has_flat_params() && Caffe::mode() == Caffe::CPU) {
+    // 梯度连续存放时一次点积即可
+    const Dtype* flat_diff = this->net_->cpu_flat_diff();
+    sumsq_diff = caffe_cpu_dot(this->net_->flat_params_count(), flat_diff,
+        flat_diff);
+  } else {
     for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
+      sumsq_diff += net_params[i]->sumsq_diff();
     }
   }
+  const Dtype l2norm_diff = std::sqrt(sumsq_diff);
+  if (l2norm_diff <= clip_gradients) { return 1; }
+  Dtype scale_factor = clip_gradients / l2norm_diff;
+  LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
+      << l2norm_diff << " > " << clip_gradients << ") "
+      << "by scale factor " << scale_factor;
+  return scale_factor;
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ClipGradients() {
+  const Dtype scale_factor = GetClipScale();
+  if (scale_factor == 1) { return; }
+  if (this->net_->has_flat_params() && Caffe::mode() == Caffe::CPU) {
+    caffe_scal(this->net_->flat_params_count(), scale_factor,
+        this->net_->mutable_cpu_flat_diff());
+    return;
+  }
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  for (int i = 0; i < net_params.size(); ++i) {
+    net_params[i]->scale_diff(scale_factor);
+  }
 }
 
 template <typename Dtype>
@@ -105,6 +127,16 @@ void SGDSolver<Dtype>::ApplyUpdate() {
     LOG_IF(INFO, Caffe::root_solver()) << "Iteration " << this->iter_
         << ", lr = " << rate;
   }
+  if (UseFusedUpdate()) {
+    // CPU 上每个参数只遍历一次：归一化和梯度裁剪合并成一个缩放系数，
+    // 正则化、求更新量和 Net::Update 都在融合内核中完成
+    const Dtype diff_scale = GetClipScale() / this->param_.iter_size();
+    for (int param_id = 0; param_id < this->net_->learnable_params().size();
+         ++param_id) {
+      FusedUpdate(param_id, rate, diff_scale);
+    }
+    return;
+  }
   ClipGradients();
   for (int param_id = 0; param_id < this->net_->learnable_params().size();
        ++param_id) {
@@ -115,6 +147,20 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   this->net_->Update();
 }
 
+template <typename Dtype>
+bool SGDSolver<Dtype>::UseFusedUpdate() const {
+  if (Caffe::mode() != Caffe::CPU || this->param_.debug_info()) {
+    return false;
+  }
+  const std::type_info& type = typeid(*this);
+  return type == typeid(SGDSolver<Dtype>) ||
+      type == typeid(NesterovSolver<Dtype>) ||
+      type == typeid(AdaGradSolver<Dtype>) ||
+      type == typeid(RMSPropSolver<Dtype>) ||
+      type == typeid(AdaDeltaSolver<Dtype>) ||
+      type == typeid(AdamSolver<Dtype>);
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id) {
   if (this->param_.iter_size() == 1) { return; }
@@ -242,14 +288,68 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+SolverUpdateArgs<Dtype> SGDSolver<Dtype>::GetUpdateArgs(int param_id,
+    Dtype rate, Dtype diff_scale) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype local_decay = this->param_.weight_decay() *
+      this->net_->params_weight_decay()[param_id];
+  const string& regularization_type = this->param_.regularization_type();
+  SolverUpdateArgs<Dtype> args;
+  args.data = param->mutable_cpu_data();
+  args.diff = param->mutable_cpu_diff();
+  args.history = history_[param_id]->mutable_cpu_data();
+  args.history2 = NULL;
+  args.diff_scale = diff_scale;
+  args.l2_decay = 0;
+  args.l1_decay = 0;
+  if (regularization_type == "L2") {
+    args.l2_decay = local_decay;
+  } else if (regularization_type == "L1") {
+    args.l1_decay = local_decay;
+  } else {
+    LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+  }
+  args.rate = rate * this->net_->params_lr()[param_id];
+  args.momentum = this->param_.momentum();
+  args.momentum2 = this->param_.momentum2();
+  args.delta = this->param_.delta();
+  return args;
+}
+
+template <typename Dtype> CAFFE_SIMD_CLONES
+static void sgd_update_cpu(const int begin, const int end,
+    const SolverUpdateArgs<Dtype>* args) {
+  // 拷贝到局部变量，编译器才能确定参数不会被写入的数据覆盖
+  const SolverUpdateArgs<Dtype> a = *args;
+  for (int i = begin; i < end; ++i) {
+    const Dtype h = a.momentum * a.history[i] + a.rate * a.gradient(i);
+    a.history[i] = h;
+    a.diff[i] = h;
+    a.data[i] -= h;
+  }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedUpdate(int param_id, Dtype rate,
+    Dtype diff_scale) {
+  const SolverUpdateArgs<Dtype> args =
+      GetUpdateArgs(param_id, rate, diff_scale);
+  caffe_cpu_parallel_for(this->net_->learnable_params()[param_id]->count(),
+      boost::bind(&sgd_update_cpu<Dtype>, _1, _2, &args));
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
   switch (this->param_.snapshot_format()) {
     case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
-      SnapshotSolverStateToBinaryProto(model_filename);
+      SnapshotSolverStateToBinaryProto(this->iter_, this->current_step_,
+          history_, model_filename,
+          Solver<Dtype>::SnapshotFilename(".solverstate"));
       break;
     case caffe::SolverParameter_SnapshotFormat_HDF5:
-      SnapshotSolverStateToHDF5(model_filename);
+      SnapshotSolverStateToHDF5(this->iter_, this->current_step_, history_,
+          model_filename, Solver<Dtype>::SnapshotFilename(".solverstate.h5"));
       break;
     default:
       LOG(FATAL) << "Unsupported snapshot format.";
@@ -257,45 +357,83 @@ void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
+boost::function<void(const string&)> SGDSolver<Dtype>::StageSolverState() {
+  staged_history_.resize(history_.size());
+  for (int i = 0; i < history_.size(); ++i) {
+    if (!staged_history_[i]) {
+      staged_history_[i].reset(new Blob<Dtype>());
+    }
+    this->StageBlob(*history_[i], false, staged_history_[i].get());
+  }
+  const SolverParameter_SnapshotFormat format =
+      this->param_.snapshot_format();
+  const string state_filename = Solver<Dtype>::SnapshotFilename(
+      format == caffe::SolverParameter_SnapshotFormat_HDF5 ?
+      ".solverstate.h5" : ".solverstate");
+  return boost::bind(&SGDSolver<Dtype>::WriteStagedSolverState, format,
+      this->iter_, this->current_step_, staged_history_, state_filename, _1);
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::WriteStagedSolverState(
+    SolverParameter_SnapshotFormat format, int iter, int current_step,
+    vector<shared_ptr<Blob<Dtype> > > history, const string& state_filename,
     const string& model_filename) {
+  const string temp_filename = state_filename + ".tmp";
+  switch (format) {
+    case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
+      SnapshotSolverStateToBinaryProto(iter, current_step, history,
+          model_filename, temp_filename);
+      break;
+    case caffe::SolverParameter_SnapshotFormat_HDF5:
+      SnapshotSolverStateToHDF5(iter, current_step, history, model_filename,
+          temp_filename);
+      break;
+    default:
+      LOG(FATAL) << "Unsupported snapshot format.";
+  }
+  CommitFile(temp_filename, state_filename);
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(int iter,
+    int current_step, const vector<shared_ptr<Blob<Dtype> > >& history,
+    const string& model_filename, const string& state_filename) {
   SolverState state;
-  state.set_iter(this->iter_);
+  state.set_iter(iter);
   state.set_learned_net(model_filename);
-  state.set_current_step(this->current_step_);
+  state.set_current_step(current_step);
   state.clear_history();
-  for (int i = 0; i < history_.size(); ++i) {
+  for (int i = 0; i < history.size(); ++i) {
     // Add history
     BlobProto* history_blob = state.add_history();
-    history_[i]->ToProto(history_blob);
+    history[i]->ToProto(history_blob);
   }
-  string snapshot_filename = Solver<Dtype>::SnapshotFilename(".solverstate");
   LOG(INFO)
-    << "Snapshotting solver state to binary proto file " << snapshot_filename;
-  WriteProtoToBinaryFile(state, snapshot_filename.c_str());
+    << "Snapshotting solver state to binary proto file " << state_filename;
+  WriteProtoToBinaryFile(state, state_filename.c_str());
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
-    const string& model_filename) {
-  string snapshot_filename =
-      Solver<Dtype>::SnapshotFilename(".solverstate.h5");
-  LOG(INFO) << "Snapshotting solver state to HDF5 file " << snapshot_filename;
-  hid_t file_hid = H5Fcreate(snapshot_filename.c_str(), H5F_ACC_TRUNC,
+void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(int iter, int current_step,
+    const vector<shared_ptr<Blob<Dtype> > >& history,
+    const string& model_filename, const string& state_filename) {
+  LOG(INFO) << "Snapshotting solver state to HDF5 file " << state_filename;
+  hid_t file_hid = H5Fcreate(state_filename.c_str(), H5F_ACC_TRUNC,
       H5P_DEFAULT, H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
-      << "Couldn't open " << snapshot_filename << " to save solver state.";
-  hdf5_save_int(file_hid, "iter", this->iter_);
+      << "Couldn't open " << state_filename << " to save solver state.";
+  hdf5_save_int(file_hid, "iter", iter);
   hdf5_save_string(file_hid, "learned_net", model_filename);
-  hdf5_save_int(file_hid, "current_step", this->current_step_);
+  hdf5_save_int(file_hid, "current_step", current_step);
   hid_t history_hid = H5Gcreate2(file_hid, "history", H5P_DEFAULT, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(history_hid, 0)
-      << "Error saving solver state to " << snapshot_filename << ".";
-  for (int i = 0; i < history_.size(); ++i) {
+      << "Error saving solver state to " << state_filename << ".";
+  for (int i = 0; i < history.size(); ++i) {
     ostringstream oss;
     oss << i;
-    hdf5_save_nd_dataset<Dtype>(history_hid, oss.str(), *history_[i]);
+    hdf5_save_nd_dataset<Dtype>(history_hid, oss.str(), *history[i]);
   }
   H5Gclose(history_hid);
   H5Fclose(file_hid);
@@ -5,7 +5,8 @@
 namespace caffe {
 SyncedMemory::SyncedMemory()
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false),
+    cpu_malloc_pooled_(false), own_gpu_data_(false), generation_(0) {
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -15,7 +16,8 @@ SyncedMemory::SyncedMemory()
 
 SyncedMemory::SyncedMemory(size_t size)
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false),
+    cpu_malloc_pooled_(false), own_gpu_data_(false), generation_(0) {
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -26,7 +28,8 @@ SyncedMemory::SyncedMemory(size_t size)
 SyncedMemory::~SyncedMemory() {
   check_device();
   if (cpu_ptr_ && own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_); // 释放CPU内存空间
+    // 释放CPU内存空间
+    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_, cpu_malloc_pooled_);
   }
 
 #ifndef CPU_ONLY
@@ -40,7 +43,8 @@ inline void SyncedMemory::to_cpu() {
   check_device();
   switch (head_) {
   case UNINITIALIZED: // 如果未初始化
-    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_); // 分配CPU内存空间
+    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_,
+        &cpu_malloc_pooled_); // 分配CPU内存空间
     caffe_memset(size_, 0, cpu_ptr_); // 初始化为全0
     head_ = HEAD_AT_CPU; // 设置状态为 HEAD_AT_CPU
     own_cpu_data_ = true;
@@ -48,7 +52,8 @@ inline void SyncedMemory::to_cpu() {
   case HEAD_AT_GPU: // 如果GPU数据有效
 #ifndef CPU_ONLY
     if (cpu_ptr_ == NULL) {
-      CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_); // 分配CPU内存空间
+      CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_,
+          &cpu_malloc_pooled_); // 分配CPU内存空间
       own_cpu_data_ = true;
     }
     caffe_gpu_memcpy(size_, gpu_ptr_, cpu_ptr_); // 将GPU显存中数据拷贝到CPU内存中
@@ -104,10 +109,12 @@ void SyncedMemory::set_cpu_data(void* data) {
   check_device();
   CHECK(data);
   if (own_cpu_data_) { // CPU对数据拥有所有权（非共享数据）
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_); // 释放CPU内存空间
+    // 释放CPU内存空间
+    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_, cpu_malloc_pooled_);
   }
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU; // 状态设为 HEAD_AT_CPU
+  ++generation_;
   own_cpu_data_ = false; // 因为是共享数据，所以CPU数据所有权设为 false
 }
 
@@ -133,6 +140,7 @@ void SyncedMemory::set_gpu_data(void* data) {
   }
   gpu_ptr_ = data;
   head_ = HEAD_AT_GPU; // 状态设置为 HEAD_AT_GPU
+  ++generation_;
   own_gpu_data_ = false; // 因为是共享数据，所以GPU数据所有权设为 false
 #else
   NO_GPU;
@@ -144,6 +152,7 @@ void* SyncedMemory::mutable_cpu_data() {
   check_device();
   to_cpu(); // 将数据拷贝CPU内存中
   head_ = HEAD_AT_CPU; // 状态设置为 HEAD_AT_CPU
+  ++generation_;
   return cpu_ptr_;
 }
 
@@ -153,6 +162,7 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu(); // 将数据拷贝至GPU显存中
   head_ = HEAD_AT_GPU; // 状态设置为 HEAD_AT_GPU
+  ++generation_;
   return gpu_ptr_;
 #else
   NO_GPU;
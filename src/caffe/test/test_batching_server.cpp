@@ -0,0 +1,103 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/batching_server.hpp"
+#include "caffe/common.hpp"
+#include "caffe/inference_replicas.hpp"
+#include "caffe/net.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class BatchingServerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  BatchingServerTest() {
+    const string proto =
+        "name: 'BatchingNet' "
+        "layer { name: 'data' type: 'Input' top: 'data' "
+        "  input_param { shape { dim: 1 dim: 2 dim: 3 } } } "
+        "layer { name: 'ip' type: 'InnerProduct' bottom: 'data' top: 'ip' "
+        "  inner_product_param { num_output: 4 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } } } "
+        "layer { name: 'prob' type: 'Softmax' bottom: 'ip' top: 'prob' } ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param_));
+    param_.mutable_state()->set_phase(TEST);
+    net_.reset(new Net<Dtype>(param_));
+  }
+
+  static void Input(int request, vector<Dtype>* input) {
+    input->resize(6);
+    for (int i = 0; i < 6; ++i) {
+      (*input)[i] = Dtype((request * 7 + i) % 11) / 11;
+    }
+  }
+
+  // 每个客户端线程发送 count 个请求
+  static void Client(BatchingServer<Dtype>* server, int first, int count,
+      vector<vector<Dtype> >* outputs) {
+    vector<Dtype> input;
+    for (int i = first; i < first + count; ++i) {
+      Input(i, &input);
+      (*outputs)[i].resize(server->output_count());
+      server->Predict(&input[0], &(*outputs)[i][0]);
+    }
+  }
+
+  NetParameter param_;
+  shared_ptr<Net<Dtype> > net_;
+};
+
+TYPED_TEST_CASE(BatchingServerTest, TestDtypes);
+
+TYPED_TEST(BatchingServerTest, TestPredict) {
+  typedef TypeParam Dtype;
+  const int kClients = 8;
+  const int kRequests = 25;
+  // 单个样本逐一推理的结果作为参照
+  vector<vector<Dtype> > expected(kClients * kRequests);
+  vector<Dtype> input;
+  for (int i = 0; i < expected.size(); ++i) {
+    this->Input(i, &input);
+    std::copy(input.begin(), input.end(),
+        this->net_->input_blobs()[0]->mutable_cpu_data());
+    const Blob<Dtype>* output = this->net_->Forward()[0];
+    expected[i].assign(output->cpu_data(), output->cpu_data() + 4);
+  }
+
+  shared_ptr<InferenceReplicas<Dtype> > replicas(
+      new InferenceReplicas<Dtype>(this->param_, this->net_, 2));
+  vector<vector<Dtype> > outputs(expected.size());
+  {
+    BatchingServer<Dtype> server(replicas, 4, 1000);
+    EXPECT_EQ(6, server.input_count());
+    EXPECT_EQ(4, server.output_count());
+    boost::thread_group threads;
+    for (int i = 0; i < kClients; ++i) {
+      threads.create_thread(boost::bind(&BatchingServerTest<Dtype>::Client,
+          &server, i * kRequests, kRequests, &outputs));
+    }
+    threads.join_all();
+    const typename BatchingServer<Dtype>::Stats stats = server.stats();
+    EXPECT_EQ(kClients * kRequests, stats.requests);
+    // 8 个客户端同时等待，批次不超过 4 个请求
+    EXPECT_GE(stats.batches, kClients * kRequests / 4);
+    EXPECT_LT(stats.batches, kClients * kRequests);
+    EXPECT_GT(stats.p50_latency_ms, 0);
+    EXPECT_GE(stats.p99_latency_ms, stats.p50_latency_ms);
+  }
+  for (int i = 0; i < expected.size(); ++i) {
+    for (int j = 0; j < 4; ++j) {
+      EXPECT_NEAR(expected[i][j], outputs[i][j], 1e-5);
+    }
+  }
+}
+
+}  // namespace caffe
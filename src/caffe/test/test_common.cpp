@@ -42,6 +42,52 @@ TEST_F(CommonTest, TestRandSeedCPU) {
   }
 }
 
+TEST_F(CommonTest, TestContextScope) {
+  Caffe::set_mode(Caffe::CPU);
+  Caffe::set_solver_rank(0);
+  shared_ptr<Caffe> context = Caffe::CreateContext();
+  Caffe::set_mode(Caffe::GPU);
+  Caffe::set_solver_rank(2);
+  {
+    Caffe::ContextScope scope(context.get());
+    EXPECT_EQ(Caffe::CPU, Caffe::mode());
+    EXPECT_EQ(0, Caffe::solver_rank());
+    Caffe::set_solver_rank(1);
+    {
+      // A NULL context keeps the current one.
+      Caffe::ContextScope null_scope(NULL);
+      EXPECT_EQ(1, Caffe::solver_rank());
+    }
+    EXPECT_EQ(1, Caffe::solver_rank());
+  }
+  EXPECT_EQ(Caffe::GPU, Caffe::mode());
+  EXPECT_EQ(2, Caffe::solver_rank());
+  {
+    Caffe::ContextScope scope(context.get());
+    EXPECT_EQ(1, Caffe::solver_rank());
+  }
+  Caffe::set_mode(Caffe::CPU);
+  Caffe::set_solver_rank(0);
+}
+
+TEST_F(CommonTest, TestContextRNG) {
+  int a[10], b[10], c[10];
+  Caffe::set_random_seed(1701);
+  caffe_rng_bernoulli(10, 0.5, a);
+  // Drawing from a context leaves the thread's RNG alone.
+  shared_ptr<Caffe> context = Caffe::CreateContext();
+  Caffe::set_random_seed(1701);
+  {
+    Caffe::ContextScope scope(context.get());
+    Caffe::set_random_seed(1);
+    caffe_rng_bernoulli(10, 0.5, c);
+  }
+  caffe_rng_bernoulli(10, 0.5, b);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(a[i], b[i]);
+  }
+}
+
 #ifndef CPU_ONLY  // GPU Caffe singleton test.
 
 TEST_F(CommonTest, TestRandSeedGPU) {
@@ -340,5 +340,76 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestDatumViewInPlace) {
+  // A serialized Datum is read without copying its pixels: the view points
+  // into the serialized bytes and the storage Datum is left untouched.
+  const int label = -3;
+  const int channels = 3;
+  const int height = 4;
+  const int width = 5;
+  Datum datum;
+  FillDatum(label, channels, height, width, true, &datum);
+  string serialized;
+  ASSERT_TRUE(datum.SerializeToString(&serialized));
+  Datum storage;
+  const DatumView view = ParseDatumView(serialized.data(), serialized.size(),
+      &storage);
+  EXPECT_FALSE(storage.has_data());
+  EXPECT_FALSE(storage.has_channels());
+  EXPECT_GE(view.data, serialized.data());
+  EXPECT_LE(view.data + view.data_size,
+      serialized.data() + serialized.size());
+  EXPECT_EQ(datum.data(), string(view.data, view.data_size));
+  EXPECT_EQ(label, view.label);
+  EXPECT_EQ(channels, view.channels);
+  EXPECT_EQ(height, view.height);
+  EXPECT_EQ(width, view.width);
+  EXPECT_FALSE(view.encoded);
+  // The view transforms like the Datum.
+  TransformationParameter transform_param;
+  transform_param.set_crop_size(3);
+  transform_param.set_scale(0.5);
+  transform_param.add_mean_value(2);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  Blob<TypeParam> blob(transformer.InferBlobShape(view));
+  Blob<TypeParam> expected(transformer.InferBlobShape(datum));
+  ASSERT_EQ(expected.shape(), blob.shape());
+  transformer.Transform(view, &blob);
+  transformer.Transform(datum, &expected);
+  for (int j = 0; j < blob.count(); ++j) {
+    EXPECT_EQ(expected.cpu_data()[j], blob.cpu_data()[j]);
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestDatumViewFloatData) {
+  // float_data is not contiguous in the serialized bytes, so such a record
+  // is parsed into the storage Datum.
+  Datum datum;
+  datum.set_channels(1);
+  datum.set_height(2);
+  datum.set_width(2);
+  datum.set_label(1);
+  for (int j = 0; j < 4; ++j) {
+    datum.add_float_data(j * 0.5);
+  }
+  string serialized;
+  ASSERT_TRUE(datum.SerializeToString(&serialized));
+  Datum storage;
+  const DatumView view = ParseDatumView(serialized.data(), serialized.size(),
+      &storage);
+  ASSERT_EQ(4, view.float_data_size);
+  EXPECT_EQ(storage.float_data().data(), view.float_data);
+  EXPECT_EQ(0, view.data_size);
+  TransformationParameter transform_param;
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  Blob<TypeParam> blob(1, 1, 2, 2);
+  transformer.Transform(view, &blob);
+  for (int j = 0; j < 4; ++j) {
+    EXPECT_EQ(j * 0.5, blob.cpu_data()[j]);
+  }
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -1,5 +1,7 @@
 #if defined(USE_LEVELDB) && defined(USE_LMDB) && defined(USE_OPENCV)
+#include <cstring>
 #include <string>
+#include <vector>
 
 #include "boost/scoped_ptr.hpp"
 #include "gtest/gtest.h"
@@ -117,6 +119,44 @@ TYPED_TEST(DBTest, TestKeyValue) {
   EXPECT_FALSE(cursor->valid());
 }
 
+TYPED_TEST(DBTest, TestValueData) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  while (cursor->valid()) {
+    const string value = cursor->value();
+    ASSERT_EQ(value.size(), cursor->value_size());
+    EXPECT_EQ(0, memcmp(value.data(), cursor->value_data(), value.size()));
+    Datum datum, datum_view;
+    datum.ParseFromString(value);
+    EXPECT_TRUE(datum_view.ParseFromArray(cursor->value_data(),
+        cursor->value_size()));
+    EXPECT_EQ(datum.data(), datum_view.data());
+    EXPECT_EQ(datum.height(), datum_view.height());
+    cursor->Next();
+  }
+}
+
+TYPED_TEST(DBTest, TestValueDataPersists) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  if (!cursor->value_data_persists()) {
+    return;
+  }
+  // The views taken before the cursor moved on still hold their values.
+  vector<const void*> views;
+  vector<string> values;
+  for (; cursor->valid(); cursor->Next()) {
+    views.push_back(cursor->value_data());
+    values.push_back(cursor->value());
+  }
+  cursor->SeekToFirst();
+  for (int i = 0; i < views.size(); ++i) {
+    EXPECT_EQ(0, memcmp(values[i].data(), views[i], values[i].size()));
+  }
+}
+
 TYPED_TEST(DBTest, TestWrite) {
   scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::WRITE);
@@ -0,0 +1,110 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/fuse_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class FuseLayersTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  // conv1 -> bn1 -> scale1 -> relu1 is folded in place; conv2 is read by two
+  // layers and must be left alone.
+  virtual void SetUp() {
+    const string proto =
+        "name: 'FuseNet' "
+        "layer { name: 'data' type: 'Input' top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 6 dim: 5 } } } "
+        "layer { name: 'conv1' type: 'Convolution' bottom: 'data' "
+        "  top: 'conv1' convolution_param { num_output: 4 kernel_size: 3 "
+        "  pad: 1 bias_term: false weight_filler { type: 'gaussian' } } } "
+        "layer { name: 'bn1' type: 'BatchNorm' bottom: 'conv1' top: 'conv1' } "
+        "layer { name: 'scale1' type: 'Scale' bottom: 'conv1' top: 'conv1' "
+        "  scale_param { bias_term: true "
+        "  filler { type: 'uniform' min: 0.5 max: 1.5 } "
+        "  bias_filler { type: 'gaussian' } } } "
+        "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' } "
+        "layer { name: 'conv2' type: 'Convolution' bottom: 'conv1' "
+        "  top: 'conv2' convolution_param { num_output: 2 kernel_size: 1 "
+        "  weight_filler { type: 'gaussian' } "
+        "  bias_filler { type: 'gaussian' } } } "
+        "layer { name: 'bn2' type: 'BatchNorm' bottom: 'conv2' top: 'bn2' } "
+        "layer { name: 'relu2' type: 'ReLU' bottom: 'conv2' top: 'relu2' } ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param_));
+  }
+
+  // Gives the BatchNorm layers non-trivial statistics.
+  void FillBatchNorm(Net<Dtype>* net, const string& name) {
+    const vector<shared_ptr<Blob<Dtype> > >& blobs =
+        net->layer_by_name(name)->blobs();
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> mean_filler(filler_param);
+    mean_filler.Fill(blobs[0].get());
+    filler_param.set_min(0.5);
+    filler_param.set_max(1.5);
+    UniformFiller<Dtype> variance_filler(filler_param);
+    variance_filler.Fill(blobs[1].get());
+    blobs[2]->mutable_cpu_data()[0] = 2;
+  }
+
+  NetParameter param_;
+};
+
+TYPED_TEST_CASE(FuseLayersTest, TestDtypesAndDevices);
+
+TYPED_TEST(FuseLayersTest, TestFuseConvBatchNormScaleReLU) {
+  typedef typename TypeParam::Dtype Dtype;
+  Net<Dtype> net(this->param_);
+  this->FillBatchNorm(&net, "bn1");
+  this->FillBatchNorm(&net, "bn2");
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(net.blob_by_name("data").get());
+  net.Forward();
+
+  NetParameter trained_param;
+  net.ToProto(&trained_param, false);
+  NetParameter fused_param;
+  FuseInferenceLayers(trained_param, &fused_param);
+  // Net inserted a Split layer after conv2.
+  ASSERT_EQ(6, fused_param.layer_size());
+  const LayerParameter& conv1 = fused_param.layer(1);
+  EXPECT_EQ("conv1", conv1.name());
+  EXPECT_EQ("conv1", conv1.top(0));
+  EXPECT_TRUE(conv1.convolution_param().bias_term());
+  EXPECT_TRUE(conv1.convolution_param().fuse_relu());
+  EXPECT_EQ(2, conv1.blobs_size());
+  const LayerParameter& conv2 = fused_param.layer(2);
+  EXPECT_EQ("conv2", conv2.name());
+  EXPECT_FALSE(conv2.convolution_param().fuse_relu());
+  EXPECT_EQ("Split", fused_param.layer(3).type());
+  EXPECT_EQ("BatchNorm", fused_param.layer(4).type());
+  EXPECT_EQ("ReLU", fused_param.layer(5).type());
+
+  // The layers load their blobs from fused_param.
+  Net<Dtype> fused_net(fused_param);
+  fused_net.blob_by_name("data")->CopyFrom(*net.blob_by_name("data"));
+  fused_net.Forward();
+  const char* outputs[] = {"bn2", "relu2"};
+  for (int i = 0; i < 2; ++i) {
+    const Blob<Dtype>& expected = *net.blob_by_name(outputs[i]);
+    const Blob<Dtype>& actual = *fused_net.blob_by_name(outputs[i]);
+    ASSERT_EQ(expected.count(), actual.count());
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_NEAR(expected.cpu_data()[j], actual.cpu_data()[j], 1e-3);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <algorithm>
 #include <string>
 #include <utility>
@@ -12,6 +14,8 @@
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/transport.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -19,6 +23,35 @@ using std::ostringstream;
 
 namespace caffe {
 
+// Overrides ComputeUpdateValue without changing it, so that ApplyUpdate runs
+// the separate Normalize, Regularize, ComputeUpdateValue and Net::Update
+// passes; a reference for the fused update.
+template <template <typename> class SolverType, typename Dtype>
+class SeparatePassSolver : public SolverType<Dtype> {
+ public:
+  explicit SeparatePassSolver(const SolverParameter& param)
+      : SolverType<Dtype>(param) {}
+
+ protected:
+  virtual void ComputeUpdateValue(int param_id, Dtype rate) {
+    SolverType<Dtype>::ComputeUpdateValue(param_id, rate);
+  }
+};
+
+// Zeroes every update, to check that an overridden step is not bypassed.
+template <typename Dtype>
+class ZeroUpdateSolver : public SGDSolver<Dtype> {
+ public:
+  explicit ZeroUpdateSolver(const SolverParameter& param)
+      : SGDSolver<Dtype>(param) {}
+
+ protected:
+  virtual void ComputeUpdateValue(int param_id, Dtype rate) {
+    Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+    caffe_set(param->count(), Dtype(0), param->mutable_cpu_diff());
+  }
+};
+
 template <typename TypeParam>
 class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -26,7 +59,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
  protected:
   GradientBasedSolverTest() :
       seed_(1701), num_(4), channels_(3), height_(10), width_(10),
-      share_(false) {
+      share_(false), separate_passes_(false), transport_(false) {
         input_file_ = new string(
         CMAKE_SOURCE_DIR "caffe/test/test_data/solver_data_list.txt" CMAKE_EXT);
       }
@@ -39,11 +72,19 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
 #ifdef USE_NCCL
   shared_ptr<NCCL<Dtype> > nccl_;
 #endif
+  shared_ptr<CPUParallel<Dtype> > cpu_parallel_;
   int seed_;
   // Dimensions are determined by generate_sample_data.py
   // TODO this is brittle and the hdf5 file should be checked instead.
   int num_, channels_, height_, width_;
   bool share_;
+  // Use SeparatePassSolver instead of the solver under test.
+  bool separate_passes_;
+  // Run multi-solver CPU tests as ranks of a TransportParallel over Unix
+  // sockets instead of CPUParallel.
+  bool transport_;
+  // Extra SolverParameter fields in text format.
+  string extra_solver_params_;
   Dtype delta_;  // Stability constant for RMSProp, AdaGrad, AdaDelta and Adam
 
   // Test data: check out generate_sample_data.py in the same directory.
@@ -51,6 +92,15 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
 
   virtual void InitSolver(const SolverParameter& param) = 0;
 
+  template <template <typename> class SolverType>
+  void InitSolverOfType(const SolverParameter& param) {
+    if (separate_passes_) {
+      solver_.reset(new SeparatePassSolver<SolverType, Dtype>(param));
+    } else {
+      solver_.reset(new SolverType<Dtype>(param));
+    }
+  }
+
   virtual void InitSolverFromProtoString(const string& proto) {
     SolverParameter param;
     CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
@@ -69,6 +119,20 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     delta_ = param.delta();
   }
 
+  // 一个 rank 的训练：solver 为 NULL 时按 param 创建 (rank 0 之外的线程)
+  static void RunTransportRank(shared_ptr<Solver<Dtype> > solver,
+      SolverParameter param, const string& address, int rank, int size) {
+    Caffe::set_mode(Caffe::CPU);
+    Caffe::set_solver_count(size);
+    Caffe::set_solver_rank(rank);
+    if (!solver) {
+      solver.reset(SolverRegistry<Dtype>::CreateSolver(param));
+    }
+    shared_ptr<Transport> transport = Transport::Create(address, rank, size);
+    TransportParallel<Dtype> parallel(solver, transport, "ring");
+    parallel.Run();
+  }
+
   string RunLeastSquaresSolver(const Dtype learning_rate,
       const Dtype weight_decay, const Dtype momentum, const int num_iters,
       const int iter_size = 1, const int devices = 1,
@@ -179,6 +243,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     if (momentum != 0) {
       proto << "momentum: " << momentum << " ";
     }
+    proto << extra_solver_params_;
     MakeTempDir(&snapshot_prefix_);
     proto << "snapshot_prefix: '" << snapshot_prefix_ << "/' ";
     if (snapshot) {
@@ -194,6 +259,28 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     }
     if (devices == 1) {
       this->solver_->Solve();
+    } else if (Caffe::mode() == Caffe::CPU && transport_) {
+      LOG(INFO) << "Multi-process CPU test with " << devices << " ranks";
+      string address;
+      MakeTempDir(&address);
+      address = "unix:" + address + "/rank";
+      SolverParameter param(this->solver_->param());
+      param.set_type(this->solver_->type());
+      boost::thread_group ranks;
+      for (int rank = 1; rank < devices; ++rank) {
+        ranks.create_thread(boost::bind(&RunTransportRank,
+            shared_ptr<Solver<Dtype> >(), param, address, rank, devices));
+      }
+      RunTransportRank(this->solver_, param, address, 0, devices);
+      ranks.join_all();
+      Caffe::set_solver_count(1);
+    } else if (Caffe::mode() == Caffe::CPU) {
+      LOG(INFO) << "Multi-solver CPU test with " << devices << " solvers";
+      Caffe::set_solver_count(devices);
+      this->cpu_parallel_.reset(new CPUParallel<Dtype>(this->solver_));
+      const bool kPinNuma = false;
+      this->cpu_parallel_->Run(kPinNuma, from_snapshot);
+      Caffe::set_solver_count(1);
     } else {
       LOG(INFO) << "Multi-GPU test on " << devices << " devices";
       vector<int> gpus;
@@ -439,6 +526,53 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     EXPECT_NEAR(expected_bias, accum_bias, error_margin);
   }
 
+  // Check that the single-pass CPU update matches the separate passes, with
+  // L1 regularization and gradient clipping, which the least squares
+  // reference does not model. The params, their diffs (which hold the update
+  // value) and the history are compared.
+  void CheckFusedUpdate(const Dtype kLearningRate, const Dtype kWeightDecay,
+      const Dtype kMomentum, const int kNumIters, const int kIterSize) {
+    const double kPrecision = 1e-3;
+    const double kMinPrecision = 1e-7;
+    extra_solver_params_ = "regularization_type: 'L1' clip_gradients: 0.1 ";
+    vector<vector<shared_ptr<Blob<Dtype> > > > results(2);
+    for (int separate = 0; separate <= 1; ++separate) {
+      separate_passes_ = separate;
+      RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+          kIterSize);
+      const vector<Blob<Dtype>*>& params =
+          this->solver_->net()->learnable_params();
+      vector<Blob<Dtype>*> blobs = params;
+      for (int i = 0; i < this->solver_->history().size(); ++i) {
+        blobs.push_back(this->solver_->history()[i].get());
+      }
+      for (int i = 0; i < blobs.size(); ++i) {
+        results[separate].push_back(
+            shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+        results[separate].back()->CopyFrom(*blobs[i], false, true);
+      }
+      for (int i = 0; i < params.size(); ++i) {
+        results[separate].push_back(
+            shared_ptr<Blob<Dtype> >(new Blob<Dtype>(params[i]->shape())));
+        caffe_copy(params[i]->count(), params[i]->cpu_diff(),
+            results[separate].back()->mutable_cpu_data());
+      }
+    }
+    separate_passes_ = false;
+    extra_solver_params_ = "";
+    ASSERT_EQ(results[0].size(), results[1].size());
+    for (int i = 0; i < results[0].size(); ++i) {
+      for (int j = 0; j < results[0][i]->count(); ++j) {
+        const Dtype fused = results[0][i]->cpu_data()[j];
+        const Dtype separate = results[1][i]->cpu_data()[j];
+        const Dtype error_margin = std::max(kMinPrecision, kPrecision *
+            std::min(fabs(fused), fabs(separate)));
+        EXPECT_NEAR(separate, fused, error_margin)
+            << "blob " << i << " differed at " << j;
+      }
+    }
+  }
+
   // Test that the correct update is computed for a regularized least squares
   // problem:
   //
@@ -459,8 +593,8 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
       const int iter_to_check = 0) {
     const int kNum = num_;
     const int kIterSize = 1;
-    // Test over all numbers of devices.
-    int available_devices = 1;
+    // Test over all numbers of devices, or of solver threads on the CPU.
+    int available_devices = (Caffe::mode() == Caffe::CPU) ? 3 : 1;
 #ifdef USE_NCCL
     if (Caffe::mode() == Caffe::GPU) {
       CUDA_CHECK(cudaGetDeviceCount(&available_devices));
@@ -585,7 +719,7 @@ class SGDSolverTest : public GradientBasedSolverTest<TypeParam> {
 
  protected:
   virtual void InitSolver(const SolverParameter& param) {
-    this->solver_.reset(new SGDSolver<Dtype>(param));
+    this->template InitSolverOfType<SGDSolver>(param);
   }
 };
 
@@ -668,6 +802,22 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingShare) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingTransport) {
+  typedef typename TypeParam::Dtype Dtype;
+  // TransportParallel only trains in CPU mode
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.5;
+  const int kNumIters = 4;
+  this->transport_ = true;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -691,6 +841,41 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
       kIterSize);
 }
 
+TYPED_TEST(SGDSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(SGDSolverTest, TestOverriddenStepIsUsed) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 1;
+  this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+      kNumIters);
+  ZeroUpdateSolver<Dtype> solver(this->solver_->param());
+  const vector<Blob<Dtype>*>& params = solver.net()->learnable_params();
+  vector<shared_ptr<Blob<Dtype> > > initial(params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    initial[i].reset(new Blob<Dtype>());
+    initial[i]->CopyFrom(*params[i], false, true);
+  }
+  solver.Step(2);
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(initial[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+      EXPECT_EQ(0, params[i]->cpu_diff()[j]);
+    }
+  }
+}
+
 TYPED_TEST(SGDSolverTest, TestSnapshot) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -714,6 +899,18 @@ TYPED_TEST(SGDSolverTest, TestSnapshotShare) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestSnapshotAsync) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->extra_solver_params_ = "snapshot_async: true ";
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 
 template <typename TypeParam>
 class AdaGradSolverTest : public GradientBasedSolverTest<TypeParam> {
@@ -721,7 +918,7 @@ class AdaGradSolverTest : public GradientBasedSolverTest<TypeParam> {
 
  protected:
   virtual void InitSolver(const SolverParameter& param) {
-    this->solver_.reset(new AdaGradSolver<Dtype>(param));
+    this->template InitSolverOfType<AdaGradSolver>(param);
   }
 };
 
@@ -791,6 +988,17 @@ TYPED_TEST(AdaGradSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
       kIterSize);
 }
 
+TYPED_TEST(AdaGradSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(AdaGradSolverTest, TestSnapshot) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -821,7 +1029,7 @@ class NesterovSolverTest : public GradientBasedSolverTest<TypeParam> {
 
  protected:
   virtual void InitSolver(const SolverParameter& param) {
-    this->solver_.reset(new NesterovSolver<Dtype>(param));
+    this->template InitSolverOfType<NesterovSolver>(param);
   }
 };
 
@@ -925,6 +1133,17 @@ TYPED_TEST(NesterovSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
       kIterSize);
 }
 
+TYPED_TEST(NesterovSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(NesterovSolverTest, TestSnapshot) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -954,7 +1173,7 @@ class AdaDeltaSolverTest : public GradientBasedSolverTest<TypeParam> {
 
  protected:
   virtual void InitSolver(const SolverParameter& param) {
-    this->solver_.reset(new AdaDeltaSolver<Dtype>(param));
+    this->template InitSolverOfType<AdaDeltaSolver>(param);
   }
 };
 
@@ -1054,6 +1273,17 @@ TYPED_TEST(AdaDeltaSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
       kIterSize);
 }
 
+TYPED_TEST(AdaDeltaSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.1;
+  const Dtype kWeightDecay = 0.1;
+  const Dtype kMomentum = 0.95;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(AdaDeltaSolverTest, TestSnapshot) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.1;
@@ -1088,7 +1318,7 @@ class AdamSolverTest : public GradientBasedSolverTest<TypeParam> {
     new_param.set_momentum(momentum);
     const Dtype momentum2 = 0.999;
     new_param.set_momentum2(momentum2);
-    this->solver_.reset(new AdamSolver<Dtype>(new_param));
+    this->template InitSolverOfType<AdamSolver>(new_param);
   }
 };
 
@@ -1156,6 +1386,17 @@ TYPED_TEST(AdamSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
       kIterSize);
 }
 
+TYPED_TEST(AdamSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(AdamSolverTest, TestSnapshot) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1188,7 +1429,7 @@ class RMSPropSolverTest : public GradientBasedSolverTest<TypeParam> {
     const Dtype rms_decay = 0.95;
     SolverParameter new_param = param;
     new_param.set_rms_decay(rms_decay);
-    this->solver_.reset(new RMSPropSolver<Dtype>(new_param));
+    this->template InitSolverOfType<RMSPropSolver>(new_param);
   }
 };
 
@@ -1259,6 +1500,17 @@ TYPED_TEST(RMSPropSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
       kIterSize);
 }
 
+TYPED_TEST(RMSPropSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.0;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(RMSPropSolverTest, TestSnapshot) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -0,0 +1,125 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/host_allocator.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HostAllocatorTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    HostAllocator::Get().set_mode(HostAllocator::POOLED);
+    HostAllocator::Get().Trim();
+    HostAllocator::Get().ResetStats();
+  }
+  virtual void TearDown() {
+    HostAllocator::Get().set_mode(HostAllocator::SYSTEM);
+    HostAllocator::Get().set_cache_limit(static_cast<size_t>(-1));
+  }
+};
+
+TEST_F(HostAllocatorTest, TestRoundSize) {
+  EXPECT_EQ(64, HostAllocator::RoundSize(0));
+  EXPECT_EQ(64, HostAllocator::RoundSize(1));
+  EXPECT_EQ(64, HostAllocator::RoundSize(64));
+  EXPECT_EQ(80, HostAllocator::RoundSize(65));
+  EXPECT_EQ(128, HostAllocator::RoundSize(128));
+  EXPECT_EQ(160, HostAllocator::RoundSize(129));
+  EXPECT_EQ(1280, HostAllocator::RoundSize(1025));
+  EXPECT_EQ(4096, HostAllocator::RoundSize(4000));
+}
+
+TEST_F(HostAllocatorTest, TestAlignmentAndReuse) {
+  HostAllocator& allocator = HostAllocator::Get();
+  void* first = allocator.Allocate(1000);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(first) % HostAllocator::kAlignment);
+  EXPECT_EQ(1024, allocator.stats().bytes_live);
+  allocator.Free(first);
+  EXPECT_EQ(0, allocator.stats().bytes_live);
+  EXPECT_EQ(1024, allocator.stats().bytes_cached);
+  // Same size class: the cached block is handed out again.
+  void* second = allocator.Allocate(1010);
+  EXPECT_EQ(first, second);
+  HostAllocator::Stats stats = allocator.stats();
+  EXPECT_EQ(1, stats.hits);
+  EXPECT_EQ(1, stats.misses);
+  EXPECT_EQ(0, stats.bytes_cached);
+  EXPECT_DOUBLE_EQ(0.5, stats.hit_rate());
+  allocator.Free(second);
+}
+
+TEST_F(HostAllocatorTest, TestTrimAndCacheLimit) {
+  HostAllocator& allocator = HostAllocator::Get();
+  vector<void*> blocks;
+  for (int i = 0; i < 4; ++i) {
+    blocks.push_back(allocator.Allocate(256));
+  }
+  allocator.set_cache_limit(512);
+  for (int i = 0; i < blocks.size(); ++i) {
+    allocator.Free(blocks[i]);
+  }
+  EXPECT_EQ(512, allocator.stats().bytes_cached);
+  allocator.Trim();
+  EXPECT_EQ(0, allocator.stats().bytes_cached);
+}
+
+TEST_F(HostAllocatorTest, TestFreeAfterModeSwitch) {
+  HostAllocator& allocator = HostAllocator::Get();
+  void* block = allocator.Allocate(3000);
+  // The size class comes from the block header, so the block is released
+  // to the system once the pool is off.
+  allocator.set_mode(HostAllocator::SYSTEM);
+  allocator.Free(block);
+  EXPECT_EQ(0, allocator.stats().bytes_live);
+  EXPECT_EQ(0, allocator.stats().bytes_cached);
+}
+
+// 每个线程反复分配、释放不同大小的块
+static void AllocateAndFree(int seed) {
+  HostAllocator& allocator = HostAllocator::Get();
+  for (int i = 0; i < 1000; ++i) {
+    const size_t size = 64 * (1 + (seed + i) % 7);
+    char* block = static_cast<char*>(allocator.Allocate(size));
+    block[0] = block[size - 1] = static_cast<char>(i);
+    allocator.Free(block);
+  }
+}
+
+TEST_F(HostAllocatorTest, TestConcurrent) {
+  boost::thread_group threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.create_thread(boost::bind(&AllocateAndFree, i));
+  }
+  threads.join_all();
+  HostAllocator::Stats stats = HostAllocator::Get().stats();
+  EXPECT_EQ(0, stats.bytes_live);
+  EXPECT_EQ(4000, stats.hits + stats.misses);
+  HostAllocator::Get().Trim();
+  EXPECT_EQ(0, HostAllocator::Get().stats().bytes_cached);
+}
+
+TEST_F(HostAllocatorTest, TestSyncedMemory) {
+  void* ptr;
+  {
+    SyncedMemory mem(100 * sizeof(float));
+    ptr = mem.mutable_cpu_data();
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(ptr) % HostAllocator::kAlignment);
+    EXPECT_EQ(0, static_cast<const float*>(mem.cpu_data())[99]);
+  }
+  EXPECT_EQ(0, HostAllocator::Get().stats().bytes_live);
+  SyncedMemory mem(100 * sizeof(float));
+  EXPECT_EQ(ptr, mem.mutable_cpu_data());
+  EXPECT_EQ(1, HostAllocator::Get().stats().hits);
+  // Blocks allocated while pooled are still released after switching back.
+  HostAllocator::Get().set_mode(HostAllocator::SYSTEM);
+}
+
+}  // namespace caffe
@@ -97,6 +97,43 @@ TYPED_TEST(ImageDataLayerTest, TestRead) {
   }
 }
 
+TYPED_TEST(ImageDataLayerTest, TestReadParallel) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(5);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_shuffle(false);
+  ImageDataLayer<Dtype> reference_layer(param);
+  vector<Blob<Dtype>*> reference_top_vec;
+  Blob<Dtype> reference_data;
+  Blob<Dtype> reference_label;
+  reference_top_vec.push_back(&reference_data);
+  reference_top_vec.push_back(&reference_label);
+  reference_layer.SetUp(this->blob_bottom_vec_, reference_top_vec);
+  // 多个线程解码，结果与单线程一致
+  image_data_param->set_decode_threads(3);
+  ImageDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->num(), 5);
+  EXPECT_EQ(this->blob_top_data_->channels(), 3);
+  EXPECT_EQ(this->blob_top_data_->height(), 360);
+  EXPECT_EQ(this->blob_top_data_->width(), 480);
+  // Go through the data twice
+  for (int iter = 0; iter < 2; ++iter) {
+    reference_layer.Forward(this->blob_bottom_vec_, reference_top_vec);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_EQ(i, this->blob_top_label_->cpu_data()[i]);
+    }
+    ASSERT_EQ(reference_data.count(), this->blob_top_data_->count());
+    for (int i = 0; i < reference_data.count(); ++i) {
+      ASSERT_EQ(reference_data.cpu_data()[i],
+          this->blob_top_data_->cpu_data()[i]);
+    }
+  }
+}
+
 TYPED_TEST(ImageDataLayerTest, TestResize) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
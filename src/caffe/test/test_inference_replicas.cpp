@@ -0,0 +1,147 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/inference_replicas.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/net.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class InferenceReplicasTest : public CPUDeviceTest<Dtype> {
+ protected:
+  InferenceReplicasTest() {
+    const string proto =
+        "name: 'ReplicaNet' "
+        "state { phase: TEST } "
+        "layer { name: 'data' type: 'Input' top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 4 dim: 4 } } } "
+        "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+        "  convolution_param { num_output: 4 kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } } } "
+        "layer { name: 'ip' type: 'InnerProduct' bottom: 'conv' top: 'ip' "
+        "  inner_product_param { num_output: 5 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } } } ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param_));
+  }
+
+  // 输入为 seed + i，重复多次以便与其他线程交错
+  static void Forward(Net<Dtype>* net, int seed, vector<Dtype>* output) {
+    for (int iter = 0; iter < 20; ++iter) {
+      Blob<Dtype>* input = net->input_blobs()[0];
+      for (int i = 0; i < input->count(); ++i) {
+        input->mutable_cpu_data()[i] = Dtype(seed + i) / input->count();
+      }
+      const Blob<Dtype>* result = net->Forward()[0];
+      output->assign(result->cpu_data(), result->cpu_data() + result->count());
+    }
+  }
+
+  NetParameter param_;
+};
+
+TYPED_TEST_CASE(InferenceReplicasTest, TestDtypes);
+
+TYPED_TEST(InferenceReplicasTest, TestSharedWeights) {
+  typedef TypeParam Dtype;
+  shared_ptr<Net<Dtype> > net(new Net<Dtype>(this->param_));
+  InferenceReplicas<Dtype> replicas(this->param_, net, 3);
+  ASSERT_EQ(3, replicas.size());
+  EXPECT_EQ(net, replicas.replica(0));
+  // conv 4 x 3 x 3 x 3 + 4, ip 5 x 16 + 5
+  EXPECT_EQ((112 + 85) * sizeof(Dtype), replicas.weights_bytes());
+  EXPECT_GT(replicas.activations_bytes(), 0);
+  for (int i = 1; i < replicas.size(); ++i) {
+    const Net<Dtype>& replica = *replicas.replica(i);
+    ASSERT_EQ(net->params().size(), replica.params().size());
+    for (int j = 0; j < net->params().size(); ++j) {
+      EXPECT_EQ(net->params()[j]->cpu_data(), replica.params()[j]->cpu_data());
+    }
+    EXPECT_NE(net->input_blobs()[0]->cpu_data(),
+        replica.input_blobs()[0]->cpu_data());
+  }
+}
+
+TYPED_TEST(InferenceReplicasTest, TestConcurrentForward) {
+  typedef TypeParam Dtype;
+  shared_ptr<Net<Dtype> > net(new Net<Dtype>(this->param_));
+  InferenceReplicas<Dtype> replicas(this->param_, net, 4);
+  vector<vector<Dtype> > expected(replicas.size());
+  for (int i = 0; i < replicas.size(); ++i) {
+    this->Forward(net.get(), i, &expected[i]);
+  }
+  vector<vector<Dtype> > outputs(replicas.size());
+  boost::thread_group threads;
+  for (int i = 0; i < replicas.size(); ++i) {
+    threads.create_thread(boost::bind(&InferenceReplicasTest<Dtype>::Forward,
+        replicas.replica(i).get(), i, &outputs[i]));
+  }
+  threads.join_all();
+  for (int i = 0; i < replicas.size(); ++i) {
+    ASSERT_EQ(expected[i].size(), outputs[i].size());
+    for (int j = 0; j < outputs[i].size(); ++j) {
+      EXPECT_EQ(expected[i][j], outputs[i][j]);
+    }
+  }
+}
+
+TYPED_TEST(InferenceReplicasTest, TestWinogradWeightsShared) {
+  typedef TypeParam Dtype;
+  // 10x10 outputs use F(4x4,3x3): 6 x 6 transformed coefficients per filter
+  NetParameter param(this->param_);
+  param.mutable_layer(0)->mutable_input_param()->mutable_shape(0)->set_dim(
+      2, 10);
+  param.mutable_layer(0)->mutable_input_param()->mutable_shape(0)->set_dim(
+      3, 10);
+  ConvolutionParameter* conv_param =
+      param.mutable_layer(1)->mutable_convolution_param();
+  conv_param->add_pad(1);
+  conv_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+  shared_ptr<Net<Dtype> > net(new Net<Dtype>(param));
+  const int count = 4;
+  InferenceReplicas<Dtype> replicas(param, net, count);
+  // conv 4 x 3 x 3 x 3 + 4, ip 5 x 400 + 5, transformed 36 x 4 x 3 held once
+  const size_t bytes = (112 + 2005 + 432) * sizeof(Dtype);
+  EXPECT_EQ(bytes, replicas.weights_bytes());
+  vector<vector<Dtype> > expected(count);
+  for (int i = 0; i < count; ++i) {
+    this->Forward(net.get(), i, &expected[i]);
+  }
+  vector<vector<Dtype> > outputs(count);
+  boost::thread_group threads;
+  for (int i = 0; i < count; ++i) {
+    threads.create_thread(boost::bind(&InferenceReplicasTest<Dtype>::Forward,
+        replicas.replica(i).get(), i, &outputs[i]));
+  }
+  threads.join_all();
+  EXPECT_EQ(bytes, replicas.weights_bytes());
+  const Blob<Dtype>* transformed = NULL;
+  for (int i = 0; i < count; ++i) {
+    const WinogradConvolutionLayer<Dtype>* conv =
+        dynamic_cast<const WinogradConvolutionLayer<Dtype>*>(
+            replicas.replica(i)->layer_by_name("conv").get());
+    ASSERT_TRUE(conv != NULL);
+    ASSERT_TRUE(conv->transformed_weights() != NULL);
+    if (i == 0) {
+      transformed = conv->transformed_weights();
+      EXPECT_EQ(432, transformed->count());
+    }
+    EXPECT_EQ(transformed, conv->transformed_weights());
+    ASSERT_EQ(expected[i].size(), outputs[i].size());
+    for (int j = 0; j < outputs[i].size(); ++j) {
+      EXPECT_EQ(expected[i][j], outputs[i][j]);
+    }
+  }
+}
+
+}  // namespace caffe
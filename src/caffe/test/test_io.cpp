@@ -4,6 +4,7 @@
 #include <opencv2/highgui/highgui_c.h>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include <cstdlib>
 #include <string>
 
 #include "gtest/gtest.h"
@@ -229,6 +230,35 @@ TEST_F(IOTest, TestReadImageToCVMatResizedGray) {
   EXPECT_EQ(cv_img.cols, 256);
 }
 
+TEST_F(IOTest, TestReadImageToCVMatReduced) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  // 360 x 480 的图片以 1/2 尺寸解码后再缩放
+  cv::Mat cv_img = ReadImageToCVMat(filename, 100, 200, true, true);
+  cv::Mat cv_img_ref = ReadImageToCVMat(filename, 100, 200, true);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, 100);
+  EXPECT_EQ(cv_img.cols, 200);
+  double difference = 0;
+  for (int h = 0; h < cv_img.rows; ++h) {
+    for (int w = 0; w < cv_img.cols; ++w) {
+      for (int c = 0; c < 3; ++c) {
+        difference += std::abs(cv_img.at<cv::Vec3b>(h, w)[c] -
+            cv_img_ref.at<cv::Vec3b>(h, w)[c]);
+      }
+    }
+  }
+  EXPECT_LT(difference / (cv_img.rows * cv_img.cols * 3), 8);
+  // 目标尺寸大于一半时按原尺寸解码，结果与原来一致
+  cv_img = ReadImageToCVMat(filename, 256, 256, false, true);
+  cv_img_ref = ReadImageToCVMat(filename, 256, 256, false);
+  EXPECT_EQ(cv_img.channels(), 1);
+  for (int h = 0; h < cv_img.rows; ++h) {
+    for (int w = 0; w < cv_img.cols; ++w) {
+      EXPECT_EQ(cv_img.at<uchar>(h, w), cv_img_ref.at<uchar>(h, w));
+    }
+  }
+}
+
 TEST_F(IOTest, TestCVMatToDatum) {
   string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
   cv::Mat cv_img = ReadImageToCVMat(filename);
@@ -340,6 +370,53 @@ TEST_F(IOTest, TestDecodeDatumToCVMatContent) {
   }
 }
 
+TEST_F(IOTest, TestDecodeDatumToCVMatReduced) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  Datum datum;
+  EXPECT_TRUE(ReadFileToDatum(filename, &datum));
+  cv::Mat cv_img = DecodeDatumToCVMat(datum, true, 80, 100, true);
+  cv::Mat cv_img_ref = ReadImageToCVMat(filename, 80, 100, true, true);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, 80);
+  EXPECT_EQ(cv_img.cols, 100);
+  for (int h = 0; h < cv_img.rows; ++h) {
+    for (int w = 0; w < cv_img.cols; ++w) {
+      for (int c = 0; c < 3; ++c) {
+        EXPECT_EQ(cv_img.at<cv::Vec3b>(h, w)[c],
+            cv_img_ref.at<cv::Vec3b>(h, w)[c]);
+      }
+    }
+  }
+}
+
+TEST_F(IOTest, TestDecodeDatumToCVMatReducedExifOrientation) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  Datum datum;
+  EXPECT_TRUE(ReadFileToDatum(filename, &datum));
+  // 在 SOI 之后插入 EXIF 方向为 6 (顺时针旋转 90 度) 的 APP1 段
+  const char exif[] =
+      "\xFF\xE1\x00\x22" "Exif\0\0" "MM\x00\x2A\x00\x00\x00\x08"
+      "\x00\x01" "\x01\x12\x00\x03\x00\x00\x00\x01\x00\x06\x00\x00"
+      "\x00\x00\x00\x00";
+  string data = datum.data();
+  data.insert(2, exif, sizeof(exif) - 1);
+  datum.set_data(data);
+  // 旋转后为 480 x 360，1/2 尺寸解码的 180 列不够 200 列，只能按原尺寸解码
+  cv::Mat cv_img = DecodeDatumToCVMat(datum, true, 100, 200, true);
+  cv::Mat cv_img_ref = DecodeDatumToCVMat(datum, true, 100, 200, false);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, 100);
+  EXPECT_EQ(cv_img.cols, 200);
+  for (int h = 0; h < cv_img.rows; ++h) {
+    for (int w = 0; w < cv_img.cols; ++w) {
+      for (int c = 0; c < 3; ++c) {
+        EXPECT_EQ(cv_img.at<cv::Vec3b>(h, w)[c],
+            cv_img_ref.at<cv::Vec3b>(h, w)[c]);
+      }
+    }
+  }
+}
+
 TEST_F(IOTest, TestDecodeDatumNative) {
   string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
   Datum datum;
@@ -0,0 +1,203 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/hdf5.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class MappedWeightsTest : public CPUDeviceTest<Dtype> {
+ protected:
+  MappedWeightsTest() {
+    MakeTempDir(&temp_dir_);
+  }
+
+  shared_ptr<Net<Dtype> > InitNet(int seed) {
+    const string proto =
+        "name: 'MappedNet' "
+        "layer { name: 'data' type: 'DummyData' top: 'data' "
+        "  dummy_data_param { shape { dim: 2 dim: 3 dim: 4 dim: 4 } } } "
+        "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+        "  convolution_param { num_output: 2 kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } } } "
+        "layer { name: 'ip' type: 'InnerProduct' bottom: 'conv' top: 'ip' "
+        "  inner_product_param { num_output: 5 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } } } ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    Caffe::set_random_seed(seed);
+    return shared_ptr<Net<Dtype> >(new Net<Dtype>(param));
+  }
+
+  void ExpectParamsEqual(const Net<Dtype>& expected, const Net<Dtype>& net) {
+    ASSERT_EQ(expected.params().size(), net.params().size());
+    for (int i = 0; i < net.params().size(); ++i) {
+      const Blob<Dtype>& expected_blob = *expected.params()[i];
+      const Blob<Dtype>& blob = *net.params()[i];
+      ASSERT_TRUE(expected_blob.shape() == blob.shape());
+      for (int j = 0; j < blob.count(); ++j) {
+        EXPECT_EQ(expected_blob.cpu_data()[j], blob.cpu_data()[j]);
+      }
+    }
+  }
+
+  string temp_dir_;
+};
+
+TYPED_TEST_CASE(MappedWeightsTest, TestDtypes);
+
+TYPED_TEST(MappedWeightsTest, TestWriteRead) {
+  typedef TypeParam Dtype;
+  shared_ptr<Net<Dtype> > net = this->InitNet(1701);
+  NetParameter param;
+  net->ToProto(&param);
+  // A blob with the legacy 4-D shape fields.
+  BlobProto* legacy = param.add_layer()->add_blobs();
+  param.mutable_layer(param.layer_size() - 1)->set_name("legacy");
+  legacy->set_num(1);
+  legacy->set_channels(1);
+  legacy->set_height(1);
+  legacy->set_width(3);
+  for (int i = 0; i < 3; ++i) {
+    legacy->add_data(i);
+  }
+  const string filename = this->temp_dir_ + "/net.caffeweights";
+  EXPECT_TRUE(IsMappedWeightsFile(filename));
+  EXPECT_FALSE(IsMappedWeightsFile(this->temp_dir_ + "/net.caffemodel"));
+  WriteMappedWeights(param, filename);
+
+  MappedWeights weights(filename);
+  const WeightsIndex& index = weights.index();
+  ASSERT_EQ(5, index.tensor_size());
+  EXPECT_TRUE(weights.layer_tensors("data") == NULL);
+  ASSERT_TRUE(weights.layer_tensors("ip") != NULL);
+  EXPECT_EQ(2, weights.layer_tensors("ip")->size());
+  EXPECT_EQ(2, (*weights.layer_tensors("ip"))[0]);
+  for (int i = 0; i < index.tensor_size(); ++i) {
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(weights.data(i)) % 64);
+  }
+  EXPECT_EQ(4, index.tensor(4).shape().dim_size());
+  EXPECT_EQ(WeightsIndex::FLOAT, index.tensor(4).type());
+  EXPECT_EQ(sizeof(Dtype) == sizeof(double) ? WeightsIndex::DOUBLE :
+      WeightsIndex::FLOAT, index.tensor(0).type());
+  for (int i = 0; i < net->params().size(); ++i) {
+    const Blob<Dtype>& blob = *net->params()[i];
+    EXPECT_EQ(blob.count(), MappedWeights::count(index.tensor(i)));
+    const Dtype* data = static_cast<const Dtype*>(weights.data(i));
+    for (int j = 0; j < blob.count(); ++j) {
+      EXPECT_EQ(blob.cpu_data()[j], data[j]);
+    }
+  }
+
+  NetParameter read_param;
+  ReadMappedWeights(filename, &read_param);
+  ASSERT_EQ(3, read_param.layer_size());
+  EXPECT_EQ("conv", read_param.layer(0).name());
+  EXPECT_EQ("legacy", read_param.layer(2).name());
+  ASSERT_EQ(3, read_param.layer(2).blobs(0).data_size());
+  EXPECT_EQ(2, read_param.layer(2).blobs(0).data(2));
+  shared_ptr<Net<Dtype> > read_net = this->InitNet(1702);
+  read_net->CopyTrainedLayersFrom(read_param);
+  this->ExpectParamsEqual(*net, *read_net);
+}
+
+TYPED_TEST(MappedWeightsTest, TestCopyTrainedLayersFrom) {
+  typedef TypeParam Dtype;
+  shared_ptr<Net<Dtype> > net = this->InitNet(1701);
+  NetParameter param;
+  net->ToProto(&param);
+  const string filename = this->temp_dir_ + "/net.caffeweights";
+  WriteMappedWeights(param, filename);
+
+  shared_ptr<Net<Dtype> > mapped_net = this->InitNet(1702);
+  mapped_net->CopyTrainedLayersFrom(filename);
+  this->ExpectParamsEqual(*net, *mapped_net);
+  // The blobs point into the mapping.
+  for (int i = 0; i < mapped_net->params().size(); ++i) {
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(
+        mapped_net->params()[i]->cpu_data()) % 64);
+  }
+  // Writing to a bound blob leaves the file unchanged.
+  mapped_net->params()[0]->mutable_cpu_data()[0] += 1;
+  EXPECT_NE(net->params()[0]->cpu_data()[0],
+      mapped_net->params()[0]->cpu_data()[0]);
+  shared_ptr<Net<Dtype> > other_net = this->InitNet(1703);
+  other_net->CopyTrainedLayersFrom(filename);
+  this->ExpectParamsEqual(*net, *other_net);
+
+  // Packed params are copied rather than bound.
+  shared_ptr<Net<Dtype> > flat_net = this->InitNet(1704);
+  flat_net->PackFlatParams();
+  flat_net->CopyTrainedLayersFrom(filename);
+  this->ExpectParamsEqual(*net, *flat_net);
+  EXPECT_EQ(flat_net->cpu_flat_data(), flat_net->params()[0]->cpu_data());
+}
+
+TYPED_TEST(MappedWeightsTest, TestSharedParams) {
+  typedef TypeParam Dtype;
+  const string proto =
+      "name: 'SharedNet' "
+      "layer { name: 'data' type: 'DummyData' top: 'data' "
+      "  dummy_data_param { shape { dim: 2 dim: 4 } } } "
+      "layer { name: 'ip1' type: 'InnerProduct' bottom: 'data' top: 'ip1' "
+      "  param { name: 'shared' } "
+      "  inner_product_param { num_output: 4 bias_term: false "
+      "    weight_filler { type: 'gaussian' } } } "
+      "layer { name: 'ip2' type: 'InnerProduct' bottom: 'ip1' top: 'ip2' "
+      "  param { name: 'shared' } "
+      "  inner_product_param { num_output: 4 bias_term: false "
+      "    weight_filler { type: 'gaussian' } } } ";
+  NetParameter net_param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &net_param));
+  Caffe::set_random_seed(1701);
+  Net<Dtype> net(net_param);
+  NetParameter param;
+  net.ToProto(&param);
+  // Only the layer that shares the param is in the file, not its owner.
+  param.mutable_layer()->DeleteSubrange(1, 1);
+  ASSERT_EQ("ip2", param.layer(1).name());
+  const string filename = this->temp_dir_ + "/shared.caffeweights";
+  WriteMappedWeights(param, filename);
+  Caffe::set_random_seed(1702);
+  Net<Dtype> mapped_net(net_param);
+  mapped_net.CopyTrainedLayersFrom(filename);
+  const Blob<Dtype>& expected = *net.layer_by_name("ip2")->blobs()[0];
+  for (int i = 0; i < 2; ++i) {
+    const Blob<Dtype>& blob = *mapped_net.layers()[i + 1]->blobs()[0];
+    ASSERT_EQ(expected.count(), blob.count());
+    for (int j = 0; j < blob.count(); ++j) {
+      EXPECT_EQ(expected.cpu_data()[j], blob.cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(MappedWeightsTest, TestHDF5) {
+  typedef TypeParam Dtype;
+  shared_ptr<Net<Dtype> > net = this->InitNet(1701);
+  const string filename = this->temp_dir_ + "/net.h5";
+  net->ToHDF5(filename);
+  NetParameter param;
+  hdf5_load_net_weights(filename, &param);
+  const string mapped_filename = this->temp_dir_ + "/net.caffeweights";
+  WriteMappedWeights(param, mapped_filename);
+  ReadMappedWeights(mapped_filename, &param);
+  const string copy_filename = this->temp_dir_ + "/copy.h5";
+  hdf5_save_net_weights(param, copy_filename);
+  shared_ptr<Net<Dtype> > hdf5_net = this->InitNet(1702);
+  hdf5_net->CopyTrainedLayersFrom(copy_filename);
+  this->ExpectParamsEqual(*net, *hdf5_net);
+}
+
+}  // namespace caffe
@@ -1,6 +1,8 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
 #include <cmath>  // for std::fabs
+#include <limits>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -8,6 +10,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -119,6 +122,56 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(CPUMathFunctionsTest, TestParallelElementwise) {
+  const int n = this->blob_bottom_->count();
+  const TypeParam* a = this->blob_bottom_->cpu_data();
+  const TypeParam* b = this->blob_top_->cpu_data();
+  vector<TypeParam> sum(n), product(n), axpby(b, b + n);
+  // Serial reference results
+  caffe_add(n, a, b, &sum[0]);
+  caffe_mul(n, a, b, &product[0]);
+  caffe_cpu_axpby(n, TypeParam(2), a, TypeParam(-3), &axpby[0]);
+  // Split the arrays into unaligned chunks across several threads.
+  const int threshold = caffe_cpu_parallel_threshold();
+  caffe_set_cpu_parallel_threshold(1001);
+  ThreadPool::SetGlobalThreads(4);
+  vector<TypeParam> y(n), in_place(a, a + n), axpby_parallel(b, b + n);
+  caffe_add(n, a, b, &y[0]);
+  caffe_mul(n, &in_place[0], b, &in_place[0]);
+  caffe_cpu_axpby(n, TypeParam(2), a, TypeParam(-3), &axpby_parallel[0]);
+  ThreadPool::SetGlobalThreads(1);
+  caffe_set_cpu_parallel_threshold(threshold);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(sum[i], y[i]);
+    EXPECT_EQ(product[i], in_place[i]);
+    EXPECT_NEAR(axpby[i], axpby_parallel[i], 1e-4);
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestAxpbyZeroBeta) {
+  // beta == 0 overwrites y, as the BLAS scal it replaces did: NaN and Inf
+  // already in y must not reach the result.
+  const int n = this->blob_bottom_->count();
+  const TypeParam* x = this->blob_bottom_->cpu_data();
+  vector<TypeParam> y(n, std::numeric_limits<TypeParam>::quiet_NaN());
+  y[1] = std::numeric_limits<TypeParam>::infinity();
+  caffe_cpu_axpby(n, TypeParam(2), x, TypeParam(0), &y[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(2 * x[i], y[i]);
+  }
+  // The same across several threads
+  const int threshold = caffe_cpu_parallel_threshold();
+  caffe_set_cpu_parallel_threshold(1001);
+  ThreadPool::SetGlobalThreads(4);
+  vector<TypeParam> y_parallel(n, std::numeric_limits<TypeParam>::quiet_NaN());
+  caffe_cpu_axpby(n, TypeParam(2), x, TypeParam(0), &y_parallel[0]);
+  ThreadPool::SetGlobalThreads(1);
+  caffe_set_cpu_parallel_threshold(threshold);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(2 * x[i], y_parallel[i]);
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
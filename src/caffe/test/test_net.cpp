@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <string>
 #include <utility>
 #include <vector>
@@ -68,8 +70,9 @@ class NetTest : public MultiDeviceTest<TypeParam> {
   }
 
   virtual void InitTinyNet(const bool force_backward = false,
-                           const bool accuracy_layer = false) {
-    string proto =
+                           const bool accuracy_layer = false,
+                           const string& net_options = "") {
+    string proto = net_options +
         "name: 'TinyTestNetwork' "
         "layer { "
         "  name: 'data' "
@@ -564,8 +567,8 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
-  virtual void InitReshapableNet() {
-    const string& proto =
+  virtual void InitReshapableNet(const string& net_options = "") {
+    const string& proto = net_options +
         "name: 'ReshapableNetwork' "
         "layer { "
         "  name: 'data' "
@@ -2446,6 +2449,181 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestShareActivations) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> blob1(2, 3, 12, 10);
+  Blob<Dtype> blob2(4, 3, 19, 21);
+  filler.Fill(&blob1);
+  filler.Fill(&blob2);
+  const string options[3] = {
+    "state { phase: TEST } ",
+    "state { phase: TEST } share_activations: true ",
+    "state { phase: TEST } share_activations: true keep_blob: 'conv1' "
+  };
+  vector<shared_ptr<Net<Dtype> > > nets;
+  for (int i = 0; i < 3; ++i) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitReshapableNet(options[i]);
+    nets.push_back(this->net_);
+  }
+  // conv1 is dead once pool1 has run, so norm1 can reuse its memory.
+  EXPECT_NE(nets[0]->blob_by_name("conv1")->data(),
+      nets[0]->blob_by_name("norm1")->data());
+  EXPECT_EQ(nets[1]->blob_by_name("conv1")->data(),
+      nets[1]->blob_by_name("norm1")->data());
+  EXPECT_NE(nets[2]->blob_by_name("conv1")->data(),
+      nets[2]->blob_by_name("norm1")->data());
+  for (int pass = 0; pass < 3; ++pass) {
+    const Blob<Dtype>& input = (pass == 1) ? blob2 : blob1;
+    for (int i = 0; i < nets.size(); ++i) {
+      Blob<Dtype>* input_blob = nets[i]->input_blobs()[0];
+      input_blob->ReshapeLike(input);
+      caffe_copy(input.count(), input.cpu_data(),
+          input_blob->mutable_cpu_data());
+      nets[i]->Reshape();
+      nets[i]->Forward();
+    }
+    for (int i = 1; i < nets.size(); ++i) {
+      const Blob<Dtype>* expected = nets[0]->output_blobs()[0];
+      const Blob<Dtype>* output = nets[i]->output_blobs()[0];
+      ASSERT_EQ(expected->count(), output->count());
+      for (int j = 0; j < expected->count(); ++j) {
+        EXPECT_EQ(expected->cpu_data()[j], output->cpu_data()[j]);
+      }
+    }
+    // A kept blob still holds its value after the forward pass.
+    const Blob<Dtype>* expected = nets[0]->blob_by_name("conv1").get();
+    const Blob<Dtype>* kept = nets[2]->blob_by_name("conv1").get();
+    for (int j = 0; j < expected->count(); ++j) {
+      EXPECT_EQ(expected->cpu_data()[j], kept->cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestProfiler) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitTinyNet();
+  shared_ptr<Profiler> profiler(new Profiler());
+  this->net_->set_profiler(profiler);
+  this->net_->Forward();
+  this->net_->Backward();
+  // The data layer needs no backward pass.
+  const vector<Profiler::Event> events = profiler->events();
+  ASSERT_EQ(5, events.size());
+  EXPECT_EQ("innerproduct", events[1].name);
+  EXPECT_EQ("InnerProduct", events[1].type);
+  EXPECT_EQ("Forward", events[1].phase);
+  EXPECT_EQ((5 * 24 + 1000 * 24 + 1000) * sizeof(Dtype),
+      events[1].bytes_read);
+  EXPECT_EQ(5 * 1000 * sizeof(Dtype), events[1].bytes_written);
+  EXPECT_EQ(5 * 1000 * sizeof(Dtype), events[1].bytes_allocated);
+  EXPECT_EQ("Backward", events[3].phase);
+  EXPECT_EQ("loss", events[3].name);
+  EXPECT_EQ("innerproduct", events[4].name);
+  // The top diff is allocated by the backward pass of the loss.
+  EXPECT_EQ(2 * 5 * 1000 * sizeof(Dtype), events[4].bytes_allocated);
+  for (int i = 1; i < events.size(); ++i) {
+    EXPECT_GE(events[i].start_us, events[i - 1].start_us);
+  }
+  // Profiling stops when the profiler is removed.
+  this->net_->set_profiler(shared_ptr<Profiler>());
+  this->net_->Forward();
+  EXPECT_EQ(5, profiler->events().size());
+}
+
+template <typename Dtype>
+static void ForwardInOtherMode(Net<Dtype>* net, Dtype* loss) {
+  // 线程自己的状态与网络的上下文不同，网络仍在自己的上下文中运行
+  Caffe::set_mode(Caffe::mode() == Caffe::CPU ? Caffe::GPU : Caffe::CPU);
+  Caffe::set_random_seed(1);
+  net->Forward(loss);
+}
+
+TYPED_TEST(NetTest, TestContext) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitTinyNet();
+  Caffe::set_random_seed(this->seed_);
+  Dtype expected_loss;
+  this->net_->Forward(&expected_loss);
+
+  shared_ptr<Caffe> context = Caffe::CreateContext();
+  {
+    Caffe::ContextScope scope(context.get());
+    Caffe::set_random_seed(this->seed_);
+  }
+  this->net_->set_context(context);
+  EXPECT_EQ(context, this->net_->context());
+  Dtype loss = 0;
+  boost::thread thread(boost::bind(&ForwardInOtherMode<Dtype>,
+      this->net_.get(), &loss));
+  thread.join();
+  EXPECT_EQ(expected_loss, loss);
+}
+
+TYPED_TEST(NetTest, TestFlatParams) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitTinyNet(false, false, "state { phase: TRAIN } ");
+  shared_ptr<Net<Dtype> > net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitTinyNet(false, false, "state { phase: TRAIN } flat_params: true ");
+  shared_ptr<Net<Dtype> > flat_net = this->net_;
+  EXPECT_FALSE(net->has_flat_params());
+  ASSERT_TRUE(flat_net->has_flat_params());
+  // The weights (1000 x 24) and the bias (1000) start on 64-byte boundaries.
+  const vector<Blob<Dtype>*>& params = flat_net->learnable_params();
+  ASSERT_EQ(2, params.size());
+  const vector<int>& offsets = flat_net->flat_param_offsets();
+  EXPECT_EQ(0, offsets[0]);
+  EXPECT_EQ(24000, offsets[1]);
+  EXPECT_EQ(0, flat_net->flat_params_count() * sizeof(Dtype) % 64);
+  EXPECT_GE(flat_net->flat_params_count(), 25000);
+  const Dtype* flat_data = flat_net->cpu_flat_data();
+  const Dtype* flat_diff = flat_net->cpu_flat_diff();
+  EXPECT_EQ(0, reinterpret_cast<size_t>(flat_data) % 64);
+  EXPECT_EQ(0, reinterpret_cast<size_t>(flat_diff) % 64);
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_EQ(flat_data + offsets[i], params[i]->cpu_data());
+    EXPECT_EQ(flat_diff + offsets[i], params[i]->cpu_diff());
+  }
+  // Training steps give the same params as the unpacked net. The data layer
+  // refills its gaussian data on every forward, so both nets reseed first.
+  for (int iter = 0; iter < 2; ++iter) {
+    net->ClearParamDiffs();
+    flat_net->ClearParamDiffs();
+    Caffe::set_random_seed(this->seed_ + iter);
+    net->ForwardBackward();
+    Caffe::set_random_seed(this->seed_ + iter);
+    flat_net->ForwardBackward();
+    net->Update();
+    flat_net->Update();
+    for (int i = 0; i < params.size(); ++i) {
+      const Blob<Dtype>* expected = net->learnable_params()[i];
+      for (int j = 0; j < expected->count(); ++j) {
+        EXPECT_EQ(expected->cpu_diff()[j], params[i]->cpu_diff()[j]);
+        EXPECT_EQ(expected->cpu_data()[j], params[i]->cpu_data()[j]);
+      }
+    }
+  }
+  flat_net->ClearParamDiffs();
+  flat_diff = flat_net->cpu_flat_diff();
+  for (int i = 0; i < flat_net->flat_params_count(); ++i) {
+    EXPECT_EQ(0, flat_diff[i]);
+  }
+  // Packing an existing net keeps its values.
+  net->PackFlatParams();
+  ASSERT_TRUE(net->has_flat_params());
+  flat_data = net->cpu_flat_data();
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(params[i]->cpu_data()[j], flat_data[offsets[i] + j]);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
@@ -0,0 +1,57 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/profiler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ProfilerTest : public ::testing::Test {};
+
+TEST_F(ProfilerTest, TestSummaryAndEventLimit) {
+  Profiler profiler(3);
+  for (int i = 0; i < 2; ++i) {
+    profiler.Record("conv1", "Convolution", "Forward", profiler.Now(),
+        100, 10, 1000);
+    profiler.Record("conv1", "Convolution", "Backward", profiler.Now(),
+        200, 20, 1000);
+  }
+  // Only the first three events are kept, but all four are summarized.
+  EXPECT_EQ(3, profiler.events().size());
+  const vector<Profiler::Summary> summary = profiler.summary();
+  ASSERT_EQ(2, summary.size());
+  EXPECT_EQ("Forward", summary[0].phase);
+  EXPECT_EQ(2, summary[0].calls);
+  EXPECT_EQ(200, summary[0].bytes_read);
+  EXPECT_EQ(20, summary[0].bytes_written);
+  EXPECT_EQ("Backward", summary[1].phase);
+  EXPECT_EQ(400, summary[1].bytes_read);
+  EXPECT_EQ(1000, summary[1].bytes_allocated);
+  profiler.Clear();
+  EXPECT_EQ(0, profiler.events().size());
+  EXPECT_EQ(0, profiler.summary().size());
+}
+
+TEST_F(ProfilerTest, TestChromeTrace) {
+  Profiler profiler;
+  profiler.Record("layer \"a\"", "ReLU", "Forward", profiler.Now(), 1, 2, 3);
+  string filename;
+  MakeTempFilename(&filename);
+  profiler.WriteChromeTrace(filename);
+  std::ifstream in(filename.c_str());
+  std::stringstream trace;
+  trace << in.rdbuf();
+  EXPECT_EQ(0, trace.str().find("{\"traceEvents\":["));
+  EXPECT_NE(string::npos, trace.str().find("\"name\":\"layer \\\"a\\\"\""));
+  EXPECT_NE(string::npos, trace.str().find("\"ph\":\"X\""));
+  EXPECT_NE(string::npos, trace.str().find("\"bytes_allocated\":3"));
+}
+
+}  // namespace caffe
@@ -0,0 +1,145 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/shape_buckets.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class ShapeBucketsTest : public CPUDeviceTest<Dtype> {
+ protected:
+  ShapeBucketsTest() {
+    const string proto =
+        "name: 'BucketNet' "
+        "layer { name: 'data' type: 'Input' top: 'data' "
+        "  input_param { shape { dim: 1 dim: 1 dim: 4 dim: 4 } } } "
+        "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+        "  convolution_param { num_output: 2 kernel_size: 3 pad: 1 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } } } ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param_));
+    param_.mutable_state()->set_phase(TEST);
+    net_.reset(new Net<Dtype>(param_));
+    int shape_4[] = {1, 1, 4, 4};
+    int shape_8[] = {1, 1, 8, 8};
+    shapes_.push_back(vector<int>(shape_4, shape_4 + 4));
+    shapes_.push_back(vector<int>(shape_8, shape_8 + 4));
+  }
+
+  static vector<int> Shape(int height, int width) {
+    vector<int> shape(4, 1);
+    shape[2] = height;
+    shape[3] = width;
+    return shape;
+  }
+
+  NetParameter param_;
+  shared_ptr<Net<Dtype> > net_;
+  vector<vector<int> > shapes_;
+};
+
+TYPED_TEST_CASE(ShapeBucketsTest, TestDtypes);
+
+TYPED_TEST(ShapeBucketsTest, TestFind) {
+  typedef TypeParam Dtype;
+  ShapeBuckets<Dtype> buckets(this->param_, this->net_, this->shapes_);
+  ASSERT_EQ(2, buckets.size());
+  EXPECT_EQ(this->net_, buckets.net(0));
+  EXPECT_EQ(0, buckets.Find(this->Shape(4, 4)));
+  EXPECT_EQ(0, buckets.Find(this->Shape(3, 2)));
+  EXPECT_EQ(1, buckets.Find(this->Shape(5, 7)));
+  EXPECT_EQ(1, buckets.Find(this->Shape(8, 1)));
+  EXPECT_EQ(-1, buckets.Find(this->Shape(9, 2)));
+  EXPECT_EQ(-1, buckets.Find(vector<int>(3, 1)));
+  vector<int> batch_of_two = this->Shape(4, 4);
+  batch_of_two[0] = 2;
+  EXPECT_EQ(-1, buckets.Find(batch_of_two));
+  for (int i = 0; i < buckets.size(); ++i) {
+    EXPECT_TRUE(buckets.net(i)->input_blobs()[0]->shape() == this->shapes_[i]);
+    EXPECT_EQ(this->net_->params()[0]->cpu_data(),
+        buckets.net(i)->params()[0]->cpu_data());
+  }
+}
+
+TYPED_TEST(ShapeBucketsTest, TestWinogradWeightsShared) {
+  typedef TypeParam Dtype;
+  this->param_.mutable_layer(1)->mutable_convolution_param()->set_engine(
+      ConvolutionParameter_Engine_WINOGRAD);
+  this->net_.reset(new Net<Dtype>(this->param_));
+  // 4x4 outputs use F(2x2,3x3), 8x8 and 10x10 outputs share F(4x4,3x3)
+  int shape_10[] = {1, 1, 10, 10};
+  this->shapes_.push_back(vector<int>(shape_10, shape_10 + 4));
+  ShapeBuckets<Dtype> buckets(this->param_, this->net_, this->shapes_);
+  // conv 2 x 1 x 3 x 3 + 2, transformed 16 x 2 x 1 and 36 x 2 x 1
+  EXPECT_EQ((20 + 32 + 72) * sizeof(Dtype), buckets.weights_bytes());
+  vector<Dtype> data(10 * 10, Dtype(1));
+  for (int i = 0; i < buckets.size(); ++i) {
+    const vector<int>& shape = buckets.shape(i);
+    ASSERT_EQ(i, buckets.Prepare(&data[0], shape));
+    buckets.net(i)->Forward();
+  }
+  EXPECT_EQ((20 + 32 + 72) * sizeof(Dtype), buckets.weights_bytes());
+}
+
+TYPED_TEST(ShapeBucketsTest, TestPrepare) {
+  typedef TypeParam Dtype;
+  ShapeBuckets<Dtype> buckets(this->param_, this->net_, this->shapes_);
+  vector<Dtype> data(3 * 5);
+  for (int i = 0; i < data.size(); ++i) {
+    data[i] = i + 1;
+  }
+  ASSERT_EQ(1, buckets.Prepare(&data[0], this->Shape(3, 5)));
+  const Dtype* input = buckets.net(1)->input_blobs()[0]->cpu_data();
+  for (int h = 0; h < 8; ++h) {
+    for (int w = 0; w < 8; ++w) {
+      const Dtype expected = (h < 3 && w < 5) ? data[h * 5 + w] : 0;
+      EXPECT_EQ(expected, input[h * 8 + w]);
+    }
+  }
+}
+
+TYPED_TEST(ShapeBucketsTest, TestSwitchWithoutReshape) {
+  typedef TypeParam Dtype;
+  ShapeBuckets<Dtype> buckets(this->param_, this->net_, this->shapes_);
+  // 参照：直接 Reshape 到 8 x 8 的网络
+  Net<Dtype> reference(this->param_);
+  reference.ShareTrainedLayersWith(this->net_.get());
+  reference.input_blobs()[0]->Reshape(this->shapes_[1]);
+  reference.Reshape();
+  vector<Dtype> data(64);
+  for (int i = 0; i < data.size(); ++i) {
+    data[i] = Dtype(i % 7) / 7;
+  }
+  std::copy(data.begin(), data.end(),
+      reference.input_blobs()[0]->mutable_cpu_data());
+  const Blob<Dtype>& expected = *reference.Forward()[0];
+
+  vector<const Dtype*> outputs(buckets.size());
+  for (int iter = 0; iter < 3; ++iter) {
+    for (int i = 0; i < buckets.size(); ++i) {
+      const vector<int>& shape = this->shapes_[i];
+      ASSERT_EQ(i, buckets.Prepare(&data[0], shape));
+      const Blob<Dtype>& output = *buckets.net(i)->Forward()[0];
+      // 在桶之间切换不会重新分配输出
+      if (iter == 0) {
+        outputs[i] = output.cpu_data();
+      }
+      EXPECT_EQ(outputs[i], output.cpu_data());
+      EXPECT_EQ(shape[3], output.shape(3));
+    }
+    const Blob<Dtype>& output = *buckets.net(1)->output_blobs()[0];
+    ASSERT_EQ(expected.count(), output.count());
+    for (int j = 0; j < output.count(); ++j) {
+      EXPECT_EQ(expected.cpu_data()[j], output.cpu_data()[j]);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,93 @@
+#include <boost/thread.hpp>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/util/spsc_queue.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class SPSCQueueTest : public ::testing::Test {};
+
+class QueueProducerThread : public InternalThread {
+ public:
+  QueueProducerThread(SPSCQueue<int>* queue, int count)
+      : queue_(queue), count_(count) {}
+
+ protected:
+  virtual void InternalThreadEntry() {
+    for (int i = 0; i < count_; ++i) {
+      queue_->push(i);
+    }
+  }
+
+  SPSCQueue<int>* queue_;
+  int count_;
+};
+
+class QueueConsumerThread : public InternalThread {
+ public:
+  explicit QueueConsumerThread(SPSCQueue<int>* queue)
+      : queue_(queue), interrupted_(false) {}
+  bool interrupted() const { return interrupted_; }
+
+ protected:
+  virtual void InternalThreadEntry() {
+    try {
+      queue_->pop();
+    } catch (boost::thread_interrupted&) {
+      interrupted_ = true;
+    }
+  }
+
+  SPSCQueue<int>* queue_;
+  bool interrupted_;
+};
+
+TEST_F(SPSCQueueTest, TestTryPushPop) {
+  SPSCQueue<int> queue(2);
+  int value;
+  EXPECT_EQ(2, queue.capacity());
+  EXPECT_FALSE(queue.try_pop(&value));
+  EXPECT_TRUE(queue.try_push(1));
+  EXPECT_TRUE(queue.try_push(2));
+  EXPECT_FALSE(queue.try_push(3));
+  EXPECT_EQ(2, queue.size());
+  EXPECT_TRUE(queue.try_pop(&value));
+  EXPECT_EQ(1, value);
+  EXPECT_TRUE(queue.try_push(3));
+  EXPECT_EQ(2, queue.pop());
+  EXPECT_EQ(3, queue.pop());
+  EXPECT_EQ(0, queue.size());
+}
+
+TEST_F(SPSCQueueTest, TestProducerConsumer) {
+  const int kCount = 20000;
+  SPSCQueue<int> queue(3);
+  QueueProducerThread producer(&queue, kCount);
+  producer.StartInternalThread();
+  for (int i = 0; i < kCount; ++i) {
+    ASSERT_EQ(i, queue.pop());
+  }
+  producer.StopInternalThread();
+  EXPECT_EQ(0, queue.size());
+  // A queue of three elements cannot hold 20000 pushes without one side
+  // waiting for the other at least once.
+  EXPECT_GT(queue.producer_stalls() + queue.consumer_stalls(), 0);
+}
+
+TEST_F(SPSCQueueTest, TestInterruptParkedConsumer) {
+  SPSCQueue<int> queue(1);
+  QueueConsumerThread consumer(&queue);
+  consumer.StartInternalThread();
+  // Give the consumer time to spin and park on the empty queue.
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  consumer.StopInternalThread();
+  EXPECT_TRUE(consumer.interrupted());
+  EXPECT_EQ(1, queue.consumer_stalls());
+}
+
+}  // namespace caffe
@@ -0,0 +1,56 @@
+#include <boost/bind.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ThreadPoolTest : public ::testing::Test {};
+
+static void MarkTask(vector<int>* counts, int index) {
+  ++(*counts)[index];
+}
+
+static void RunNested(ThreadPool* pool, vector<vector<int> >* counts,
+    int index) {
+  pool->Run((*counts)[index].size(),
+      boost::bind(&MarkTask, &(*counts)[index], _1));
+}
+
+TEST_F(ThreadPoolTest, TestRunsEveryTaskOnce) {
+  for (int num_threads = 1; num_threads <= 4; ++num_threads) {
+    ThreadPool pool(num_threads);
+    EXPECT_EQ(num_threads, pool.num_threads());
+    vector<int> counts(37, 0);
+    pool.Run(counts.size(), boost::bind(&MarkTask, &counts, _1));
+    for (int i = 0; i < counts.size(); ++i) {
+      EXPECT_EQ(1, counts[i]);
+    }
+  }
+}
+
+TEST_F(ThreadPoolTest, TestNestedRun) {
+  ThreadPool pool(3);
+  vector<vector<int> > counts(5, vector<int>(7, 0));
+  pool.Run(counts.size(), boost::bind(&RunNested, &pool, &counts, _1));
+  for (int i = 0; i < counts.size(); ++i) {
+    for (int j = 0; j < counts[i].size(); ++j) {
+      EXPECT_EQ(1, counts[i][j]);
+    }
+  }
+}
+
+TEST_F(ThreadPoolTest, TestGlobalThreads) {
+  EXPECT_EQ(1, ThreadPool::global_threads());
+  ThreadPool::SetGlobalThreads(2);
+  EXPECT_EQ(2, ThreadPool::global_threads());
+  ThreadPool::SetGlobalThreads(1);
+  EXPECT_EQ(1, ThreadPool::global_threads());
+}
+
+}  // namespace caffe
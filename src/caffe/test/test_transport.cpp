@@ -0,0 +1,87 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/transport.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class TransportTest : public ::testing::Test {
+ protected:
+  TransportTest() {
+    MakeTempDir(&temp_dir_);
+    address_ = "unix:" + temp_dir_ + "/rank";
+  }
+
+  // 每个 rank 的数据为 rank * 1000 + i，求和后为 sum(rank) * 1000 + size * i
+  static void RunRank(const string& address, int rank, int size, int count,
+      const string& algorithm, vector<Dtype>* result) {
+    shared_ptr<Transport> transport = Transport::Create(address, rank, size);
+    result->resize(count);
+    for (int i = 0; i < count; ++i) {
+      (*result)[i] = rank * 1000 + i;
+    }
+    Dtype* data = count > 0 ? &(*result)[0] : NULL;
+    if (algorithm == "ring") {
+      RingAllReduce(transport.get(), data, count);
+    } else if (algorithm == "tree") {
+      TreeAllReduce(transport.get(), data, count);
+    } else {
+      TreeBroadcast(transport.get(), data, count);
+    }
+  }
+
+  void Run(int size, int count, const string& algorithm) {
+    vector<vector<Dtype> > results(size);
+    boost::thread_group threads;
+    for (int rank = 0; rank < size; ++rank) {
+      threads.create_thread(boost::bind(&TransportTest::RunRank, address_,
+          rank, size, count, algorithm, &results[rank]));
+    }
+    threads.join_all();
+    const Dtype rank_sum = size * (size - 1) / 2;
+    for (int rank = 0; rank < size; ++rank) {
+      ASSERT_EQ(count, results[rank].size());
+      for (int i = 0; i < count; ++i) {
+        const Dtype expected = (algorithm == "broadcast") ? i :
+            rank_sum * 1000 + size * i;
+        EXPECT_EQ(expected, results[rank][i]);
+      }
+    }
+  }
+
+  string temp_dir_;
+  string address_;
+};
+
+TYPED_TEST_CASE(TransportTest, TestDtypes);
+
+TYPED_TEST(TransportTest, TestRingAllReduce) {
+  for (int size = 1; size <= 5; ++size) {
+    this->Run(size, 3, "ring");
+    this->Run(size, 100003, "ring");
+  }
+}
+
+TYPED_TEST(TransportTest, TestTreeAllReduce) {
+  for (int size = 1; size <= 5; ++size) {
+    this->Run(size, 3, "tree");
+    this->Run(size, 100003, "tree");
+  }
+}
+
+TYPED_TEST(TransportTest, TestTreeBroadcast) {
+  for (int size = 1; size <= 5; ++size) {
+    this->Run(size, 1000, "broadcast");
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,173 @@
+#include <cmath>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/fuse_layers.hpp"
+
+namespace caffe {
+
+// Reads the values of a blob, whichever precision they were saved in.
+static vector<double> ReadBlobValues(const BlobProto& blob) {
+  vector<double> values;
+  if (blob.double_data_size() > 0) {
+    values.assign(blob.double_data().begin(), blob.double_data().end());
+  } else {
+    values.assign(blob.data().begin(), blob.data().end());
+  }
+  return values;
+}
+
+static void WriteBlobValues(const vector<double>& values, bool double_data,
+    BlobProto* blob) {
+  blob->clear_data();
+  blob->clear_double_data();
+  for (int i = 0; i < values.size(); ++i) {
+    if (double_data) {
+      blob->add_double_data(values[i]);
+    } else {
+      blob->add_data(values[i]);
+    }
+  }
+}
+
+// Whether layer i + 1 has the given type and is the only reader of the output
+// of layer i, so that it can be folded into it.
+static bool CanFoldNext(const NetParameter& param, int i, const string& type,
+    const map<pair<int, int>, int>& top_idx_to_bottom_count) {
+  if (i + 1 >= param.layer_size()) {
+    return false;
+  }
+  const LayerParameter& layer_param = param.layer(i);
+  const LayerParameter& next_param = param.layer(i + 1);
+  if (next_param.type() != type || next_param.bottom_size() != 1 ||
+      next_param.top_size() != 1 ||
+      next_param.bottom(0) != layer_param.top(0)) {
+    return false;
+  }
+  map<pair<int, int>, int>::const_iterator it =
+      top_idx_to_bottom_count.find(make_pair(i, 0));
+  return it != top_idx_to_bottom_count.end() && it->second == 1;
+}
+
+void FuseInferenceLayers(const NetParameter& param, NetParameter* param_fused) {
+  param_fused->CopyFrom(param);
+  param_fused->clear_layer();
+  // Count the readers of every layer output, following in-place layers that
+  // reuse a blob name the same way InsertSplits does.
+  map<string, pair<int, int> > blob_name_to_last_top_idx;
+  map<pair<int, int>, int> top_idx_to_bottom_count;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      map<string, pair<int, int> >::const_iterator it =
+          blob_name_to_last_top_idx.find(layer_param.bottom(j));
+      if (it != blob_name_to_last_top_idx.end()) {
+        ++top_idx_to_bottom_count[it->second];
+      }
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      blob_name_to_last_top_idx[layer_param.top(j)] = make_pair(i, j);
+    }
+  }
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& conv_param = param.layer(i);
+    LayerParameter* fused_param = param_fused->add_layer();
+    fused_param->CopyFrom(conv_param);
+    if (conv_param.type() != "Convolution" || conv_param.top_size() != 1 ||
+        conv_param.blobs_size() == 0 ||
+        conv_param.convolution_param().axis() != 1 ||
+        conv_param.convolution_param().fuse_relu()) {
+      continue;
+    }
+    const int num_output = conv_param.convolution_param().num_output();
+    // The folded layers turn the convolution output y into
+    // multiplier * y + shift, per output channel.
+    vector<double> multiplier(num_output, 1.);
+    vector<double> shift(num_output, 0.);
+    int last = i;
+    // 1. BatchNorm: (y - mean) / sqrt(variance + eps)
+    if (CanFoldNext(param, last, "BatchNorm", top_idx_to_bottom_count)) {
+      const LayerParameter& bn_param = param.layer(last + 1);
+      const BatchNormParameter& bn = bn_param.batch_norm_param();
+      if (bn_param.blobs_size() == 3 &&
+          ReadBlobValues(bn_param.blobs(0)).size() == num_output &&
+          (!bn.has_use_global_stats() || bn.use_global_stats())) {
+        const vector<double> mean = ReadBlobValues(bn_param.blobs(0));
+        const vector<double> variance = ReadBlobValues(bn_param.blobs(1));
+        const double scale_factor = ReadBlobValues(bn_param.blobs(2))[0];
+        // 与 BatchNormLayer 一样，滑动平均系数为 0 时均值和方差按 0 处理
+        const double scale = scale_factor == 0 ? 0 : 1. / scale_factor;
+        for (int c = 0; c < num_output; ++c) {
+          const double inv_std =
+              1. / std::sqrt(variance[c] * scale + bn.eps());
+          multiplier[c] *= inv_std;
+          shift[c] = (shift[c] - mean[c] * scale) * inv_std;
+        }
+        ++last;
+      }
+    }
+    // 2. Scale: gamma * y + beta
+    if (CanFoldNext(param, last, "Scale", top_idx_to_bottom_count)) {
+      const LayerParameter& scale_param = param.layer(last + 1);
+      const ScaleParameter& scale = scale_param.scale_param();
+      if (scale_param.blobs_size() == 1 + scale.bias_term() &&
+          scale.axis() == 1 &&
+          scale.num_axes() == 1 &&
+          ReadBlobValues(scale_param.blobs(0)).size() == num_output) {
+        const vector<double> gamma = ReadBlobValues(scale_param.blobs(0));
+        const vector<double> beta = scale.bias_term() ?
+            ReadBlobValues(scale_param.blobs(1)) :
+            vector<double>(num_output, 0.);
+        for (int c = 0; c < num_output; ++c) {
+          multiplier[c] *= gamma[c];
+          shift[c] = shift[c] * gamma[c] + beta[c];
+        }
+        ++last;
+      }
+    }
+    if (last > i) {
+      // W' = multiplier * W, b' = multiplier * b + shift
+      const bool double_data = conv_param.blobs(0).double_data_size() > 0;
+      vector<double> weights = ReadBlobValues(conv_param.blobs(0));
+      CHECK_EQ(weights.size() % num_output, 0)
+          << "Unexpected weight count in layer " << conv_param.name();
+      const int weight_dim = weights.size() / num_output;
+      for (int c = 0; c < num_output; ++c) {
+        for (int k = 0; k < weight_dim; ++k) {
+          weights[c * weight_dim + k] *= multiplier[c];
+        }
+      }
+      WriteBlobValues(weights, double_data, fused_param->mutable_blobs(0));
+      vector<double> bias = conv_param.convolution_param().bias_term() ?
+          ReadBlobValues(conv_param.blobs(1)) : vector<double>(num_output, 0.);
+      for (int c = 0; c < num_output; ++c) {
+        bias[c] = multiplier[c] * bias[c] + shift[c];
+      }
+      if (!conv_param.convolution_param().bias_term()) {
+        fused_param->mutable_convolution_param()->set_bias_term(true);
+        fused_param->add_blobs()->mutable_shape()->add_dim(num_output);
+      }
+      WriteBlobValues(bias, double_data, fused_param->mutable_blobs(1));
+    }
+    // 3. ReLU, applied by the convolution as it writes its output
+    if (CanFoldNext(param, last, "ReLU", top_idx_to_bottom_count) &&
+        conv_param.convolution_param().engine() !=
+            ConvolutionParameter_Engine_CUDNN) {
+      fused_param->mutable_convolution_param()->set_fuse_relu(true);
+      fused_param->mutable_convolution_param()->set_relu_negative_slope(
+          param.layer(last + 1).relu_param().negative_slope());
+      ++last;
+    }
+    for (int j = i + 1; j <= last; ++j) {
+      LOG(INFO) << "Folding " << param.layer(j).type() << " layer "
+          << param.layer(j).name() << " into " << conv_param.name();
+    }
+    fused_param->set_top(0, param.layer(last).top(0));
+    i = last;
+  }
+}
+
+}  // namespace caffe
@@ -1,5 +1,6 @@
 #include "caffe/util/hdf5.hpp"
 
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -434,4 +435,82 @@ string hdf5_get_name_by_idx(hid_t loc_id, int idx) {
   return result;
 }
 
+// 与 Net::CopyTrainedLayersFromHDF5 相同的布局：/data/<layer>/<blob 序号>
+void hdf5_load_net_weights(const string& filename, NetParameter* param) {
+  hid_t file_hid = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  CHECK_GE(file_hid, 0) << "Couldn't open " << filename;
+  hid_t data_hid = H5Gopen2(file_hid, "data", H5P_DEFAULT);
+  CHECK_GE(data_hid, 0) << "Error reading weights from " << filename;
+  param->Clear();
+  const int num_layers = hdf5_get_num_links(data_hid);
+  for (int i = 0; i < num_layers; ++i) {
+    LayerParameter* layer = param->add_layer();
+    layer->set_name(hdf5_get_name_by_idx(data_hid, i));
+    hid_t layer_hid = H5Gopen2(data_hid, layer->name().c_str(), H5P_DEFAULT);
+    CHECK_GE(layer_hid, 0) << "Error reading weights from " << filename;
+    const int num_params = hdf5_get_num_links(layer_hid);
+    for (int j = 0; j < num_params; ++j) {
+      std::ostringstream dataset_name;
+      dataset_name << j;
+      // 共享的权值不会写入文件，无法还原其位置
+      CHECK(H5Lexists(layer_hid, dataset_name.str().c_str(), H5P_DEFAULT))
+          << "Layer " << layer->name() << " of " << filename
+          << " has shared weights, which cannot be converted.";
+      int ndims;
+      CHECK_GE(H5LTget_dataset_ndims(layer_hid, dataset_name.str().c_str(),
+          &ndims), 0) << "Error reading weights from " << filename;
+      std::vector<hsize_t> dims(ndims);
+      size_t type_size;
+      CHECK_GE(H5LTget_dataset_info(layer_hid, dataset_name.str().c_str(),
+          dims.data(), NULL, &type_size), 0)
+          << "Error reading weights from " << filename;
+      if (type_size == sizeof(double)) {
+        Blob<double> blob;
+        hdf5_load_nd_dataset(layer_hid, dataset_name.str().c_str(), 0,
+            kMaxBlobAxes, &blob);
+        blob.ToProto(layer->add_blobs());
+      } else {
+        Blob<float> blob;
+        hdf5_load_nd_dataset(layer_hid, dataset_name.str().c_str(), 0,
+            kMaxBlobAxes, &blob);
+        blob.ToProto(layer->add_blobs());
+      }
+    }
+    H5Gclose(layer_hid);
+  }
+  H5Gclose(data_hid);
+  H5Fclose(file_hid);
+}
+
+void hdf5_save_net_weights(const NetParameter& param, const string& filename) {
+  hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
+      H5P_DEFAULT);
+  CHECK_GE(file_hid, 0) << "Couldn't open " << filename << " to save weights.";
+  hid_t data_hid = H5Gcreate2(file_hid, "data", H5P_DEFAULT, H5P_DEFAULT,
+      H5P_DEFAULT);
+  CHECK_GE(data_hid, 0) << "Error saving weights to " << filename << ".";
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    hid_t layer_hid = H5Gcreate2(data_hid, layer.name().c_str(), H5P_DEFAULT,
+        H5P_DEFAULT, H5P_DEFAULT);
+    CHECK_GE(layer_hid, 0) << "Error saving weights to " << filename << ".";
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      std::ostringstream dataset_name;
+      dataset_name << j;
+      if (layer.blobs(j).double_data_size() > 0) {
+        Blob<double> blob;
+        blob.FromProto(layer.blobs(j));
+        hdf5_save_nd_dataset(layer_hid, dataset_name.str(), blob);
+      } else {
+        Blob<float> blob;
+        blob.FromProto(layer.blobs(j));
+        hdf5_save_nd_dataset(layer_hid, dataset_name.str(), blob);
+      }
+    }
+    H5Gclose(layer_hid);
+  }
+  H5Gclose(data_hid);
+  H5Fclose(file_hid);
+}
+
 }  // namespace caffe
@@ -0,0 +1,209 @@
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <stdint.h>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+#ifdef USE_MKL
+  #include "mkl.h"
+#endif
+
+#include "caffe/util/host_allocator.hpp"
+
+namespace caffe {
+
+class HostAllocator::sync {
+ public:
+  sync() : mode_(SYSTEM), cache_limit_(std::numeric_limits<size_t>::max()),
+      bytes_live_(0), bytes_cached_(0), hits_(0), misses_(0) {}
+
+  // 一个大小级别的空闲链表，只在取放块时加锁
+  struct FreeList {
+    boost::mutex mutex_;
+    vector<void*> blocks_;
+  };
+
+  // 分配和释放的快速路径无锁读取
+  boost::atomic<Mode> mode_;
+  boost::atomic<size_t> cache_limit_;
+  boost::atomic<size_t> bytes_live_;
+  boost::atomic<size_t> bytes_cached_;
+  boost::atomic<size_t> hits_;
+  boost::atomic<size_t> misses_;
+  FreeList free_lists_[kSizeClasses];
+};
+
+const size_t HostAllocator::kAlignment;
+const int HostAllocator::kSizeClasses;
+
+namespace {
+
+// 内存池块的头部，位于返回给调用者的指针之前 kAlignment 字节处
+struct BlockHeader {
+  uint32_t magic;
+  int32_t size_class;
+};
+
+const uint32_t kBlockMagic = 0xCAFEB10Cu;
+
+}  // namespace
+
+// 向系统申请按 kAlignment 对齐的内存
+static void* AlignedMalloc(size_t size) {
+#ifdef USE_MKL
+  void* ptr = mkl_malloc(size, HostAllocator::kAlignment);
+#else
+  void* ptr = NULL;
+  if (posix_memalign(&ptr, HostAllocator::kAlignment, size) != 0) {
+    ptr = NULL;
+  }
+#endif
+  CHECK(ptr) << "host allocation of size " << size << " failed";
+  return ptr;
+}
+
+static void AlignedFree(void* ptr) {
+#ifdef USE_MKL
+  mkl_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+HostAllocator::HostAllocator() : sync_(new sync()) {}
+
+HostAllocator& HostAllocator::Get() {
+  // Never destroyed: SyncedMemory held by other statics may be freed after
+  // any function-local static would have been.
+  static HostAllocator* allocator = new HostAllocator();
+  return *allocator;
+}
+
+int HostAllocator::SizeClass(size_t size, size_t* rounded) {
+  if (size <= kAlignment) {
+    *rounded = kAlignment;
+    return 0;
+  }
+  // 每个 2 的幂区间 (2^p, 2^(p+1)] 再均分为 4 级
+  size_t power = kAlignment;
+  int octave = 0;
+  while (power * 2 < size) {
+    power *= 2;
+    ++octave;
+  }
+  const size_t step = power / 4;
+  *rounded = (size + step - 1) / step * step;
+  return 1 + 4 * octave + static_cast<int>(*rounded / step - 5);
+}
+
+size_t HostAllocator::ClassSize(int size_class) {
+  if (size_class == 0) {
+    return kAlignment;
+  }
+  const size_t step = (kAlignment << ((size_class - 1) / 4)) / 4;
+  return (5 + (size_class - 1) % 4) * step;
+}
+
+size_t HostAllocator::RoundSize(size_t size) {
+  size_t rounded;
+  SizeClass(size, &rounded);
+  return rounded;
+}
+
+HostAllocator::Mode HostAllocator::mode() {
+  return sync_->mode_.load(boost::memory_order_relaxed);
+}
+
+void HostAllocator::set_mode(Mode mode) {
+  sync_->mode_.store(mode, boost::memory_order_relaxed);
+  if (mode == SYSTEM) {
+    Trim();
+  }
+}
+
+void HostAllocator::set_cache_limit(size_t bytes) {
+  sync_->cache_limit_.store(bytes);
+  TrimTo(bytes);
+}
+
+void* HostAllocator::Allocate(size_t size) {
+  size_t rounded;
+  const int size_class = SizeClass(size, &rounded);
+  sync::FreeList& list = sync_->free_lists_[size_class];
+  void* ptr = NULL;
+  {
+    boost::mutex::scoped_lock lock(list.mutex_);
+    if (!list.blocks_.empty()) {
+      ptr = list.blocks_.back();
+      list.blocks_.pop_back();
+    }
+  }
+  if (ptr) {
+    sync_->bytes_cached_ -= rounded;
+    ++sync_->hits_;
+  } else {
+    ++sync_->misses_;
+    char* base = static_cast<char*>(AlignedMalloc(rounded + kAlignment));
+    BlockHeader* header = reinterpret_cast<BlockHeader*>(base);
+    header->magic = kBlockMagic;
+    header->size_class = size_class;
+    ptr = base + kAlignment;
+  }
+  sync_->bytes_live_ += rounded;
+  return ptr;
+}
+
+void HostAllocator::Free(void* ptr) {
+  char* base = static_cast<char*>(ptr) - kAlignment;
+  const BlockHeader* header = reinterpret_cast<const BlockHeader*>(base);
+  CHECK_EQ(header->magic, kBlockMagic)
+      << "Freeing a block not allocated by HostAllocator";
+  const size_t rounded = ClassSize(header->size_class);
+  sync_->bytes_live_ -= rounded;
+  if (sync_->mode_.load(boost::memory_order_relaxed) == POOLED) {
+    // 先占用缓存额度，超过上限则退回额度，直接还给系统
+    if (sync_->bytes_cached_.fetch_add(rounded) + rounded <=
+        sync_->cache_limit_.load()) {
+      sync::FreeList& list = sync_->free_lists_[header->size_class];
+      boost::mutex::scoped_lock lock(list.mutex_);
+      list.blocks_.push_back(ptr);
+      return;
+    }
+    sync_->bytes_cached_ -= rounded;
+  }
+  AlignedFree(base);
+}
+
+void HostAllocator::Trim() {
+  TrimTo(0);
+}
+
+void HostAllocator::TrimTo(size_t limit) {
+  for (int c = kSizeClasses - 1; c >= 0 && sync_->bytes_cached_ > limit; --c) {
+    sync::FreeList& list = sync_->free_lists_[c];
+    const size_t rounded = ClassSize(c);
+    boost::mutex::scoped_lock lock(list.mutex_);
+    while (!list.blocks_.empty() && sync_->bytes_cached_ > limit) {
+      AlignedFree(static_cast<char*>(list.blocks_.back()) - kAlignment);
+      list.blocks_.pop_back();
+      sync_->bytes_cached_ -= rounded;
+    }
+  }
+}
+
+HostAllocator::Stats HostAllocator::stats() {
+  Stats stats;
+  stats.bytes_live = sync_->bytes_live_;
+  stats.bytes_cached = sync_->bytes_cached_;
+  stats.hits = sync_->hits_;
+  stats.misses = sync_->misses_;
+  return stats;
+}
+
+void HostAllocator::ResetStats() {
+  sync_->hits_ = 0;
+  sync_->misses_ = 0;
+}
+
+}  // namespace caffe
@@ -2,6 +2,7 @@
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/text_format.h>
+#include <google/protobuf/wire_format_lite.h>
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -9,9 +10,13 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #endif  // USE_OPENCV
 #include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <cstring>
 #include <fstream>  // NOLINT(readability/streams)
+#include <iterator>
 #include <string>
 #include <vector>
 
@@ -69,7 +74,169 @@ void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
   CHECK(proto.SerializeToOstream(&output));
 }
 
+void CommitFile(const string& temp_filename, const string& filename) {
+  int fd = open(temp_filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << temp_filename;
+  CHECK_EQ(fsync(fd), 0) << "Failed to sync " << temp_filename;
+  close(fd);
+  CHECK_EQ(rename(temp_filename.c_str(), filename.c_str()), 0)
+      << "Failed to rename " << temp_filename << " to " << filename;
+  // 目录也要同步，rename 才能在掉电后保留
+  const size_t slash = filename.rfind('/');
+  const string dir = slash == string::npos ? "." :
+      filename.substr(0, std::max<size_t>(slash, 1));
+  fd = open(dir.c_str(), O_RDONLY);
+  if (fd != -1) {
+    fsync(fd);
+    close(fd);
+  }
+}
+
 #ifdef USE_OPENCV
+// Reads a 2- or 4-byte EXIF value in the byte order of the TIFF header.
+static size_t ReadExifValue(const unsigned char* p, int bytes, bool little) {
+  size_t value = 0;
+  for (int i = 0; i < bytes; ++i) {
+    value |= static_cast<size_t>(p[little ? i : bytes - 1 - i]) << (8 * i);
+  }
+  return value;
+}
+
+// Returns the EXIF orientation (1-8) stored in the payload of an APP1
+// segment, or 1 if there is none.
+static int ExifOrientation(const unsigned char* p, size_t size) {
+  if (size < 14 || std::memcmp(p, "Exif\0\0", 6) != 0) {
+    return 1;
+  }
+  // TIFF 头：字节序 (II / MM)，42，第一个 IFD 的偏移
+  const unsigned char* tiff = p + 6;
+  const size_t tiff_size = size - 6;
+  const bool little = tiff[0] == 'I' && tiff[1] == 'I';
+  if (!little && !(tiff[0] == 'M' && tiff[1] == 'M')) {
+    return 1;
+  }
+  const size_t ifd = ReadExifValue(tiff + 4, 4, little);
+  if (ifd + 2 > tiff_size) {
+    return 1;
+  }
+  const size_t entries = ReadExifValue(tiff + ifd, 2, little);
+  for (size_t i = 0; i < entries; ++i) {
+    const size_t entry = ifd + 2 + 12 * i;
+    if (entry + 12 > tiff_size) {
+      break;
+    }
+    if (ReadExifValue(tiff + entry, 2, little) == 0x0112) {  // Orientation
+      const int orientation =
+          static_cast<int>(ReadExifValue(tiff + entry + 8, 2, little));
+      return (orientation >= 1 && orientation <= 8) ? orientation : 1;
+    }
+  }
+  return 1;
+}
+
+// Reads the size of a JPEG image from the frame header (SOFn segment), as
+// it will be decoded: imdecode applies the EXIF orientation, so height and
+// width are swapped for orientations 5-8 (rotated by 90 degrees).
+// Returns false if the data is not a JPEG image.
+static bool JPEGImageSize(const char* data, size_t size,
+    int* height, int* width) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  if (size < 4 || p[0] != 0xFF || p[1] != 0xD8) {
+    return false;
+  }
+  size_t pos = 2;
+  int orientation = 1;
+  while (pos + 4 <= size) {
+    if (p[pos] != 0xFF) {
+      return false;
+    }
+    const unsigned char marker = p[pos + 1];
+    if (marker == 0xFF) {  // 填充字节
+      ++pos;
+      continue;
+    }
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+      pos += 2;  // 无长度字段的标记
+      continue;
+    }
+    const size_t length = (p[pos + 2] << 8) | p[pos + 3];
+    // SOF0 - SOF15，除去 DHT (C4)、JPG (C8) 和 DAC (CC)
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+        marker != 0xC8 && marker != 0xCC) {
+      if (pos + 9 > size) {
+        return false;
+      }
+      *height = (p[pos + 5] << 8) | p[pos + 6];
+      *width = (p[pos + 7] << 8) | p[pos + 8];
+      if (orientation >= 5) {
+        std::swap(*height, *width);
+      }
+      return *height > 0 && *width > 0;
+    }
+    if (marker == 0xE1 && length >= 2 && pos + 2 + length <= size &&
+        orientation == 1) {  // APP1，可能是 EXIF
+      orientation = ExifOrientation(p + pos + 4, length - 2);
+    }
+    if (marker == 0xD9 || marker == 0xDA) {  // 图像结束或扫描数据开始
+      return false;
+    }
+    pos += 2 + length;
+  }
+  return false;
+}
+
+// The imdecode flag that decodes a JPEG image at 1/2, 1/4 or 1/8 of its size
+// (by the DCT scaling of libjpeg) when that is still at least height x
+// width, or the full-size flag. OpenCV before 3.0 only decodes full size.
+static int ReducedReadFlag(const char* data, size_t size,
+    const int height, const int width, const bool is_color) {
+  int source_height, source_width;
+  int scale = 1;
+  if (height > 0 && width > 0 &&
+      JPEGImageSize(data, size, &source_height, &source_width)) {
+    // libjpeg 按比例缩小时向上取整
+    for (scale = 8; scale > 1; scale /= 2) {
+      if ((source_height + scale - 1) / scale >= height &&
+          (source_width + scale - 1) / scale >= width) {
+        break;
+      }
+    }
+  }
+#if CV_MAJOR_VERSION >= 3
+  switch (scale) {
+  case 8:
+    return is_color ? cv::IMREAD_REDUCED_COLOR_8 :
+        cv::IMREAD_REDUCED_GRAYSCALE_8;
+  case 4:
+    return is_color ? cv::IMREAD_REDUCED_COLOR_4 :
+        cv::IMREAD_REDUCED_GRAYSCALE_4;
+  case 2:
+    return is_color ? cv::IMREAD_REDUCED_COLOR_2 :
+        cv::IMREAD_REDUCED_GRAYSCALE_2;
+  }
+#endif  // CV_MAJOR_VERSION >= 3
+  return (is_color ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE);
+}
+
+// Decodes an encoded image and resizes it to height x width if both are
+// positive. The encoded bytes are decoded in place.
+static cv::Mat DecodeImageResized(const char* data, size_t size,
+    const int height, const int width, const bool is_color,
+    const bool reduced) {
+  const int cv_read_flag = reduced ?
+      ReducedReadFlag(data, size, height, width, is_color) :
+      (is_color ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE);
+  const cv::Mat buffer(1, static_cast<int>(size), CV_8UC1,
+      const_cast<char*>(data));
+  cv::Mat cv_img_origin = cv::imdecode(buffer, cv_read_flag);
+  if (!cv_img_origin.data || height <= 0 || width <= 0) {
+    return cv_img_origin;
+  }
+  cv::Mat cv_img;
+  cv::resize(cv_img_origin, cv_img, cv::Size(width, height));
+  return cv_img;
+}
+
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color) {
   cv::Mat cv_img;
@@ -88,6 +255,27 @@ cv::Mat ReadImageToCVMat(const string& filename,
   return cv_img;
 }
 
+cv::Mat ReadImageToCVMat(const string& filename,
+    const int height, const int width, const bool is_color,
+    const bool reduced) {
+  if (!reduced || height <= 0 || width <= 0) {
+    return ReadImageToCVMat(filename, height, width, is_color);
+  }
+  // 先读入整个文件，以便在解码前从文件头得到图片尺寸
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  std::vector<char> data((std::istreambuf_iterator<char>(file)),
+      std::istreambuf_iterator<char>());
+  cv::Mat cv_img;
+  if (!data.empty()) {
+    cv_img = DecodeImageResized(&data[0], data.size(), height, width,
+        is_color, true);
+  }
+  if (!cv_img.data) {
+    LOG(ERROR) << "Could not open or find file " << filename;
+  }
+  return cv_img;
+}
+
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width) {
   return ReadImageToCVMat(filename, height, width, true);
@@ -118,8 +306,9 @@ static bool matchExt(const std::string & fn,
 
 bool ReadImageToDatum(const string& filename, const int label,
     const int height, const int width, const bool is_color,
-    const std::string & encoding, Datum* datum) {
-  cv::Mat cv_img = ReadImageToCVMat(filename, height, width, is_color);
+    const std::string & encoding, const bool reduced, Datum* datum) {
+  cv::Mat cv_img = ReadImageToCVMat(filename, height, width, is_color,
+      reduced);
   if (cv_img.data) {
     if (encoding.size()) {
       if ( (cv_img.channels() == 3) == is_color && !height && !width &&
@@ -164,26 +353,99 @@ bool ReadFileToDatum(const string& filename, const int label,
   }
 }
 
+DatumView::DatumView(const Datum& datum)
+    : channels(datum.channels()), height(datum.height()),
+      width(datum.width()), data(datum.data().data()),
+      data_size(datum.data().size()), float_data(datum.float_data().data()),
+      float_data_size(datum.float_data_size()), label(datum.label()),
+      encoded(datum.encoded()) {}
+
+// Reads the fields of a serialized Datum without copying data. Returns false
+// for a record with float_data, whose (unpacked) values are not contiguous
+// in the serialized bytes, or a malformed one.
+static bool ReadDatumInPlace(const void* bytes, size_t size,
+    DatumView* view) {
+  using google::protobuf::internal::WireFormatLite;
+  const uint8_t* buffer = static_cast<const uint8_t*>(bytes);
+  CodedInputStream input(buffer, size);
+  *view = DatumView();
+  uint32_t tag;
+  while ((tag = input.ReadTag()) != 0) {
+    const int field = WireFormatLite::GetTagFieldNumber(tag);
+    const bool is_varint = WireFormatLite::GetTagWireType(tag) ==
+        WireFormatLite::WIRETYPE_VARINT;
+    uint32_t value;
+    if (field == Datum::kDataFieldNumber &&
+        WireFormatLite::GetTagWireType(tag) ==
+            WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      if (!input.ReadVarint32(&value)) { return false; }
+      const int position = input.CurrentPosition();
+      if (!input.Skip(value)) { return false; }
+      view->data = reinterpret_cast<const char*>(buffer + position);
+      view->data_size = value;
+    } else if (field == Datum::kFloatDataFieldNumber) {
+      return false;
+    } else if (is_varint && (field == Datum::kChannelsFieldNumber ||
+        field == Datum::kHeightFieldNumber ||
+        field == Datum::kWidthFieldNumber ||
+        field == Datum::kLabelFieldNumber ||
+        field == Datum::kEncodedFieldNumber)) {
+      if (!input.ReadVarint32(&value)) { return false; }
+      // int32 字段：负数按 64 位 varint 编码，取低 32 位即可
+      const int32_t int_value = static_cast<int32_t>(value);
+      switch (field) {
+      case Datum::kChannelsFieldNumber: view->channels = int_value; break;
+      case Datum::kHeightFieldNumber: view->height = int_value; break;
+      case Datum::kWidthFieldNumber: view->width = int_value; break;
+      case Datum::kLabelFieldNumber: view->label = int_value; break;
+      default: view->encoded = value != 0; break;
+      }
+    } else if (!WireFormatLite::SkipField(&input, tag)) {
+      return false;
+    }
+  }
+  return input.ConsumedEntireMessage();
+}
+
+DatumView ParseDatumView(const void* bytes, size_t size, Datum* storage) {
+  DatumView view;
+  if (!ReadDatumInPlace(bytes, size, &view)) {
+    CHECK(storage->ParseFromArray(bytes, size)) << "Could not parse datum";
+    view = DatumView(*storage);
+  }
+  return view;
+}
+
 #ifdef USE_OPENCV
 cv::Mat DecodeDatumToCVMatNative(const Datum& datum) {
-  cv::Mat cv_img;
-  CHECK(datum.encoded()) << "Datum not encoded";
-  const string& data = datum.data();
-  std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
-  cv_img = cv::imdecode(vec_data, -1);
+  return DecodeDatumToCVMatNative(DatumView(datum));
+}
+cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color) {
+  return DecodeDatumToCVMat(DatumView(datum), is_color, 0, 0, false);
+}
+cv::Mat DecodeDatumToCVMat(const DatumView& datum, bool is_color) {
+  return DecodeDatumToCVMat(datum, is_color, 0, 0, false);
+}
+cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color,
+    int height, int width, bool reduced) {
+  return DecodeDatumToCVMat(DatumView(datum), is_color, height, width,
+      reduced);
+}
+cv::Mat DecodeDatumToCVMatNative(const DatumView& datum) {
+  CHECK(datum.encoded) << "Datum not encoded";
+  const cv::Mat buffer(1, static_cast<int>(datum.data_size), CV_8UC1,
+      const_cast<char*>(datum.data));
+  cv::Mat cv_img = cv::imdecode(buffer, -1);
   if (!cv_img.data) {
     LOG(ERROR) << "Could not decode datum ";
   }
   return cv_img;
 }
-cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color) {
-  cv::Mat cv_img;
-  CHECK(datum.encoded()) << "Datum not encoded";
-  const string& data = datum.data();
-  std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
-  int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
-    CV_LOAD_IMAGE_GRAYSCALE);
-  cv_img = cv::imdecode(vec_data, cv_read_flag);
+cv::Mat DecodeDatumToCVMat(const DatumView& datum, bool is_color,
+    int height, int width, bool reduced) {
+  CHECK(datum.encoded) << "Datum not encoded";
+  cv::Mat cv_img = DecodeImageResized(datum.data, datum.data_size, height,
+      width, is_color, reduced);
   if (!cv_img.data) {
     LOG(ERROR) << "Could not decode datum ";
   }
@@ -0,0 +1,182 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/mapped_weights.hpp"
+
+namespace caffe {
+
+static const char kMagic[8] = {'C', 'A', 'F', 'F', 'E', 'M', 'A', 'P'};
+// 魔数和索引长度
+static const size_t kHeaderSize = sizeof(kMagic) + sizeof(uint64_t);
+static const size_t kAlignment = 64;
+
+static inline size_t Align(size_t offset) {
+  return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+static inline size_t ElementSize(const WeightsIndex::Tensor& tensor) {
+  return tensor.type() == WeightsIndex::DOUBLE ? sizeof(double) :
+      sizeof(float);
+}
+
+MappedWeights::MappedWeights(const string& filename)
+    : filename_(filename), addr_(NULL), size_(0), data_begin_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Failed to stat " << filename;
+  size_ = st.st_size;
+  CHECK_GE(size_, kHeaderSize) << filename
+      << " is not a mapped weights file.";
+  // 私有映射：写 blob 时只复制被写的页，文件不会改变
+  addr_ = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  CHECK(addr_ != MAP_FAILED) << "Failed to map " << filename;
+  const char* bytes = static_cast<const char*>(addr_);
+  CHECK_EQ(memcmp(bytes, kMagic, sizeof(kMagic)), 0) << filename
+      << " is not a mapped weights file.";
+  uint64_t index_size;
+  memcpy(&index_size, bytes + sizeof(kMagic), sizeof(index_size));
+  CHECK_LE(index_size, size_ - kHeaderSize) << "Truncated weights file "
+      << filename;
+  CHECK(index_.ParseFromArray(bytes + kHeaderSize, index_size))
+      << "Failed to parse the index of " << filename;
+  CHECK_EQ(index_.version(), 1) << "Unsupported version of weights file "
+      << filename;
+  data_begin_ = Align(kHeaderSize + index_size);
+  for (int i = 0; i < index_.tensor_size(); ++i) {
+    const WeightsIndex::Tensor& tensor = index_.tensor(i);
+    CHECK_EQ(tensor.offset() % kAlignment, 0) << "Tensor " << i << " of "
+        << filename << " is not aligned.";
+    CHECK_LE(data_begin_ + tensor.offset() + count(tensor) *
+        ElementSize(tensor), size_) << "Truncated weights file " << filename;
+    layers_[tensor.layer()].push_back(i);
+  }
+}
+
+MappedWeights::~MappedWeights() {
+  if (addr_) {
+    munmap(addr_, size_);
+  }
+}
+
+const vector<int>* MappedWeights::layer_tensors(const string& layer) const {
+  std::map<string, vector<int> >::const_iterator it = layers_.find(layer);
+  return it == layers_.end() ? NULL : &it->second;
+}
+
+int64_t MappedWeights::count(const WeightsIndex::Tensor& tensor) {
+  int64_t count = 1;
+  for (int i = 0; i < tensor.shape().dim_size(); ++i) {
+    CHECK_GE(tensor.shape().dim(i), 0);
+    count *= tensor.shape().dim(i);
+  }
+  return count;
+}
+
+bool IsMappedWeightsFile(const string& filename) {
+  const string extension = ".caffeweights";
+  return filename.size() >= extension.size() &&
+      filename.compare(filename.size() - extension.size(), extension.size(),
+      extension) == 0;
+}
+
+// 与 Blob::FromProto 相同：没有 shape 时使用旧的 4 维字段
+static void GetShape(const BlobProto& proto, BlobShape* shape) {
+  if (proto.has_shape()) {
+    shape->CopyFrom(proto.shape());
+    return;
+  }
+  shape->Clear();
+  if (proto.has_num() || proto.has_channels() || proto.has_height() ||
+      proto.has_width()) {
+    shape->add_dim(proto.num());
+    shape->add_dim(proto.channels());
+    shape->add_dim(proto.height());
+    shape->add_dim(proto.width());
+  }
+}
+
+void WriteMappedWeights(const NetParameter& param, const string& filename) {
+  WeightsIndex index;
+  vector<const BlobProto*> blobs;
+  uint64_t offset = 0;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      const BlobProto& blob = layer.blobs(j);
+      WeightsIndex::Tensor* tensor = index.add_tensor();
+      tensor->set_layer(layer.name());
+      GetShape(blob, tensor->mutable_shape());
+      const bool is_double = blob.double_data_size() > 0;
+      tensor->set_type(is_double ? WeightsIndex::DOUBLE : WeightsIndex::FLOAT);
+      CHECK_EQ(MappedWeights::count(*tensor),
+          is_double ? blob.double_data_size() : blob.data_size())
+          << "Blob " << j << " of layer " << layer.name()
+          << " does not match its shape.";
+      tensor->set_offset(offset);
+      offset = Align(offset + MappedWeights::count(*tensor) *
+          ElementSize(*tensor));
+      blobs.push_back(&blob);
+    }
+  }
+  string serialized_index;
+  CHECK(index.SerializeToString(&serialized_index));
+  const uint64_t index_size = serialized_index.size();
+  std::ofstream output(filename.c_str(),
+      std::ios::out | std::ios::trunc | std::ios::binary);
+  CHECK(output) << "Failed to open " << filename;
+  output.write(kMagic, sizeof(kMagic));
+  output.write(reinterpret_cast<const char*>(&index_size), sizeof(index_size));
+  output << serialized_index;
+  const size_t data_begin = Align(kHeaderSize + index_size);
+  const vector<char> padding(kAlignment, 0);
+  output.write(&padding[0], data_begin - kHeaderSize - index_size);
+  for (int i = 0; i < blobs.size(); ++i) {
+    const WeightsIndex::Tensor& tensor = index.tensor(i);
+    const size_t bytes = MappedWeights::count(tensor) * ElementSize(tensor);
+    const char* data = tensor.type() == WeightsIndex::DOUBLE ?
+        reinterpret_cast<const char*>(blobs[i]->double_data().data()) :
+        reinterpret_cast<const char*>(blobs[i]->data().data());
+    output.write(data, bytes);
+    output.write(&padding[0], Align(bytes) - bytes);
+  }
+  CHECK(output) << "Failed to write " << filename;
+}
+
+void ReadMappedWeights(const string& filename, NetParameter* param) {
+  MappedWeights weights(filename);
+  const WeightsIndex& index = weights.index();
+  param->Clear();
+  LayerParameter* layer = NULL;
+  for (int i = 0; i < index.tensor_size(); ++i) {
+    const WeightsIndex::Tensor& tensor = index.tensor(i);
+    // 同一层的张量是连续的
+    if (!layer || layer->name() != tensor.layer()) {
+      layer = param->add_layer();
+      layer->set_name(tensor.layer());
+    }
+    BlobProto* blob = layer->add_blobs();
+    blob->mutable_shape()->CopyFrom(tensor.shape());
+    const int count = MappedWeights::count(tensor);
+    if (tensor.type() == WeightsIndex::DOUBLE) {
+      blob->mutable_double_data()->Resize(count, 0);
+      memcpy(blob->mutable_double_data()->mutable_data(), weights.data(i),
+          count * sizeof(double));
+    } else {
+      blob->mutable_data()->Resize(count, 0);
+      memcpy(blob->mutable_data()->mutable_data(), weights.data(i),
+          count * sizeof(float));
+    }
+  }
+}
+
+}  // namespace caffe
@@ -1,11 +1,14 @@
+#include <boost/bind.hpp>
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
 #include <limits>
 
 #include "caffe/common.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -226,6 +229,41 @@ void caffe_abs<double>(const int n, const double* a, double* y) {
     vdAbs(n, a, y);
 }
 
+static int cpu_parallel_threshold_ = 32768;
+
+int caffe_cpu_parallel_threshold() {
+  return cpu_parallel_threshold_;
+}
+
+void caffe_set_cpu_parallel_threshold(const int n) {
+  CHECK_GT(n, 0) << "Parallel threshold must be positive.";
+  cpu_parallel_threshold_ = n;
+}
+
+static void RunKernelChunk(const boost::function<void(int, int)>* kernel,
+    const int n, const int num_chunks, const int chunk) {
+  const int begin = chunk == 0 ? 0 :
+      static_cast<int>(static_cast<int64_t>(n) * chunk / num_chunks) & ~15;
+  const int end = chunk == num_chunks - 1 ? n :
+      static_cast<int>(static_cast<int64_t>(n) * (chunk + 1) / num_chunks)
+      & ~15;
+  (*kernel)(begin, end);
+}
+
+void caffe_cpu_parallel_for(const int n,
+    const boost::function<void(int, int)>& kernel) {
+  const int max_chunks = n / cpu_parallel_threshold_;
+  // 数组较短时不去访问线程池
+  const int num_chunks = max_chunks < 2 ? 1 :
+      std::min(max_chunks, ThreadPool::global_threads());
+  if (num_chunks == 1) {
+    kernel(0, n);
+    return;
+  }
+  ThreadPool::Global().Run(num_chunks,
+      boost::bind(&RunKernelChunk, &kernel, n, num_chunks, _1));
+}
+
 unsigned int caffe_rng_rand() {
   return (*caffe_rng())();
 }
@@ -0,0 +1,125 @@
+#include <boost/bind.hpp>
+
+#include <cmath>
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#ifndef USE_MKL
+
+using caffe::caffe_cpu_parallel_for;
+
+// y[i] = operation for i in [begin, end). exp, log and pow are not vectorized
+// without -ffast-math, but still run in parallel.
+#define DEFINE_VSL_UNARY_FUNC(name, operation) \
+  template <typename Dtype> CAFFE_SIMD_CLONES \
+  static void v##name##Kernel(const int begin, const int end, \
+      const Dtype* a, Dtype* y) { \
+    for (int i = begin; i < end; ++i) { operation; } \
+  } \
+  void vs##name(const int n, const float* a, float* y) { \
+    CHECK_GT(n, 0); CHECK(a); CHECK(y); \
+    caffe_cpu_parallel_for(n, \
+        boost::bind(&v##name##Kernel<float>, _1, _2, a, y)); \
+  } \
+  void vd##name(const int n, const double* a, double* y) { \
+    CHECK_GT(n, 0); CHECK(a); CHECK(y); \
+    caffe_cpu_parallel_for(n, \
+        boost::bind(&v##name##Kernel<double>, _1, _2, a, y)); \
+  }
+
+DEFINE_VSL_UNARY_FUNC(Sqr, y[i] = a[i] * a[i]);
+DEFINE_VSL_UNARY_FUNC(Exp, y[i] = exp(a[i]));
+DEFINE_VSL_UNARY_FUNC(Ln, y[i] = log(a[i]));
+DEFINE_VSL_UNARY_FUNC(Abs, y[i] = fabs(a[i]));
+
+#define DEFINE_VSL_UNARY_FUNC_WITH_PARAM(name, operation) \
+  template <typename Dtype> CAFFE_SIMD_CLONES \
+  static void v##name##Kernel(const int begin, const int end, \
+      const Dtype* a, const Dtype b, Dtype* y) { \
+    for (int i = begin; i < end; ++i) { operation; } \
+  } \
+  void vs##name(const int n, const float* a, const float b, float* y) { \
+    CHECK_GT(n, 0); CHECK(a); CHECK(y); \
+    caffe_cpu_parallel_for(n, \
+        boost::bind(&v##name##Kernel<float>, _1, _2, a, b, y)); \
+  } \
+  void vd##name(const int n, const double* a, const float b, double* y) { \
+    CHECK_GT(n, 0); CHECK(a); CHECK(y); \
+    caffe_cpu_parallel_for(n, boost::bind(&v##name##Kernel<double>, _1, _2, a, \
+        static_cast<double>(b), y)); \
+  }
+
+DEFINE_VSL_UNARY_FUNC_WITH_PARAM(Powx, y[i] = pow(a[i], b));
+
+#define DEFINE_VSL_BINARY_FUNC(name, operation) \
+  template <typename Dtype> CAFFE_SIMD_CLONES \
+  static void v##name##Kernel(const int begin, const int end, \
+      const Dtype* a, const Dtype* b, Dtype* y) { \
+    for (int i = begin; i < end; ++i) { operation; } \
+  } \
+  void vs##name(const int n, const float* a, const float* b, float* y) { \
+    CHECK_GT(n, 0); CHECK(a); CHECK(b); CHECK(y); \
+    caffe_cpu_parallel_for(n, \
+        boost::bind(&v##name##Kernel<float>, _1, _2, a, b, y)); \
+  } \
+  void vd##name(const int n, const double* a, const double* b, double* y) { \
+    CHECK_GT(n, 0); CHECK(a); CHECK(b); CHECK(y); \
+    caffe_cpu_parallel_for(n, \
+        boost::bind(&v##name##Kernel<double>, _1, _2, a, b, y)); \
+  }
+
+DEFINE_VSL_BINARY_FUNC(Add, y[i] = a[i] + b[i]);
+DEFINE_VSL_BINARY_FUNC(Sub, y[i] = a[i] - b[i]);
+DEFINE_VSL_BINARY_FUNC(Mul, y[i] = a[i] * b[i]);
+DEFINE_VSL_BINARY_FUNC(Div, y[i] = a[i] / b[i]);
+
+template <typename Dtype> CAFFE_SIMD_CLONES
+static void vAxpbyKernel(const int begin, const int end, const Dtype alpha,
+    const Dtype* x, const Dtype beta, Dtype* y) {
+  // beta 为 0 时与 MKL 一样不读 y，y 中原有的 NaN/Inf 不会传到结果中
+  if (beta == 0) {
+    for (int i = begin; i < end; ++i) {
+      y[i] = alpha * x[i];
+    }
+    return;
+  }
+  for (int i = begin; i < end; ++i) {
+    y[i] = alpha * x[i] + beta * y[i];
+  }
+}
+
+// Strided axpby; negative increments start from the end as in BLAS.
+template <typename Dtype>
+static void AxpbyStrided(const int N, const Dtype alpha, const Dtype* X,
+    const int incX, const Dtype beta, Dtype* Y, const int incY) {
+  const Dtype* x = incX < 0 ? X + (1 - N) * incX : X;
+  Dtype* y = incY < 0 ? Y + (1 - N) * incY : Y;
+  for (int i = 0; i < N; ++i, x += incX, y += incY) {
+    *y = beta == 0 ? alpha * *x : alpha * *x + beta * *y;
+  }
+}
+
+void cblas_saxpby(const int N, const float alpha, const float* X,
+                  const int incX, const float beta, float* Y,
+                  const int incY) {
+  if (incX != 1 || incY != 1) {
+    AxpbyStrided(N, alpha, X, incX, beta, Y, incY);
+    return;
+  }
+  caffe_cpu_parallel_for(N,
+      boost::bind(&vAxpbyKernel<float>, _1, _2, alpha, X, beta, Y));
+}
+
+void cblas_daxpby(const int N, const double alpha, const double* X,
+                  const int incX, const double beta, double* Y,
+                  const int incY) {
+  if (incX != 1 || incY != 1) {
+    AxpbyStrided(N, alpha, X, incX, beta, Y, incY);
+    return;
+  }
+  caffe_cpu_parallel_for(N,
+      boost::bind(&vAxpbyKernel<double>, _1, _2, alpha, X, beta, Y));
+}
+
+#endif  // USE_MKL
@@ -0,0 +1,148 @@
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "caffe/util/profiler.hpp"
+
+namespace caffe {
+
+class Profiler::sync {
+ public:
+  boost::mutex mutex_;
+  boost::posix_time::ptime start_;
+};
+
+// 转义 JSON 字符串中的特殊字符
+static string JsonString(const string& s) {
+  string escaped = "\"";
+  for (int i = 0; i < s.size(); ++i) {
+    const char c = s[i];
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      escaped += ' ';
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped + "\"";
+}
+
+Profiler::Profiler(size_t max_events)
+    : sync_(new sync()), max_events_(max_events) {
+  sync_->start_ = boost::posix_time::microsec_clock::universal_time();
+}
+
+int64_t Profiler::Now() {
+#ifndef CPU_ONLY
+  if (Caffe::mode() == Caffe::GPU) {
+    CUDA_CHECK(cudaDeviceSynchronize());
+  }
+#endif
+  return (boost::posix_time::microsec_clock::universal_time() -
+      sync_->start_).total_microseconds();
+}
+
+void Profiler::Record(const string& name, const string& type,
+    const string& phase, int64_t start_us, size_t bytes_read,
+    size_t bytes_written, size_t bytes_allocated) {
+  const int64_t end_us = Now();
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  const pair<string, string> key(phase, name);
+  std::map<pair<string, string>, int>::iterator it = summary_index_.find(key);
+  if (it == summary_index_.end()) {
+    it = summary_index_.insert(make_pair(key, summary_.size())).first;
+    Summary summary;
+    summary.name = name;
+    summary.type = type;
+    summary.phase = phase;
+    summary.calls = 0;
+    summary.total_us = 0;
+    summary.bytes_read = 0;
+    summary.bytes_written = 0;
+    summary_.push_back(summary);
+  }
+  Summary& summary = summary_[it->second];
+  ++summary.calls;
+  summary.total_us += end_us - start_us;
+  summary.bytes_read += bytes_read;
+  summary.bytes_written += bytes_written;
+  summary.bytes_allocated = bytes_allocated;
+  if (events_.size() < max_events_) {
+    Event event;
+    event.name = name;
+    event.type = type;
+    event.phase = phase;
+    event.thread = Caffe::solver_rank();
+    event.start_us = start_us;
+    event.duration_us = end_us - start_us;
+    event.bytes_read = bytes_read;
+    event.bytes_written = bytes_written;
+    event.bytes_allocated = bytes_allocated;
+    events_.push_back(event);
+    LOG_IF(WARNING, events_.size() == max_events_) << "Profiler keeps at most "
+        << max_events_ << " events; later events only update the summary.";
+  }
+}
+
+vector<Profiler::Event> Profiler::events() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return events_;
+}
+
+vector<Profiler::Summary> Profiler::summary() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return summary_;
+}
+
+void Profiler::Clear() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  events_.clear();
+  summary_.clear();
+  summary_index_.clear();
+}
+
+void Profiler::LogSummary() {
+  const vector<Summary> layers = summary();
+  LOG(INFO) << "Average time and memory traffic per layer:";
+  for (int i = 0; i < layers.size(); ++i) {
+    const Summary& s = layers[i];
+    const double avg_us = static_cast<double>(s.total_us) / s.calls;
+    // 字节数 / 微秒 = MB/s
+    const double bandwidth = s.total_us > 0 ?
+        static_cast<double>(s.bytes_read + s.bytes_written) / s.total_us : 0;
+    LOG(INFO) << std::setfill(' ') << std::setw(10) << s.name
+        << "\t" << s.phase << ": " << avg_us / 1000 << " ms, "
+        << bandwidth << " MB/s, "
+        << s.bytes_allocated / 1048576. << " MB allocated ("
+        << s.calls << " calls)";
+  }
+}
+
+void Profiler::WriteChromeTrace(const string& filename) {
+  const vector<Event> trace = events();
+  std::ofstream out(filename.c_str());
+  CHECK(out) << "Failed to open " << filename;
+  out << "{\"traceEvents\":[";
+  for (int i = 0; i < trace.size(); ++i) {
+    const Event& e = trace[i];
+    out << (i > 0 ? ",\n" : "\n")
+        << "{\"name\":" << JsonString(e.name)
+        << ",\"cat\":" << JsonString(e.phase)
+        << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.thread
+        << ",\"ts\":" << e.start_us << ",\"dur\":" << e.duration_us
+        << ",\"args\":{\"type\":" << JsonString(e.type)
+        << ",\"bytes_read\":" << e.bytes_read
+        << ",\"bytes_written\":" << e.bytes_written
+        << ",\"bytes_allocated\":" << e.bytes_allocated << "}}";
+  }
+  out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  CHECK(out) << "Failed to write " << filename;
+  LOG(INFO) << "Wrote " << trace.size() << " profile events to " << filename;
+}
+
+}  // namespace caffe
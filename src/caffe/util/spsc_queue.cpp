@@ -0,0 +1,144 @@
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <string>
+
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/spsc_queue.hpp"
+
+namespace caffe {
+
+// 进入休眠前的自旋和让出 CPU 的次数
+static const int kSpinCount = 64;
+static const int kYieldCount = 16;
+
+template<typename T>
+class SPSCQueue<T>::sync {
+ public:
+  sync() : head_(0), tail_(0), producer_waiting_(false),
+      consumer_waiting_(false), producer_stalls_(0), consumer_stalls_(0) {}
+
+  // head_ 只由消费者写，tail_ 只由生产者写；两者单调递增
+  boost::atomic<size_t> head_;
+  boost::atomic<size_t> tail_;
+  boost::atomic<bool> producer_waiting_;
+  boost::atomic<bool> consumer_waiting_;
+  boost::atomic<size_t> producer_stalls_;
+  boost::atomic<size_t> consumer_stalls_;
+  boost::mutex mutex_;
+  boost::condition_variable not_full_;
+  boost::condition_variable not_empty_;
+};
+
+template<typename T>
+SPSCQueue<T>::SPSCQueue(size_t capacity)
+    : slots_(capacity), sync_(new sync()) {
+  CHECK_GT(capacity, 0) << "SPSCQueue capacity must be positive.";
+}
+
+template<typename T>
+bool SPSCQueue<T>::try_push(const T& t) {
+  const size_t tail = sync_->tail_.load(boost::memory_order_relaxed);
+  if (tail - sync_->head_.load(boost::memory_order_acquire) ==
+      slots_.size()) {
+    return false;
+  }
+  slots_[tail % slots_.size()] = t;
+  // seq_cst: must be ordered before reading consumer_waiting_, see pop().
+  sync_->tail_.store(tail + 1);
+  if (sync_->consumer_waiting_.load()) {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->not_empty_.notify_one();
+  }
+  return true;
+}
+
+template<typename T>
+void SPSCQueue<T>::push(const T& t) {
+  if (try_push(t)) {
+    return;
+  }
+  ++sync_->producer_stalls_;
+  for (int i = 0; i < kSpinCount + kYieldCount; ++i) {
+    if (i >= kSpinCount) {
+      boost::this_thread::yield();
+    }
+    if (try_push(t)) {
+      return;
+    }
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  sync_->producer_waiting_.store(true);
+  while (sync_->tail_.load() - sync_->head_.load() == slots_.size()) {
+    sync_->not_full_.wait(lock);
+  }
+  sync_->producer_waiting_.store(false);
+  lock.unlock();
+  CHECK(try_push(t));
+}
+
+template<typename T>
+bool SPSCQueue<T>::try_pop(T* t) {
+  const size_t head = sync_->head_.load(boost::memory_order_relaxed);
+  if (head == sync_->tail_.load(boost::memory_order_acquire)) {
+    return false;
+  }
+  *t = slots_[head % slots_.size()];
+  // seq_cst: must be ordered before reading producer_waiting_, so that a
+  // producer that checks for space after announcing itself cannot miss it.
+  sync_->head_.store(head + 1);
+  if (sync_->producer_waiting_.load()) {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->not_full_.notify_one();
+  }
+  return true;
+}
+
+template<typename T>
+T SPSCQueue<T>::pop(const string& log_on_wait) {
+  T t;
+  if (try_pop(&t)) {
+    return t;
+  }
+  ++sync_->consumer_stalls_;
+  if (!log_on_wait.empty()) {
+    LOG_EVERY_N(INFO, 1000) << log_on_wait;
+  }
+  for (int i = 0; i < kSpinCount + kYieldCount; ++i) {
+    if (i >= kSpinCount) {
+      boost::this_thread::yield();
+    }
+    if (try_pop(&t)) {
+      return t;
+    }
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  sync_->consumer_waiting_.store(true);
+  while (sync_->head_.load() == sync_->tail_.load()) {
+    sync_->not_empty_.wait(lock);
+  }
+  sync_->consumer_waiting_.store(false);
+  lock.unlock();
+  CHECK(try_pop(&t));
+  return t;
+}
+
+template<typename T>
+size_t SPSCQueue<T>::size() const {
+  return sync_->tail_.load() - sync_->head_.load();
+}
+
+template<typename T>
+size_t SPSCQueue<T>::producer_stalls() const {
+  return sync_->producer_stalls_.load(boost::memory_order_relaxed);
+}
+
+template<typename T>
+size_t SPSCQueue<T>::consumer_stalls() const {
+  return sync_->consumer_stalls_.load(boost::memory_order_relaxed);
+}
+
+template class SPSCQueue<Batch<float>*>;
+template class SPSCQueue<Batch<double>*>;
+template class SPSCQueue<int>;
+
+}  // namespace caffe
@@ -0,0 +1,131 @@
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <deque>
+
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+// One call to Run(): tasks are handed out in index order.
+struct ThreadPoolJob {
+  const boost::function<void(int)>* fn;
+  int size;     // 任务总数
+  int next;     // 下一个待领取的任务编号
+  int pending;  // 尚未完成的任务数
+};
+
+class ThreadPool::sync {
+ public:
+  boost::mutex mutex_;
+  boost::condition_variable work_condition_;
+  boost::condition_variable done_condition_;
+  std::deque<ThreadPoolJob*> jobs_;
+  vector<shared_ptr<boost::thread> > threads_;
+  bool stop_;
+};
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_threads_(std::max(num_threads, 1)), sync_(new sync()) {
+  sync_->stop_ = false;
+  for (int i = 1; i < num_threads_; ++i) {
+    sync_->threads_.push_back(shared_ptr<boost::thread>(
+        new boost::thread(&ThreadPool::WorkerEntry, this)));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->stop_ = true;
+  }
+  sync_->work_condition_.notify_all();
+  for (int i = 0; i < sync_->threads_.size(); ++i) {
+    sync_->threads_[i]->join();
+  }
+}
+
+void ThreadPool::WorkerEntry() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (true) {
+    while (!sync_->stop_ && sync_->jobs_.empty()) {
+      sync_->work_condition_.wait(lock);
+    }
+    if (sync_->stop_) {
+      return;
+    }
+    ThreadPoolJob* job = sync_->jobs_.front();
+    const int index = job->next++;
+    if (job->next == job->size) {
+      sync_->jobs_.pop_front();
+    }
+    lock.unlock();
+    (*job->fn)(index);
+    lock.lock();
+    if (--job->pending == 0) {
+      sync_->done_condition_.notify_all();
+    }
+  }
+}
+
+void ThreadPool::Run(int n, const boost::function<void(int)>& fn) {
+  if (n <= 0) {
+    return;
+  }
+  if (num_threads_ == 1 || n == 1) {
+    for (int i = 0; i < n; ++i) {
+      fn(i);
+    }
+    return;
+  }
+  ThreadPoolJob job;
+  job.fn = &fn;
+  job.size = n;
+  job.next = 0;
+  job.pending = n;
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  sync_->jobs_.push_back(&job);
+  lock.unlock();
+  sync_->work_condition_.notify_all();
+  lock.lock();
+  // The caller works through its own job instead of idling.
+  while (job.next < job.size) {
+    const int index = job.next++;
+    if (job.next == job.size) {
+      sync_->jobs_.erase(
+          std::find(sync_->jobs_.begin(), sync_->jobs_.end(), &job));
+    }
+    lock.unlock();
+    fn(index);
+    lock.lock();
+    --job.pending;
+  }
+  while (job.pending > 0) {
+    sync_->done_condition_.wait(lock);
+  }
+}
+
+static boost::mutex global_pool_mutex_;
+static shared_ptr<ThreadPool> global_pool_;
+
+ThreadPool& ThreadPool::Global() {
+  boost::mutex::scoped_lock lock(global_pool_mutex_);
+  if (!global_pool_) {
+    global_pool_.reset(new ThreadPool(1));
+  }
+  return *global_pool_;
+}
+
+void ThreadPool::SetGlobalThreads(int num_threads) {
+  CHECK_GE(num_threads, 1) << "Thread pool needs at least one thread.";
+  boost::mutex::scoped_lock lock(global_pool_mutex_);
+  if (global_pool_ && global_pool_->num_threads() == num_threads) {
+    return;
+  }
+  global_pool_.reset(new ThreadPool(num_threads));
+}
+
+int ThreadPool::global_threads() {
+  return Global().num_threads();
+}
+
+}  // namespace caffe
@@ -0,0 +1,341 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/transport.hpp"
+
+namespace caffe {
+
+shared_ptr<Transport> Transport::Create(const string& address, int rank,
+    int size) {
+  return shared_ptr<Transport>(new SocketTransport(address, rank, size));
+}
+
+// 等待对方启动的最长时间
+static const int kConnectTimeoutMs = 60000;
+static const int kConnectRetryMs = 100;
+
+static void SendAll(int fd, const void* data, size_t bytes, int peer) {
+  const char* ptr = static_cast<const char*>(data);
+  while (bytes > 0) {
+    const ssize_t sent = send(fd, ptr, bytes, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) { continue; }
+    CHECK_GT(sent, 0) << "Send to rank " << peer << " failed: "
+        << strerror(errno);
+    ptr += sent;
+    bytes -= sent;
+  }
+}
+
+static void RecvAll(int fd, void* data, size_t bytes, int peer) {
+  char* ptr = static_cast<char*>(data);
+  while (bytes > 0) {
+    const ssize_t received = recv(fd, ptr, bytes, 0);
+    if (received < 0 && errno == EINTR) { continue; }
+    CHECK_GE(received, 0) << "Receive from rank " << peer << " failed: "
+        << strerror(errno);
+    CHECK_GT(received, 0) << "Rank " << peer << " closed the connection.";
+    ptr += received;
+    bytes -= received;
+  }
+}
+
+SocketTransport::SocketTransport(const string& address, int rank, int size)
+  : address_(address), rank_(rank), size_(size), sockets_(size, -1) {
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, size);
+  CHECK(address_.compare(0, 5, "unix:") == 0 ||
+      address_.compare(0, 4, "tcp:") == 0)
+      << "Transport address must be unix:<path> or tcp:<host>:<port>, got "
+      << address_;
+  if (size_ == 1) {
+    return;
+  }
+  const int listener = Listen();
+  // 连接更小的 rank，并告诉对方自己的 rank
+  for (int peer = 0; peer < rank_; ++peer) {
+    sockets_[peer] = Connect(peer);
+    const int32_t me = rank_;
+    SendAll(sockets_[peer], &me, sizeof(me), peer);
+  }
+  // 接受更大的 rank 的连接
+  for (int i = rank_ + 1; i < size_; ++i) {
+    const int fd = accept(listener, NULL, NULL);
+    CHECK_GE(fd, 0) << "accept failed: " << strerror(errno);
+    int32_t peer = -1;
+    RecvAll(fd, &peer, sizeof(peer), peer);
+    CHECK(peer > rank_ && peer < size_ && sockets_[peer] < 0)
+        << "Unexpected connection from rank " << peer;
+    sockets_[peer] = fd;
+  }
+  close(listener);
+  if (!unix_path_.empty()) {
+    unlink(unix_path_.c_str());
+  }
+  for (int peer = 0; peer < size_; ++peer) {
+    if (sockets_[peer] >= 0 && address_.compare(0, 4, "tcp:") == 0) {
+      int one = 1;
+      setsockopt(sockets_[peer], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+  }
+  LOG(INFO) << "Rank " << rank_ << " connected to " << size_ - 1
+      << " peers over " << address_;
+}
+
+SocketTransport::~SocketTransport() {
+  for (int peer = 0; peer < size_; ++peer) {
+    if (sockets_[peer] >= 0) {
+      close(sockets_[peer]);
+    }
+  }
+}
+
+// 把 "tcp:<host>:<port>" 中 rank 对应的地址解析出来
+static addrinfo* ResolveTcp(const string& address, int rank) {
+  const string host_port = address.substr(4);
+  const size_t colon = host_port.rfind(':');
+  CHECK_NE(colon, string::npos) << "Missing port in " << address;
+  const string host = host_port.substr(0, colon);
+  const string port = boost::lexical_cast<string>(
+      boost::lexical_cast<int>(host_port.substr(colon + 1)) + rank);
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* result = NULL;
+  const int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+  CHECK_EQ(error, 0) << "Cannot resolve " << host << ": "
+      << gai_strerror(error);
+  return result;
+}
+
+static sockaddr_un UnixAddress(const string& address, int rank) {
+  const string path = address.substr(5) + "." +
+      boost::lexical_cast<string>(rank);
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  CHECK_LT(path.size(), sizeof(addr.sun_path)) << "Path too long: " << path;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  return addr;
+}
+
+int SocketTransport::Listen() {
+  int fd;
+  if (address_.compare(0, 5, "unix:") == 0) {
+    sockaddr_un addr = UnixAddress(address_, rank_);
+    unix_path_ = addr.sun_path;
+    unlink(unix_path_.c_str());
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK_GE(fd, 0) << "socket failed: " << strerror(errno);
+    CHECK_EQ(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0)
+        << "Cannot bind " << unix_path_ << ": " << strerror(errno);
+  } else {
+    addrinfo* info = ResolveTcp(address_, rank_);
+    fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    CHECK_GE(fd, 0) << "socket failed: " << strerror(errno);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    const int error = bind(fd, info->ai_addr, info->ai_addrlen);
+    freeaddrinfo(info);
+    CHECK_EQ(error, 0) << "Cannot bind rank " << rank_ << " to " << address_
+        << ": " << strerror(errno);
+  }
+  CHECK_EQ(listen(fd, size_), 0) << "listen failed: " << strerror(errno);
+  return fd;
+}
+
+int SocketTransport::Connect(int peer) {
+  for (int waited = 0; ; waited += kConnectRetryMs) {
+    int fd;
+    int error;
+    if (address_.compare(0, 5, "unix:") == 0) {
+      sockaddr_un addr = UnixAddress(address_, peer);
+      fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      CHECK_GE(fd, 0) << "socket failed: " << strerror(errno);
+      error = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    } else {
+      addrinfo* info = ResolveTcp(address_, peer);
+      fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+      CHECK_GE(fd, 0) << "socket failed: " << strerror(errno);
+      error = connect(fd, info->ai_addr, info->ai_addrlen);
+      freeaddrinfo(info);
+    }
+    if (error == 0) {
+      return fd;
+    }
+    close(fd);
+    CHECK_LT(waited, kConnectTimeoutMs) << "Rank " << rank_
+        << " cannot connect to rank " << peer << ": " << strerror(errno);
+    boost::this_thread::sleep(boost::posix_time::milliseconds(
+        kConnectRetryMs));
+  }
+}
+
+void SocketTransport::Send(int peer, const void* data, size_t bytes) {
+  SendAll(sockets_[peer], data, bytes, peer);
+}
+
+void SocketTransport::Recv(int peer, void* data, size_t bytes) {
+  RecvAll(sockets_[peer], data, bytes, peer);
+}
+
+void SocketTransport::SendRecv(int send_peer, const void* send_data,
+    size_t send_bytes, int recv_peer, void* recv_data, size_t recv_bytes) {
+  const char* send_ptr = static_cast<const char*>(send_data);
+  char* recv_ptr = static_cast<char*>(recv_data);
+  // 用 poll 同时等待两个方向，哪边可以读写就先处理哪边
+  while (send_bytes > 0 || recv_bytes > 0) {
+    pollfd fds[2];
+    int n = 0;
+    if (send_bytes > 0) {
+      fds[n].fd = sockets_[send_peer];
+      fds[n].events = POLLOUT;
+      fds[n++].revents = 0;
+    }
+    if (recv_bytes > 0) {
+      fds[n].fd = sockets_[recv_peer];
+      fds[n].events = POLLIN;
+      fds[n++].revents = 0;
+    }
+    if (poll(fds, n, -1) < 0) {
+      CHECK_EQ(errno, EINTR) << "poll failed: " << strerror(errno);
+      continue;
+    }
+    for (int i = 0; i < n; ++i) {
+      if (fds[i].revents == 0) { continue; }
+      if (fds[i].events == POLLOUT) {
+        const ssize_t sent = send(fds[i].fd, send_ptr, send_bytes,
+            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+            errno == EINTR)) { continue; }
+        CHECK_GT(sent, 0) << "Send to rank " << send_peer << " failed: "
+            << strerror(errno);
+        send_ptr += sent;
+        send_bytes -= sent;
+      } else {
+        const ssize_t received = recv(fds[i].fd, recv_ptr, recv_bytes,
+            MSG_DONTWAIT);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+            errno == EINTR)) { continue; }
+        CHECK_GE(received, 0) << "Receive from rank " << recv_peer
+            << " failed: " << strerror(errno);
+        CHECK_GT(received, 0) << "Rank " << recv_peer
+            << " closed the connection.";
+        recv_ptr += received;
+        recv_bytes -= received;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void RingAllReduce(Transport* transport, Dtype* data, int count) {
+  const int size = transport->size();
+  const int rank = transport->rank();
+  if (size == 1 || count == 0) {
+    return;
+  }
+  // 把缓冲区分成 size 段，第 i 段为 [begin[i], begin[i + 1])
+  vector<int> begin(size + 1);
+  for (int i = 0; i <= size; ++i) {
+    begin[i] = static_cast<int>(static_cast<int64_t>(count) * i / size);
+  }
+  const int right = (rank + 1) % size;
+  const int left = (rank + size - 1) % size;
+  vector<Dtype> buffer(count / size + 1);
+  // reduce-scatter: 第 step 步把第 rank - step 段发给右边，
+  // 把左边发来的第 rank - step - 1 段累加到自己的数据上
+  for (int step = 0; step < size - 1; ++step) {
+    const int send = (rank - step + size) % size;
+    const int recv = (rank - step - 1 + size) % size;
+    const int recv_count = begin[recv + 1] - begin[recv];
+    transport->SendRecv(right, data + begin[send],
+        (begin[send + 1] - begin[send]) * sizeof(Dtype), left, &buffer[0],
+        recv_count * sizeof(Dtype));
+    caffe_axpy(recv_count, Dtype(1), &buffer[0], data + begin[recv]);
+  }
+  // 现在第 rank + 1 段已经是所有 rank 的和; all-gather 把它们依次传下去
+  for (int step = 0; step < size - 1; ++step) {
+    const int send = (rank + 1 - step + size) % size;
+    const int recv = (rank - step + size) % size;
+    transport->SendRecv(right, data + begin[send],
+        (begin[send + 1] - begin[send]) * sizeof(Dtype), left,
+        data + begin[recv], (begin[recv + 1] - begin[recv]) * sizeof(Dtype));
+  }
+}
+
+template <typename Dtype>
+void TreeAllReduce(Transport* transport, Dtype* data, int count) {
+  const int size = transport->size();
+  const int rank = transport->rank();
+  if (size == 1 || count == 0) {
+    return;
+  }
+  // 二项树归约：rank 先累加 rank + 1, rank + 2, rank + 4, ... 发来的数据，
+  // 再发给 rank 去掉最低位 1 之后的 rank
+  vector<Dtype> buffer(count);
+  for (int mask = 1; mask < size; mask <<= 1) {
+    if (rank & mask) {
+      transport->Send(rank - mask, data, count * sizeof(Dtype));
+      break;
+    }
+    if (rank + mask < size) {
+      transport->Recv(rank + mask, &buffer[0], count * sizeof(Dtype));
+      caffe_axpy(count, Dtype(1), &buffer[0], data);
+    }
+  }
+  TreeBroadcast(transport, data, count);
+}
+
+template <typename Dtype>
+void TreeBroadcast(Transport* transport, Dtype* data, int count) {
+  const int size = transport->size();
+  const int rank = transport->rank();
+  if (size == 1 || count == 0) {
+    return;
+  }
+  // 与归约的方向相反：从父节点接收，再发给 rank + mask/2, rank + mask/4, ...
+  int mask = 1;
+  while (mask < size) {
+    mask <<= 1;
+  }
+  if (rank != 0) {
+    mask = rank & -rank;
+    transport->Recv(rank - mask, data, count * sizeof(Dtype));
+  }
+  for (mask >>= 1; mask > 0; mask >>= 1) {
+    if (rank + mask < size) {
+      transport->Send(rank + mask, data, count * sizeof(Dtype));
+    }
+  }
+}
+
+template void RingAllReduce<float>(Transport* transport, float* data,
+    int count);
+template void RingAllReduce<double>(Transport* transport, double* data,
+    int count);
+template void TreeAllReduce<float>(Transport* transport, float* data,
+    int count);
+template void TreeAllReduce<double>(Transport* transport, double* data,
+    int count);
+template void TreeBroadcast<float>(Transport* transport, float* data,
+    int count);
+template void TreeBroadcast<double>(Transport* transport, double* data,
+    int count);
+
+}  // namespace caffe
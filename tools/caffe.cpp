@@ -13,7 +13,10 @@ namespace bp = boost::python;
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/host_allocator.hpp"
+#include "caffe/util/profiler.hpp"
 #include "caffe/util/signal_handler.h"
+#include "caffe/util/thread_pool.hpp"
 
 using caffe::Blob;
 using caffe::Caffe;
@@ -54,6 +57,31 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_int32(cpu_threads, 1,
+    "Optional; number of threads used by parallel CPU layers.");
+DEFINE_int32(cpu_solvers, 1,
+    "Optional; in CPU mode, train this many solver replicas on threads and "
+    "average their gradients. The effective training batch size is "
+    "multiplied by the number of replicas.");
+DEFINE_bool(numa_pin, false,
+    "Optional; with cpu_solvers > 1, pin each replica to one NUMA node.");
+DEFINE_int32(workers, 1,
+    "Optional; in CPU mode, train with this many processes that average "
+    "their gradients over --transport. Start one process per rank.");
+DEFINE_int32(rank, 0,
+    "Optional; with workers > 1, the rank of this process in [0, workers). "
+    "Rank 0 tests and snapshots.");
+DEFINE_string(transport, "unix:/tmp/caffe_train",
+    "Optional; with workers > 1, where the processes connect: "
+    "unix:<socket path prefix> or tcp:<host>:<base port>.");
+DEFINE_string(allreduce, "ring",
+    "Optional; with workers > 1, the gradient all-reduce: ring or tree.");
+DEFINE_string(host_allocator, "system",
+    "Optional; host memory allocator for CPU blobs: "
+    "system (malloc per allocation) or pooled (cached size classes).");
+DEFINE_string(profile, "",
+    "Optional; record the time and memory traffic of every layer while "
+    "training or testing, and write them to this file as a Chrome trace.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -176,6 +204,34 @@ caffe::SolverAction::Enum GetRequestedAction(
   LOG(FATAL) << "Invalid signal effect \""<< flag_value << "\" was specified";
 }
 
+caffe::HostAllocator::Mode GetHostAllocatorMode(
+    const std::string& flag_value) {
+  if (flag_value == "system") {
+    return caffe::HostAllocator::SYSTEM;
+  }
+  if (flag_value == "pooled") {
+    return caffe::HostAllocator::POOLED;
+  }
+  LOG(FATAL) << "Invalid host allocator \"" << flag_value
+      << "\" was specified";
+}
+
+// Returns a profiler if one was requested with --profile.
+shared_ptr<caffe::Profiler> GetProfiler() {
+  shared_ptr<caffe::Profiler> profiler;
+  if (FLAGS_profile.size()) {
+    profiler.reset(new caffe::Profiler());
+  }
+  return profiler;
+}
+
+void WriteProfile(const shared_ptr<caffe::Profiler>& profiler) {
+  if (profiler) {
+    profiler->LogSummary();
+    profiler->WriteChromeTrace(FLAGS_profile);
+  }
+}
+
 // Train / Finetune a model.
 int train() {
   CHECK_GT(FLAGS_solver.size(), 0) << "Need a solver definition to train.";
@@ -210,6 +266,19 @@ int train() {
   if (gpus.size() == 0) {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
+    CHECK_GE(FLAGS_cpu_solvers, 1);
+    CHECK_GE(FLAGS_workers, 1);
+    CHECK(FLAGS_cpu_solvers == 1 || FLAGS_workers == 1)
+        << "Give either --cpu_solvers or --workers but not both.";
+    if (FLAGS_workers > 1) {
+      CHECK(FLAGS_rank >= 0 && FLAGS_rank < FLAGS_workers)
+          << "--rank must be in [0, " << FLAGS_workers << ").";
+      Caffe::set_solver_count(FLAGS_workers);
+      Caffe::set_solver_rank(FLAGS_rank);
+      Caffe::set_multiprocess(true);
+    } else {
+      Caffe::set_solver_count(FLAGS_cpu_solvers);
+    }
   } else {
     ostringstream s;
     for (int i = 0; i < gpus.size(); ++i) {
@@ -227,6 +296,7 @@ int train() {
     Caffe::SetDevice(gpus[0]);
     Caffe::set_mode(Caffe::GPU);
     Caffe::set_solver_count(gpus.size());
+    CHECK_EQ(FLAGS_workers, 1) << "--workers is only supported in CPU mode.";
   }
 
   caffe::SignalHandler signal_handler(
@@ -245,6 +315,13 @@ int train() {
     CopyLayers(solver.get(), FLAGS_weights);
   }
 
+  // Only the root solver's nets are profiled.
+  shared_ptr<caffe::Profiler> profiler = GetProfiler();
+  solver->net()->set_profiler(profiler);
+  for (int i = 0; i < solver->test_nets().size(); ++i) {
+    solver->test_nets()[i]->set_profiler(profiler);
+  }
+
   LOG(INFO) << "Starting Optimization";
   if (gpus.size() > 1) {
 #ifdef USE_NCCL
@@ -253,10 +330,20 @@ int train() {
 #else
     LOG(FATAL) << "Multi-GPU execution not available - rebuild with USE_NCCL";
 #endif
+  } else if (FLAGS_workers > 1) {
+    caffe::TransportParallel<float> parallel(solver,
+        caffe::Transport::Create(FLAGS_transport, FLAGS_rank, FLAGS_workers),
+        FLAGS_allreduce);
+    parallel.Run();
+  } else if (FLAGS_cpu_solvers > 1) {
+    caffe::CPUParallel<float> parallel(solver);
+    parallel.Run(FLAGS_numa_pin,
+        FLAGS_snapshot.size() > 0 ? FLAGS_snapshot.c_str() : NULL);
   } else {
     solver->Solve();
   }
   LOG(INFO) << "Optimization Done.";
+  WriteProfile(profiler);
   return 0;
 }
 RegisterBrewFunction(train);
@@ -287,6 +374,8 @@ int test() {
   // Instantiate the caffe net.
   Net<float> caffe_net(FLAGS_model, caffe::TEST, FLAGS_level, &stages);
   caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  shared_ptr<caffe::Profiler> profiler = GetProfiler();
+  caffe_net.set_profiler(profiler);
   LOG(INFO) << "Running for " << FLAGS_iterations << " iterations.";
 
   vector<int> test_score_output_id;
@@ -329,6 +418,7 @@ int test() {
     }
     LOG(INFO) << output_name << " = " << mean_score << loss_msg_stream.str();
   }
+  WriteProfile(profiler);
 
   return 0;
 }
@@ -421,6 +511,13 @@ int time() {
   LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
+  if (caffe::HostAllocator::Get().mode() == caffe::HostAllocator::POOLED) {
+    const caffe::HostAllocator::Stats stats =
+        caffe::HostAllocator::Get().stats();
+    LOG(INFO) << "Host allocator: " << stats.bytes_live << " bytes live, "
+        << stats.bytes_cached << " bytes cached, hit rate "
+        << stats.hit_rate();
+  }
   LOG(INFO) << "*** Benchmark ends ***";
   return 0;
 }
@@ -441,6 +538,9 @@ int main(int argc, char** argv) {
       "  time            benchmark model execution time");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  caffe::ThreadPool::SetGlobalThreads(FLAGS_cpu_threads);
+  caffe::HostAllocator::Get().set_mode(
+      GetHostAllocatorMode(FLAGS_host_allocator));
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
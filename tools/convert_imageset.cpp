@@ -7,7 +7,15 @@
 // should be a list of files as well as their labels, in the format as
 //   subfolder1/file1.JPEG 7
 //   ....
-
+//
+// With --threads=N the images are read, resized and encoded by N threads, a
+// window of --commit_size images at a time, while the previous window is
+// written in list order; the db is the same as with one thread. With
+// --shards=N the images go round-robin to the dbs DB_NAME_000, DB_NAME_001,
+// ... instead of DB_NAME.
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
@@ -23,6 +31,7 @@
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
 using std::pair;
@@ -36,12 +45,127 @@ DEFINE_string(backend, "lmdb",
         "The backend {lmdb, leveldb} for storing the result");
 DEFINE_int32(resize_width, 0, "Width images are resized to");
 DEFINE_int32(resize_height, 0, "Height images are resized to");
+DEFINE_bool(reduced_decode, false,
+    "Decode resized JPEG images at 1/2, 1/4 or 1/8 size before resizing");
 DEFINE_bool(check_size, false,
     "When this option is on, check that all the datum have the same size");
 DEFINE_bool(encoded, false,
     "When this option is on, the encoded image will be save in datum");
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg',...).");
+DEFINE_int32(threads, 1,
+    "Number of threads reading, resizing and encoding the images");
+DEFINE_int32(commit_size, 1000,
+    "Number of images written to the db per transaction");
+DEFINE_int32(shards, 1,
+    "Write the images round-robin to this many dbs DB_NAME_000, ...");
+
+#ifdef USE_OPENCV
+// One converted image of the list; value is the serialized Datum.
+struct Record {
+  bool status;
+  int shape_size;  // channels * height * width
+  int data_size;
+  string value;
+};
+
+// 转换列表中的第 first + index 张图片，各个线程互不影响
+static void ConvertImage(const std::vector<std::pair<std::string, int> >* lines,
+    const std::string* root_folder, int first, std::vector<Record>* records,
+    int index) {
+  const int line_id = first + index;
+  Record& record = (*records)[index];
+  std::string enc = FLAGS_encode_type;
+  if (FLAGS_encoded && !enc.size()) {
+    // Guess the encoding type from the file name
+    string fn = (*lines)[line_id].first;
+    size_t p = fn.rfind('.');
+    if ( p == fn.npos )
+      LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
+    enc = fn.substr(p);
+    std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
+  }
+  Datum datum;
+  record.status = ReadImageToDatum(*root_folder + (*lines)[line_id].first,
+      (*lines)[line_id].second, std::max<int>(0, FLAGS_resize_height),
+      std::max<int>(0, FLAGS_resize_width), !FLAGS_gray, enc,
+      FLAGS_reduced_decode, &datum);
+  if (record.status) {
+    record.shape_size = datum.channels() * datum.height() * datum.width();
+    record.data_size = datum.data().size();
+    CHECK(datum.SerializeToString(&record.value));
+  }
+}
+
+// Writes the records of each window in list order, committing every
+// commit_size records of a shard.
+class RecordWriter {
+ public:
+  RecordWriter(const string& name, int num_shards)
+      : dbs_(num_shards), txns_(num_shards), counts_(num_shards, 0),
+        count_(0), data_size_(0), data_size_initialized_(false) {
+    for (int s = 0; s < num_shards; ++s) {
+      dbs_[s].reset(db::GetDB(FLAGS_backend));
+      dbs_[s]->Open(num_shards == 1 ? name :
+          name + "_" + caffe::format_int(s, 3), db::NEW);
+      txns_[s].reset(dbs_[s]->NewTransaction());
+    }
+  }
+
+  void Write(const std::vector<std::pair<std::string, int> >* lines,
+      int first, const std::vector<Record>* records) {
+    for (int index = 0; index < records->size(); ++index) {
+      const Record& record = (*records)[index];
+      if (record.status == false) continue;
+      if (FLAGS_check_size) {
+        if (!data_size_initialized_) {
+          data_size_ = record.shape_size;
+          data_size_initialized_ = true;
+        } else {
+          CHECK_EQ(record.data_size, data_size_)
+              << "Incorrect data field size " << record.data_size;
+        }
+      }
+      // sequential
+      const int line_id = first + index;
+      string key_str = caffe::format_int(line_id, 8) + "_" +
+          (*lines)[line_id].first;
+
+      // Put in db
+      const int s = count_ % dbs_.size();
+      txns_[s]->Put(key_str, record.value);
+      ++count_;
+      if (++counts_[s] % FLAGS_commit_size == 0) {
+        // Commit db
+        txns_[s]->Commit();
+        txns_[s].reset(dbs_[s]->NewTransaction());
+        LOG(INFO) << "Processed " << count_ << " files.";
+      }
+    }
+  }
+
+  // write the last batch
+  void Finish() {
+    for (int s = 0; s < dbs_.size(); ++s) {
+      if (counts_[s] % FLAGS_commit_size != 0) {
+        txns_[s]->Commit();
+      }
+      txns_[s].reset();
+      dbs_[s]->Close();
+    }
+  }
+
+  inline int count() const { return count_; }
+
+ protected:
+  std::vector<shared_ptr<db::DB> > dbs_;
+  std::vector<shared_ptr<db::Transaction> > txns_;
+  std::vector<int> counts_;
+  int count_;
+  int data_size_;
+  bool data_size_initialized_;
+};
+#endif  // USE_OPENCV
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -66,10 +190,9 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  const bool is_color = !FLAGS_gray;
-  const bool check_size = FLAGS_check_size;
-  const bool encoded = FLAGS_encoded;
-  const string encode_type = FLAGS_encode_type;
+  CHECK_GE(FLAGS_threads, 1) << "Need at least one thread.";
+  CHECK_GE(FLAGS_commit_size, 1) << "Need a positive commit size.";
+  CHECK_GE(FLAGS_shards, 1) << "Need at least one shard.";
 
   std::ifstream infile(argv[2]);
   std::vector<std::pair<std::string, int> > lines;
@@ -88,70 +211,42 @@ int main(int argc, char** argv) {
   }
   LOG(INFO) << "A total of " << lines.size() << " images.";
 
-  if (encode_type.size() && !encoded)
+  if (FLAGS_encode_type.size() && !FLAGS_encoded)
     LOG(INFO) << "encode_type specified, assuming encoded=true.";
 
-  int resize_height = std::max<int>(0, FLAGS_resize_height);
-  int resize_width = std::max<int>(0, FLAGS_resize_width);
-
   // Create new DB
-  scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
-  db->Open(argv[3], db::NEW);
-  scoped_ptr<db::Transaction> txn(db->NewTransaction());
+  RecordWriter writer(argv[3], FLAGS_shards);
 
   // Storing to db
+  // 线程池转换一个窗口的图片时，写线程按顺序写入上一个窗口
   std::string root_folder(argv[1]);
-  Datum datum;
-  int count = 0;
-  int data_size = 0;
-  bool data_size_initialized = false;
-
-  for (int line_id = 0; line_id < lines.size(); ++line_id) {
-    bool status;
-    std::string enc = encode_type;
-    if (encoded && !enc.size()) {
-      // Guess the encoding type from the file name
-      string fn = lines[line_id].first;
-      size_t p = fn.rfind('.');
-      if ( p == fn.npos )
-        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
-      enc = fn.substr(p);
-      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
-    }
-    status = ReadImageToDatum(root_folder + lines[line_id].first,
-        lines[line_id].second, resize_height, resize_width, is_color,
-        enc, &datum);
-    if (status == false) continue;
-    if (check_size) {
-      if (!data_size_initialized) {
-        data_size = datum.channels() * datum.height() * datum.width();
-        data_size_initialized = true;
-      } else {
-        const std::string& data = datum.data();
-        CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
-            << data.size();
-      }
-    }
-    // sequential
-    string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
-
-    // Put in db
-    string out;
-    CHECK(datum.SerializeToString(&out));
-    txn->Put(key_str, out);
-
-    if (++count % 1000 == 0) {
-      // Commit db
-      txn->Commit();
-      txn.reset(db->NewTransaction());
-      LOG(INFO) << "Processed " << count << " files.";
+  ThreadPool pool(FLAGS_threads);
+  std::vector<Record> records[2];
+  scoped_ptr<boost::thread> write_thread;
+  const boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::local_time();
+  for (int first = 0, w = 0; first < lines.size();
+      first += FLAGS_commit_size, w ^= 1) {
+    records[w].resize(std::min<int>(FLAGS_commit_size, lines.size() - first));
+    pool.Run(records[w].size(), boost::bind(&ConvertImage, &lines,
+        &root_folder, first, &records[w], _1));
+    if (write_thread) {
+      write_thread->join();
     }
+    write_thread.reset(new boost::thread(boost::bind(&RecordWriter::Write,
+        &writer, &lines, first, &records[w])));
+    const float seconds = (boost::posix_time::microsec_clock::local_time() -
+        start).total_milliseconds() / 1000.f;
+    const int converted = first + records[w].size();
+    LOG(INFO) << "Converted " << converted << " files ("
+        << converted / std::max(seconds, 1e-3f) << " files/s).";
   }
-  // write the last batch
-  if (count % 1000 != 0) {
-    txn->Commit();
-    LOG(INFO) << "Processed " << count << " files.";
+  if (write_thread) {
+    write_thread->join();
   }
+  writer.Finish();
+  LOG(INFO) << "Wrote " << writer.count() << " of " << lines.size()
+      << " files to " << FLAGS_shards << " db(s).";
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
@@ -0,0 +1,56 @@
+// This program converts trained weights between the .caffemodel (binary
+// proto), .h5 (HDF5) and .caffeweights (mapped, see MappedWeights) formats.
+// The formats are chosen by the file extensions.
+// Usage:
+//    convert_weights input_weights output_weights
+// Mapped weights load in time proportional to the number of blobs rather
+// than their size, e.g. for inference servers that start often.
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/hdf5.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+static bool IsHDF5File(const string& filename) {
+  return filename.size() >= 3 &&
+      filename.compare(filename.size() - 3, 3, ".h5") == 0;
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 3) {
+    LOG(ERROR) << "Usage: convert_weights input_weights output_weights";
+    return 1;
+  }
+  const string input(argv[1]);
+  const string output(argv[2]);
+  NetParameter param;
+  if (IsHDF5File(input)) {
+    hdf5_load_net_weights(input, &param);
+  } else if (IsMappedWeightsFile(input)) {
+    ReadMappedWeights(input, &param);
+  } else {
+    ReadNetParamsFromBinaryFileOrDie(input, &param);
+  }
+  int num_blobs = 0;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    num_blobs += param.layer(i).blobs_size();
+  }
+  LOG(INFO) << "Read " << num_blobs << " blobs of " << param.layer_size()
+      << " layers from " << input;
+
+  if (IsHDF5File(output)) {
+    hdf5_save_net_weights(param, output);
+  } else if (IsMappedWeightsFile(output)) {
+    WriteMappedWeights(param, output);
+  } else {
+    WriteProtoToBinaryFile(param, output);
+  }
+  LOG(INFO) << "Wrote weights to " << output;
+  return 0;
+}
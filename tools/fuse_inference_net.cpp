@@ -0,0 +1,56 @@
+// This program folds the BatchNorm, Scale and ReLU layers that follow the
+// convolutions of a deploy net into the convolutions themselves, so that
+// inference does one pass over each convolution output instead of four.
+// Usage:
+//    fuse_inference_net deploy_prototxt weights fused_prototxt fused_weights
+// The fused net must only be used for inference.
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/fuse_layers.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 5) {
+    LOG(ERROR) << "Usage: fuse_inference_net deploy_prototxt weights "
+        << "fused_prototxt fused_weights";
+    return 1;
+  }
+  Caffe::set_mode(Caffe::CPU);
+  Net<float> net(argv[1], TEST);
+  net.CopyTrainedLayersFrom(argv[2]);
+  // Attach the trained blobs to the deploy layers. Net::ToProto would also
+  // write the Split layers that Net inserted, which do not belong in a
+  // prototxt.
+  NetParameter deploy_param;
+  ReadNetParamsFromTextFileOrDie(argv[1], &deploy_param);
+  deploy_param.mutable_state()->set_phase(TEST);
+  NetParameter param;
+  Net<float>::FilterNet(deploy_param, &param);
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const vector<shared_ptr<Blob<float> > >& blobs =
+        net.layer_by_name(param.layer(i).name())->blobs();
+    for (int j = 0; j < blobs.size(); ++j) {
+      blobs[j]->ToProto(param.mutable_layer(i)->add_blobs());
+    }
+  }
+
+  NetParameter fused_param;
+  FuseInferenceLayers(param, &fused_param);
+  LOG(INFO) << "Fused " << param.layer_size() << " layers into "
+      << fused_param.layer_size() << ".";
+  WriteProtoToBinaryFile(fused_param, argv[4]);
+  LOG(INFO) << "Wrote fused weights to " << argv[4];
+  for (int i = 0; i < fused_param.layer_size(); ++i) {
+    fused_param.mutable_layer(i)->clear_blobs();
+  }
+  WriteProtoToTextFile(fused_param, argv[3]);
+  LOG(INFO) << "Wrote fused net to " << argv[3];
+  return 0;
+}
@@ -0,0 +1,263 @@
+// This program serves a deploy net over a socket, batching the requests of
+// all connections (see BatchingServer).
+// Usage:
+//    inference_server --model=deploy.prototxt --weights=net.caffemodel
+//        [--address=unix:/tmp/caffe_inference] [--workers=4]
+//        [--max_batch=32] [--max_latency_us=2000]
+// With --clients=N it instead sends --requests random inputs over each of
+// N connections to a running server and reports the latency it observed.
+//
+// Protocol: on connecting, the server sends the uint32 number of floats of a
+// request and of a response. Then each request is the uint32 number of
+// floats followed by the floats (native byte order), answered the same way.
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe/batching_server.hpp"
+#include "caffe/caffe.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_string(model, "", "The deploy net prototxt.");
+DEFINE_string(weights, "", "The trained weights.");
+DEFINE_string(address, "unix:/tmp/caffe_inference",
+    "unix:<socket path> or tcp:<port> to listen on (or connect to).");
+DEFINE_int32(gpu, -1, "Run on this GPU instead of the CPU.");
+DEFINE_int32(workers, 4, "Number of net replicas running batches.");
+DEFINE_int32(max_batch, 32, "Largest batch of requests.");
+DEFINE_int32(max_latency_us, 2000,
+    "Longest time a request waits for its batch to fill.");
+DEFINE_int32(stats_interval, 10, "Seconds between stats logs.");
+DEFINE_int32(clients, 0, "Run as a load generator with this many "
+    "connections instead of serving.");
+DEFINE_int32(requests, 1000, "Requests per client connection.");
+
+static bool SendAll(int fd, const void* data, size_t bytes) {
+  const char* p = static_cast<const char*>(data);
+  while (bytes > 0) {
+    const ssize_t n = send(fd, p, bytes, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    bytes -= n;
+  }
+  return true;
+}
+
+static bool RecvAll(int fd, void* data, size_t bytes) {
+  char* p = static_cast<char*>(data);
+  while (bytes > 0) {
+    const ssize_t n = recv(fd, p, bytes, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    bytes -= n;
+  }
+  return true;
+}
+
+static bool SendFloats(int fd, const vector<float>& data) {
+  const uint32_t count = data.size();
+  return SendAll(fd, &count, sizeof(count)) &&
+      SendAll(fd, &data[0], count * sizeof(float));
+}
+
+// 读入的数目必须等于 expected
+static bool RecvFloats(int fd, uint32_t expected, vector<float>* data) {
+  uint32_t count;
+  if (!RecvAll(fd, &count, sizeof(count)) || count != expected) {
+    return false;
+  }
+  data->resize(count);
+  return RecvAll(fd, &(*data)[0], count * sizeof(float));
+}
+
+// 根据 --address 创建 socket，并返回对应的地址
+static int CreateSocket(sockaddr_storage* addr, socklen_t* addr_len) {
+  memset(addr, 0, sizeof(*addr));
+  int fd;
+  if (FLAGS_address.compare(0, 5, "unix:") == 0) {
+    sockaddr_un* unix_addr = reinterpret_cast<sockaddr_un*>(addr);
+    const string path = FLAGS_address.substr(5);
+    CHECK_LT(path.size(), sizeof(unix_addr->sun_path)) << "Path too long.";
+    unix_addr->sun_family = AF_UNIX;
+    strncpy(unix_addr->sun_path, path.c_str(), sizeof(unix_addr->sun_path));
+    *addr_len = sizeof(sockaddr_un);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  } else {
+    CHECK_EQ(FLAGS_address.compare(0, 4, "tcp:"), 0)
+        << "Unknown address " << FLAGS_address;
+    sockaddr_in* tcp_addr = reinterpret_cast<sockaddr_in*>(addr);
+    tcp_addr->sin_family = AF_INET;
+    tcp_addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    tcp_addr->sin_port = htons(
+        boost::lexical_cast<int>(FLAGS_address.substr(4)));
+    *addr_len = sizeof(sockaddr_in);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+  }
+  CHECK_GE(fd, 0) << "socket failed: " << strerror(errno);
+  return fd;
+}
+
+static void SetNoDelay(int fd) {
+  if (FLAGS_address.compare(0, 4, "tcp:") == 0) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+}
+
+static void Serve(BatchingServer<float>* server, int fd) {
+  const uint32_t counts[2] = {
+    static_cast<uint32_t>(server->input_count()),
+    static_cast<uint32_t>(server->output_count())
+  };
+  vector<float> input;
+  vector<float> output(server->output_count());
+  if (SendAll(fd, counts, sizeof(counts))) {
+    while (RecvFloats(fd, counts[0], &input)) {
+      server->Predict(&input[0], &output[0]);
+      if (!SendFloats(fd, output)) {
+        break;
+      }
+    }
+  }
+  close(fd);
+}
+
+static void LogStats(BatchingServer<float>* server) {
+  while (true) {
+    boost::this_thread::sleep(boost::posix_time::seconds(
+        FLAGS_stats_interval));
+    const BatchingServer<float>::Stats stats = server->stats();
+    LOG(INFO) << "Served " << stats.requests << " requests in "
+        << stats.batches << " batches (" << (stats.batches > 0 ?
+        static_cast<float>(stats.requests) / stats.batches : 0)
+        << " per batch), " << stats.requests / stats.seconds
+        << " requests/s, latency p50 " << stats.p50_latency_ms
+        << " ms, p99 " << stats.p99_latency_ms << " ms";
+  }
+}
+
+static void RunServer() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to serve.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to serve.";
+  if (FLAGS_gpu >= 0) {
+    Caffe::SetDevice(FLAGS_gpu);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    Caffe::set_mode(Caffe::CPU);
+  }
+  shared_ptr<InferenceReplicas<float> > replicas(new InferenceReplicas<float>(
+      FLAGS_model, FLAGS_weights, FLAGS_workers));
+  BatchingServer<float> server(replicas, FLAGS_max_batch,
+      FLAGS_max_latency_us);
+
+  sockaddr_storage addr;
+  socklen_t addr_len;
+  const int listener = CreateSocket(&addr, &addr_len);
+  if (addr.ss_family == AF_UNIX) {
+    unlink(reinterpret_cast<sockaddr_un*>(&addr)->sun_path);
+  } else {
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  }
+  CHECK_EQ(bind(listener, reinterpret_cast<sockaddr*>(&addr), addr_len), 0)
+      << "Cannot bind " << FLAGS_address << ": " << strerror(errno);
+  CHECK_EQ(listen(listener, 128), 0) << "listen failed: " << strerror(errno);
+  LOG(INFO) << "Serving " << FLAGS_model << " on " << FLAGS_address
+      << " with " << FLAGS_workers << " workers, batches of up to "
+      << FLAGS_max_batch << " within " << FLAGS_max_latency_us << " us.";
+  boost::thread stats_thread(boost::bind(&LogStats, &server));
+  while (true) {
+    const int fd = accept(listener, NULL, NULL);
+    if (fd < 0) {
+      CHECK_EQ(errno, EINTR) << "accept failed: " << strerror(errno);
+      continue;
+    }
+    SetNoDelay(fd);
+    boost::thread(boost::bind(&Serve, &server, fd)).detach();
+  }
+}
+
+static void RunClient(vector<float>* latencies_ms) {
+  sockaddr_storage addr;
+  socklen_t addr_len;
+  const int fd = CreateSocket(&addr, &addr_len);
+  CHECK_EQ(connect(fd, reinterpret_cast<sockaddr*>(&addr), addr_len), 0)
+      << "Cannot connect to " << FLAGS_address << ": " << strerror(errno);
+  SetNoDelay(fd);
+  uint32_t counts[2];
+  CHECK(RecvAll(fd, counts, sizeof(counts))) << "Lost the connection.";
+  vector<float> input(counts[0]);
+  vector<float> output;
+  unsigned int seed = fd;
+  for (int i = 0; i < FLAGS_requests; ++i) {
+    for (int j = 0; j < input.size(); ++j) {
+      input[j] = static_cast<float>(rand_r(&seed)) / RAND_MAX;
+    }
+    const boost::system_time start = boost::get_system_time();
+    CHECK(SendFloats(fd, input) && RecvFloats(fd, counts[1], &output))
+        << "Lost the connection.";
+    latencies_ms->push_back(
+        (boost::get_system_time() - start).total_microseconds() / 1000.0);
+  }
+  close(fd);
+}
+
+static void RunClients() {
+  vector<vector<float> > latencies(FLAGS_clients);
+  const boost::system_time start = boost::get_system_time();
+  boost::thread_group threads;
+  for (int i = 0; i < FLAGS_clients; ++i) {
+    threads.create_thread(boost::bind(&RunClient, &latencies[i]));
+  }
+  threads.join_all();
+  const double seconds =
+      (boost::get_system_time() - start).total_microseconds() / 1e6;
+  vector<float> all;
+  for (int i = 0; i < latencies.size(); ++i) {
+    all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+  }
+  CHECK_GT(all.size(), 0);
+  std::sort(all.begin(), all.end());
+  LOG(INFO) << all.size() << " requests in " << seconds << " s: "
+      << all.size() / seconds << " requests/s, latency p50 "
+      << all[all.size() / 2] << " ms, p99 "
+      << all[std::min(all.size() - 1, all.size() * 99 / 100)] << " ms";
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  gflags::SetUsageMessage("Serves a net over a socket, batching requests.\n"
+      "Usage: inference_server --model=<prototxt> --weights=<weights>");
+  caffe::GlobalInit(&argc, &argv);
+  if (FLAGS_clients > 0) {
+    RunClients();
+  } else {
+    RunServer();
+  }
+  return 0;
+}